@@ -0,0 +1,39 @@
+# turns an atmosim config into a header of its values, so a build can have them as compile-time constants
+# only understands what configs use: [Section] headers, `Key = number` lines and comments
+function(atmosim_bake_config config_path out_header)
+    file(STRINGS "${config_path}" lines)
+    set(section "")
+    set(values "")
+    set(count 0)
+    foreach(line IN LISTS lines)
+        string(REGEX REPLACE "#.*$" "" line "${line}")
+        string(STRIP "${line}" line)
+        if(line STREQUAL "")
+            continue()
+        elseif(line MATCHES "^\\[([A-Za-z0-9_]+)\\]$")
+            set(section "${CMAKE_MATCH_1}")
+        elseif(line MATCHES "^([A-Za-z0-9_]+)[ \t]*=[ \t]*([-+]?[0-9][0-9.eE+-]*)$")
+            string(APPEND values "    config_value{\"${section}\", \"${CMAKE_MATCH_1}\", float(${CMAKE_MATCH_2})},\n")
+            math(EXPR count "${count} + 1")
+        else()
+            message(FATAL_ERROR "Can't bake ${config_path}, don't understand line: ${line}")
+        endif()
+    endforeach()
+
+    # only rewritten when the values change, so reconfiguring doesn't rebuild everything
+    file(CONFIGURE OUTPUT "${out_header}" CONTENT
+"// generated from ${config_path} by cmake/bake_config.cmake, do not edit
+#pragma once
+
+#include <array>
+
+namespace asim {
+
+inline constexpr std::string_view baked_config_path = \"${config_path}\";
+
+inline constexpr std::array<config_value, ${count}> baked_config_values = {
+${values}};
+
+}
+")
+endfunction()
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+
+#include "gas.hpp"
+#include "tank.hpp"
+
+namespace asim {
+
+// how many tanks are simulated in lockstep
+// 16 floats fill one AVX-512 register or two AVX2 registers
+inline constexpr size_t batch_width = 16;
+
+/// <gas_mixture_batch>
+
+// struct-of-arrays version of gas_mixture holding batch_width mixtures
+// every per-lane computation mirrors gas_mixture operation-for-operation, so results are identical to the scalar kernel
+// lanes are written as branchless loops over the batch so the compiler can vectorise them
+struct gas_mixture_batch {
+    alignas(64) float amounts[gas_count][batch_width] {};
+    alignas(64) float temperature[batch_width] {};
+    // gas_mixture's cached sums, updated the same way
+    alignas(64) float cached_total_gas[batch_width] {};
+    alignas(64) float cached_heat_capacity[batch_width] {};
+#ifdef ASIM_BAKED_CONFIG
+    static constexpr const ruleset* rules = &default_ruleset;
+#else
+    const ruleset* rules;
+#endif
+    float volume;
+    float rvol = rules->R / volume;
+    // reactions checked for, see possible_reactions()
+    reaction_mask reactions = all_reactions_mask;
+
+    // every mixture loaded has to use the same rules
+#ifdef ASIM_BAKED_CONFIG
+    gas_mixture_batch(float volume, const ruleset& = default_ruleset): volume(volume) {};
+#else
+    gas_mixture_batch(float volume, const ruleset& rules = default_ruleset): rules(&rules), volume(volume) {};
+#endif
+
+    void load(size_t lane, const gas_mixture& mix);
+    void store(size_t lane, gas_mixture& mix) const;
+
+    // recompute the cached sums of lanes set in lanes from their amounts
+    void refresh_cache(const int* lanes);
+    void heat_capacity(float* out) const;
+    void pressure(float* out) const;
+
+    // do gas reactions on lanes with active set
+    // reacted: per-lane reactions that happened, like gas_mixture::reaction_tick() returns
+    void reaction_tick(const int* active, int* reacted);
+
+private:
+    void react_plasma_fire(const int* gate, float* heat_capacity_cache, int* reacted);
+    void react_tritium_fire_old(const int* gate, float* heat_capacity_cache, int* reacted);
+    void react_tritium_fire_new(const int* gate, float* heat_capacity_cache, int* reacted);
+    void react_N2O_decomposition(const int* gate, float* heat_capacity_cache, int* reacted);
+    void react_frezon_production(const int* gate, float* heat_capacity_cache, int* reacted);
+    void react_frezon_coolant(const int* gate, float* heat_capacity_cache, int* reacted);
+    void react_nitrium_decomposition(const int* gate, float* heat_capacity_cache, int* reacted);
+};
+
+/// </gas_mixture_batch>
+
+/// <gas_tank_batch>
+
+// batch_width tanks ticked together
+// lanes retire on their own as they explode, rupture, go inert or hit the tick limit, and can then be refilled with load()
+struct gas_tank_batch {
+    gas_mixture_batch mix;
+    int state[batch_width] {};
+    int integrity[batch_width] {};
+    size_t ticks[batch_width] {};
+    int active[batch_width] {};
+    size_t ticks_limit;
+
+    // reactions: only check for these, every tank loaded has to be unable to do the others
+    gas_tank_batch(size_t ticks_limit, reaction_mask reactions = all_reactions_mask, const ruleset& rules = default_ruleset)
+        : mix(rules.tank_volume, rules), ticks_limit(ticks_limit) {
+        mix.reactions = reactions;
+    };
+
+    // put a tank into a lane and start simulating it
+    void load(size_t lane, const gas_tank& tank);
+    // read a lane back out - ticks[lane] holds what gas_tank::tick_n() would have returned
+    void store(size_t lane, gas_tank& tank) const;
+
+    size_t active_count() const;
+
+    // go forward in time one tick on all active lanes
+    // returns: how many lanes are still active
+    size_t tick();
+    // simulate until every lane is retired
+    void tick_n();
+};
+
+/// </gas_tank_batch>
+
+}
@@ -0,0 +1,435 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "optimiser.hpp"
+#include "profile.hpp"
+#include "rng.hpp"
+#include "thread_pool.hpp"
+#include "timeline.hpp"
+#include "utility.hpp"
+
+namespace asim {
+
+// CMA-ES with IPOP restarts, taking the same configuration as optimiser<T, R>
+// samples a gaussian around a mean, moves the mean towards the best samples and learns their covariance
+// each run restarts from a random mean with twice the samples per generation once it converges or stalls, see Hansen 2016 and Auger & Hansen 2005
+template<typename T, typename R>
+struct cmaes {
+    // generic optimiser configuration
+    std::function<R(const std::vector<float>&, const T&)> funct;
+    // optional: evaluates several inputs at once, used instead of funct if set
+    std::function<void(std::span<const std::vector<float>>, const T&, std::span<R>)> batch_funct;
+    T args;
+    std::vector<float> lower_bounds;
+    std::vector<float> upper_bounds;
+    bool maximise;
+    duration_t max_duration;
+    size_t log_level;
+    // a generation's samples are split between this many threads, each handing its share to batch_funct at once
+    size_t n_threads = 1;
+    // stop after this many samples instead of once max_duration passes if set
+    size_t max_samples = 0;
+    // seeds the random stream if set, so the same budget always finds the same result
+    std::optional<uint64_t> seed;
+
+    // CMA-ES parameters
+    // samples per generation of the first run, 0 for 4 + 3 ln(dimensions)
+    size_t lambda = 0;
+    // initial step size, as a fraction of the bounds
+    float sigma0 = 0.3f;
+    // a run has converged once every axis' step is below this, as a fraction of the bounds
+    float sigma_tol = 1e-5f;
+    // a run has stalled once its best hasn't improved for this many generations, 0 for 10 + 30 dimensions / lambda
+    size_t stall_generations = 0;
+    // a run has gone degenerate once its covariance's axes are this many times apart
+    float max_condition = 1e7f;
+
+    // optional: fills in details of a result that is about to become a best, so funct can return cheap results
+    std::function<void(const std::vector<float>&, const T&, R&)> materialise_funct;
+    // optional: told about every new best result, e.g. so funct can give up on inputs that can't beat it
+    std::function<void(const R&)> best_funct;
+    // optional: extra status appended to the progress line
+    std::function<std::string()> status_funct;
+    // print where time went once done, only does anything when built with ASIM_PROFILE
+    bool print_profile = false;
+
+    // Reporting
+    duration_t poll_spacing = as_seconds(0.025f);
+    duration_t speed_log_spacing = as_seconds(0.5f);
+
+    // Results
+    std::vector<float> best_arg;
+    R best_result;
+    size_t sample_count = 0, valid_sample_count = 0;
+    size_t restarts = 0;
+
+    cmaes(std::function<R(const std::vector<float>&, T)> func,
+          const std::vector<float>& lowerb,
+          const std::vector<float>& upperb,
+          bool maxm,
+          T i_args,
+          duration_t i_max_duration,
+          size_t log_level = LOG_NONE)
+    :
+          funct(func),
+          args(i_args),
+          lower_bounds(lowerb),
+          upper_bounds(upperb),
+          maximise(maxm),
+          max_duration(i_max_duration),
+          log_level(log_level),
+          rng(xoshiro256ss::random()) {
+
+        if (lowerb.size() != upperb.size()) {
+            throw std::runtime_error("optimiser parameters have mismatched dimensions");
+        }
+        for (size_t i = 0; i < lowerb.size(); ++i) {
+            if (lowerb[i] > upperb[i]) {
+                throw std::runtime_error("optimiser upper bound " + std::to_string(i) + " was smaller than lower bound");
+            }
+        }
+    }
+
+    void find_best() {
+        PROFILE if (print_profile) profile_reset();
+        if (seed) rng.seed(*seed);
+        // search the dimensions that aren't fixed, scaled to [0, 1]
+        free_dims.clear();
+        for (size_t i = 0; i < lower_bounds.size(); ++i) {
+            if (lower_bounds[i] != upper_bounds[i]) free_dims.push_back(i);
+        }
+        n = free_dims.size();
+
+        std::unique_ptr<thread_pool> pool;
+        if (n_threads != 1) pool = std::make_unique<thread_pool>(n_threads);
+
+        time_point_t end_time = main_clock.now() + max_duration;
+        last_poll_time = last_speed_update_time = main_clock.now();
+        size_t run_lambda = lambda != 0 ? lambda : 4 + (size_t)(3.0 * std::log(std::max(n, (size_t)1)));
+        restarts = 0;
+
+        auto keep_going = [&]{
+            if (status_SIGINT) return false;
+            return max_samples != 0 ? sample_count < max_samples : main_clock.now() < end_time;
+        };
+        while (keep_going()) {
+            start_run(run_lambda);
+            while (keep_going()) {
+                evaluate_generation(pool.get());
+                if (n == 0 || !update()) break;
+                log_progress();
+            }
+            if (n == 0) break;
+
+            run_lambda *= 2;
+            ++restarts;
+            timeline_instant("restart", "lambda", run_lambda);
+            log([&]{ return std::format("Restarting with {} samples per generation, best: {}", run_lambda, best_result.rating_str()); }, log_level, LOG_INFO);
+        }
+
+        PROFILE if (print_profile) log(profile_report, log_level, LOG_NONE, false);
+        log([&]() { return std::format("Finished with {} ({}) samples after {} restarts", sample_count, valid_sample_count, restarts); }, log_level, LOG_BASIC);
+        // callers go on to print results themselves
+        log_flush();
+    }
+
+    // State
+    xoshiro256ss rng;
+    std::vector<size_t> free_dims;
+    size_t n = 0;
+
+    // strategy parameters of the current run
+    size_t mu;
+    std::vector<double> weights;
+    double mueff, cc, cs, c1, cmu, damps, chi_n;
+    size_t run_stall;
+
+    // state of the current run, in the scaled space
+    std::vector<double> mean;
+    double sigma;
+    // covariance, row-major, and its eigendecomposition C = B diag(D)^2 B^T
+    std::vector<double> C, B, D;
+    std::vector<double> pc, ps;
+    size_t generation;
+    R run_best;
+    size_t run_best_generation;
+
+    // the current generation: samples, as offsets y from the mean in units of sigma, and their evaluations
+    std::vector<std::vector<double>> ys;
+    std::vector<std::vector<float>> samples;
+    std::vector<R> results;
+
+    time_point_t last_poll_time;
+    time_point_t last_speed_update_time;
+    size_t last_sample_count = 0, last_valid_sample_count = 0;
+    float speed_iters = 0.f, speed_valid_iters = 0.f;
+
+    void start_run(size_t run_lambda) {
+        mu = run_lambda / 2;
+        weights.resize(mu);
+        double sum = 0.0, sum_sq = 0.0;
+        for (size_t i = 0; i < mu; ++i) {
+            weights[i] = std::log(mu + 0.5) - std::log(i + 1.0);
+            sum += weights[i];
+        }
+        for (double& w : weights) {
+            w /= sum;
+            sum_sq += w * w;
+        }
+        mueff = 1.0 / sum_sq;
+
+        double dn = std::max(n, (size_t)1);
+        cc = (4.0 + mueff / dn) / (dn + 4.0 + 2.0 * mueff / dn);
+        cs = (mueff + 2.0) / (dn + mueff + 5.0);
+        c1 = 2.0 / ((dn + 1.3) * (dn + 1.3) + mueff);
+        cmu = std::min(1.0 - c1, 2.0 * (mueff - 2.0 + 1.0 / mueff) / ((dn + 2.0) * (dn + 2.0) + mueff));
+        damps = 1.0 + 2.0 * std::max(0.0, std::sqrt((mueff - 1.0) / (dn + 1.0)) - 1.0) + cs;
+        chi_n = std::sqrt(dn) * (1.0 - 1.0 / (4.0 * dn) + 1.0 / (21.0 * dn * dn));
+        run_stall = stall_generations != 0 ? stall_generations : 10 + (size_t)std::ceil(30.0 * dn / run_lambda);
+
+        mean.resize(n);
+        for (double& m : mean) m = rng.uniform();
+        sigma = sigma0;
+        C.assign(n * n, 0.0);
+        B.assign(n * n, 0.0);
+        for (size_t i = 0; i < n; ++i) C[i * n + i] = B[i * n + i] = 1.0;
+        D.assign(n, 1.0);
+        pc.assign(n, 0.0);
+        ps.assign(n, 0.0);
+        generation = 0;
+        run_best = R();
+        run_best_generation = 0;
+
+        ys.assign(run_lambda, std::vector<double>(n));
+        samples.assign(run_lambda, std::vector<float>(lower_bounds.size()));
+        results.assign(run_lambda, R());
+    }
+
+    // draw a generation around the mean and evaluate it, clamped to bounds
+    void evaluate_generation(thread_pool* pool) {
+        timeline_span span("generation", "generation", generation + 1);
+        std::normal_distribution<double> normal;
+        std::vector<double> z(n);
+        {
+            profile_scope scope(profile_phase::trial);
+            for (size_t k = 0; k < samples.size(); ++k) {
+                for (double& v : z) v = normal(rng);
+                std::vector<double>& y = ys[k];
+                for (size_t i = 0; i < n; ++i) {
+                    double sum = 0.0;
+                    for (size_t j = 0; j < n; ++j) sum += B[i * n + j] * D[j] * z[j];
+                    // clamp, and keep what we clamped to so the update learns from what was actually evaluated
+                    double x = std::clamp(mean[i] + sigma * sum, 0.0, 1.0);
+                    y[i] = (x - mean[i]) / sigma;
+                }
+                to_input(ys[k], samples[k]);
+            }
+        }
+
+        size_t count = samples.size();
+        size_t share = pool ? (count + pool->size() - 1) / pool->size() : count;
+        for (size_t from = 0; from < count; from += share) {
+            size_t len = std::min(share, count - from);
+            auto task = [this, from, len]{
+                profile_scope scope(profile_phase::evaluate);
+                timeline_span span("evaluate", "samples", len);
+                std::span<const std::vector<float>> at(samples.data() + from, len);
+                std::span<R> res(results.data() + from, len);
+                if (batch_funct) {
+                    batch_funct(at, args, res);
+                } else {
+                    for (size_t k = 0; k < len; ++k) res[k] = funct(at[k], args);
+                }
+            };
+            if (pool) {
+                pool->submit(task);
+            } else {
+                task();
+            }
+        }
+        if (pool) pool->wait_idle();
+
+        profile_scope scope(profile_phase::select);
+        for (size_t k = 0; k < count; ++k) {
+            record(samples[k], results[k]);
+        }
+    }
+
+    void to_input(const std::vector<double>& y, std::vector<float>& input) const {
+        input = lower_bounds;
+        for (size_t i = 0; i < n; ++i) {
+            size_t d = free_dims[i];
+            float at = (float)std::clamp(mean[i] + sigma * y[i], 0.0, 1.0);
+            input[d] = lower_bounds[d] + at * (upper_bounds[d] - lower_bounds[d]);
+        }
+    }
+
+    void record(const std::vector<float>& at, const R& res) {
+        ++sample_count;
+        valid_sample_count += res.valid();
+        if (!optimiser<T, R>::better_than(res, best_result, maximise)) return;
+
+        if (best_funct) best_funct(res);
+        R best = res;
+        if (materialise_funct) materialise_funct(at, args, best);
+        timeline_instant("new best", "rating", res.rating());
+        log([&]{ return std::format("New best: {}", best.rating_str()); }, log_level, LOG_DEBUG);
+        best_result = std::move(best);
+        best_arg = at;
+    }
+
+    // move the mean and adapt the covariance and step size to the generation
+    // returns: false once the run should restart
+    bool update() {
+        profile_scope scope(profile_phase::select);
+        size_t count = ys.size();
+        std::vector<size_t> order(count);
+        for (size_t k = 0; k < count; ++k) order[k] = k;
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return optimiser<T, R>::better_than(results[a], results[b], maximise);
+        });
+        ++generation;
+
+        if (optimiser<T, R>::better_than(results[order[0]], run_best, maximise)) {
+            run_best = results[order[0]];
+            run_best_generation = generation;
+        }
+        // nothing valid to move towards yet: keep looking around where we are
+        if (!results[order[0]].valid()) return generation - run_best_generation < run_stall;
+
+        // y_w: weighted step of the best mu
+        std::vector<double> y_w(n, 0.0);
+        for (size_t r = 0; r < mu; ++r) {
+            const std::vector<double>& y = ys[order[r]];
+            for (size_t i = 0; i < n; ++i) y_w[i] += weights[r] * y[i];
+        }
+        for (size_t i = 0; i < n; ++i) mean[i] += sigma * y_w[i];
+
+        // C^-1/2 y_w = B D^-1 B^T y_w
+        std::vector<double> bt_y(n, 0.0), c_half_y(n, 0.0);
+        for (size_t j = 0; j < n; ++j) {
+            for (size_t i = 0; i < n; ++i) bt_y[j] += B[i * n + j] * y_w[i];
+            bt_y[j] /= D[j];
+        }
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < n; ++j) c_half_y[i] += B[i * n + j] * bt_y[j];
+        }
+
+        double ps_norm = 0.0;
+        double ps_fac = std::sqrt(cs * (2.0 - cs) * mueff);
+        for (size_t i = 0; i < n; ++i) {
+            ps[i] = (1.0 - cs) * ps[i] + ps_fac * c_half_y[i];
+            ps_norm += ps[i] * ps[i];
+        }
+        ps_norm = std::sqrt(ps_norm);
+        bool hsig = ps_norm / std::sqrt(1.0 - std::pow(1.0 - cs, 2.0 * generation)) / chi_n < 1.4 + 2.0 / (n + 1.0);
+
+        double pc_fac = std::sqrt(cc * (2.0 - cc) * mueff);
+        for (size_t i = 0; i < n; ++i) {
+            pc[i] = (1.0 - cc) * pc[i] + (hsig ? pc_fac * y_w[i] : 0.0);
+        }
+
+        double old_fac = 1.0 - c1 - cmu + (hsig ? 0.0 : c1 * cc * (2.0 - cc));
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j <= i; ++j) {
+                double rank_mu = 0.0;
+                for (size_t r = 0; r < mu; ++r) {
+                    const std::vector<double>& y = ys[order[r]];
+                    rank_mu += weights[r] * y[i] * y[j];
+                }
+                double c = old_fac * C[i * n + j] + c1 * pc[i] * pc[j] + cmu * rank_mu;
+                C[i * n + j] = C[j * n + i] = c;
+            }
+        }
+
+        // the whole space is 1 wide, no point stepping further
+        sigma = std::min(1.0, sigma * std::exp(cs / damps * (ps_norm / chi_n - 1.0)));
+
+        eigen_decompose();
+
+        double max_d = *std::max_element(D.begin(), D.end());
+        double min_d = *std::min_element(D.begin(), D.end());
+        if (sigma * max_d < sigma_tol) return false;
+        if (max_d > max_condition * min_d) return false;
+        return generation - run_best_generation < run_stall;
+    }
+
+    // cyclic Jacobi: B gets the eigenvectors of C as columns and D the square roots of its eigenvalues
+    // C is at most a dozen or so wide, so this is cheap next to simulating a generation
+    void eigen_decompose() {
+        std::vector<double> A = C;
+        for (size_t i = 0; i < n * n; ++i) B[i] = 0.0;
+        for (size_t i = 0; i < n; ++i) B[i * n + i] = 1.0;
+
+        for (size_t sweep = 0; sweep < 50; ++sweep) {
+            double off = 0.0;
+            for (size_t i = 0; i < n; ++i) {
+                for (size_t j = i + 1; j < n; ++j) off += A[i * n + j] * A[i * n + j];
+            }
+            if (off < 1e-30) break;
+
+            for (size_t p = 0; p < n; ++p) {
+                for (size_t q = p + 1; q < n; ++q) {
+                    double apq = A[p * n + q];
+                    if (std::abs(apq) < 1e-300) continue;
+                    double theta = (A[q * n + q] - A[p * n + p]) / (2.0 * apq);
+                    double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                    double c = 1.0 / std::sqrt(t * t + 1.0), s = t * c;
+                    for (size_t k = 0; k < n; ++k) {
+                        double akp = A[k * n + p], akq = A[k * n + q];
+                        A[k * n + p] = c * akp - s * akq;
+                        A[k * n + q] = s * akp + c * akq;
+                    }
+                    for (size_t k = 0; k < n; ++k) {
+                        double apk = A[p * n + k], aqk = A[q * n + k];
+                        A[p * n + k] = c * apk - s * aqk;
+                        A[q * n + k] = s * apk + c * aqk;
+                    }
+                    for (size_t k = 0; k < n; ++k) {
+                        double bkp = B[k * n + p], bkq = B[k * n + q];
+                        B[k * n + p] = c * bkp - s * bkq;
+                        B[k * n + q] = s * bkp + c * bkq;
+                    }
+                }
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            D[i] = std::sqrt(std::max(A[i * n + i], 1e-20));
+        }
+    }
+
+    void log_progress() {
+        if (log_level < LOG_INFO) return;
+        time_point_t now = main_clock.now();
+        if (now - last_poll_time < poll_spacing) return;
+        last_poll_time = now;
+
+        duration_t speed_tdiff = now - last_speed_update_time;
+        if (speed_tdiff > speed_log_spacing) {
+            float sec = to_seconds(speed_tdiff);
+            speed_iters = (sample_count - last_sample_count) / sec;
+            speed_valid_iters = (valid_sample_count - last_valid_sample_count) / sec;
+            last_sample_count = sample_count;
+            last_valid_sample_count = valid_sample_count;
+            last_speed_update_time = now;
+        }
+        log([&]{ return std::format("{} ({} valid) Samples ({:.0f} ({:.0f}) samples/s), best: {}, step: {:.2g}{}",
+                                    sample_count, valid_sample_count,
+                                    speed_iters, speed_valid_iters,
+                                    best_result.rating(), sigma,
+                                    status_funct ? ", " + status_funct() : "");
+        }, log_level, LOG_INFO, false);
+    }
+};
+
+}
@@ -1,9 +1,217 @@
 #pragma once
 
+#include <optional>
+#include <span>
+#include <string_view>
+
 #include <tomlplusplus/toml.hpp>
 
 namespace asim {
 
+// one value of a config, for building a ruleset without parsing toml
+struct config_value {
+    std::string_view section, key;
+    float value;
+};
+
+// every physics constant a server config can change
+// forks differ in these, so the simulation takes them as a value instead of globals and several can be used at once
+struct ruleset {
+    // [Atmosim]
+    float default_tol = 0.95f;
+
+    // [Cvars]
+    float heat_scale = 1.0 / 8.f; // inverted
+
+    // [Atmospherics]
+    float R = 8.314462618f;
+    float one_atmosphere = 101.325f;
+    float TCMB = 2.7f;
+    float T0C = 273.15f;
+    float T20C = 293.15f;
+    float minimum_heat_capacity = 0.0003f;
+
+    // [Plasma]
+    float fire_plasma_energy_released = 160000.f * heat_scale;
+    float super_saturation_threshold = 96.f;
+    float super_saturation_ends = super_saturation_threshold / 3.f;
+    float oxygen_burn_rate_base = 1.4f;
+    float plasma_minimum_burn_temperature = 100.f + T0C;
+    float plasma_upper_temperature = 1370.f + T0C;
+    float plasma_oxygen_fullburn = 10.f;
+    float plasma_burn_rate_delta = 9.f;
+
+    // [Tritium]
+    float fire_hydrogen_energy_released = 284000.f * heat_scale;
+    float minimum_tritium_oxyburn_energy = 143000.f * heat_scale;
+    float tritium_burn_oxy_factor = 100.f;
+    float tritium_burn_trit_factor = 10.f;
+    float tritium_burn_fuel_ratio = 0.f;
+
+    // [Frezon]
+    float frezon_cool_lower_temperature = 23.15f;
+    float frezon_cool_mid_temperature = 373.15f;
+    float frezon_cool_maximum_energy_modifier = 10.f;
+    float frezon_nitrogen_cool_ratio = 5.f;
+    float frezon_cool_energy_released = -600000.f * heat_scale;
+    float frezon_cool_rate_modifier = 20.f;
+    float frezon_production_temp = 73.15f;
+    float frezon_production_max_efficiency_temperature = 73.15f;
+    float frezon_production_nitrogen_ratio = 10.f;
+    float frezon_production_trit_ratio = 50.f;
+    float frezon_production_conversion_rate = 50.f;
+
+    // [N20]
+    float N2Odecomposition_rate = 1.f / 2.f; // inverted
+
+    // [Nitrium]
+    float nitrium_decomposition_energy = 30000.f;
+
+    // [Reactions]
+    float reaction_min_gas = 0.01f;
+    float plasma_fire_temp = 373.149f;
+    float trit_fire_temp = 373.149f;
+    float frezon_cool_temp = 23.15f;
+    float n2o_decomp_temp = 850.f;
+    float nitrium_decomp_temp = T0C + 70.f;
+
+    // [Canister]
+    float pressure_cap = 1013.25f;
+    float required_transfer_volume = 1500.f + 200.f * 2; // canister + two pipes volume
+
+    // [Tank]
+    float tank_volume = 5.f;
+    float tank_leak_pressure = 30.f * one_atmosphere;
+    float tank_rupture_pressure = 40.f * one_atmosphere;
+    float tank_fragment_pressure = 50.f * one_atmosphere;
+    float tank_fragment_scale = 2.25f * one_atmosphere;
+
+    // [Misc]
+    float tickrate = 0.5f;
+
+    constexpr bool operator==(const ruleset&) const = default;
+
+    // values missing from the config keep their defaults, the goobstation (non-reforged) ones, up to date as of 14.02.2026
+    static ruleset load(const toml::table& config);
+    // throws if the file can't be read or parsed
+    static ruleset load_file(std::string_view path);
+    // same as load() but usable at compile time
+    static constexpr ruleset from_values(std::span<const config_value> values);
+
+private:
+    // get(section, key) -> std::optional<float> looks up one config value
+    template<typename F>
+    static constexpr ruleset from_getter(F&& get);
+};
+
+inline ruleset ruleset::load(const toml::table& config) {
+    return from_getter([&config](std::string_view section, std::string_view key) {
+        return config[section][key].value<float>();
+    });
+}
+
+constexpr ruleset ruleset::from_values(std::span<const config_value> values) {
+    return from_getter([values](std::string_view section, std::string_view key) -> std::optional<float> {
+        for (const config_value& v : values) {
+            if (v.section == section && v.key == key) return v.value;
+        }
+        return std::nullopt;
+    });
+}
+
+template<typename F>
+constexpr ruleset ruleset::from_getter(F&& get) {
+    const ruleset defaults;
+    auto get_or = [&get](std::string_view section, std::string_view key, float fallback) {
+        return get(section, key).value_or(fallback);
+    };
+    // values nothing else is derived from, the ones left out get their defaults from these like in a default ruleset
+    ruleset rules{
+        // [Atmosim]
+        .default_tol = get_or("Atmosim", "DefaultTolerance", defaults.default_tol),
+
+        // [Cvars]
+        .heat_scale = get_or("Cvars", "HeatScale", defaults.heat_scale),
+
+        // [Atmospherics]
+        .R = get_or("Atmospherics", "R", defaults.R),
+        .one_atmosphere = get_or("Atmospherics", "OneAtmosphere", defaults.one_atmosphere),
+        .TCMB = get_or("Atmospherics", "TCMB", defaults.TCMB),
+        .T0C = get_or("Atmospherics", "T0C", defaults.T0C),
+        .T20C = get_or("Atmospherics", "T20C", defaults.T20C),
+        .minimum_heat_capacity = get_or("Atmospherics", "MinimumHeatCapacity", defaults.minimum_heat_capacity),
+
+        // [Plasma]
+        .super_saturation_threshold = get_or("Plasma", "SuperSaturationThreshold", defaults.super_saturation_threshold),
+        .oxygen_burn_rate_base = get_or("Plasma", "OxygenBurnRateBase", defaults.oxygen_burn_rate_base),
+        .plasma_oxygen_fullburn = get_or("Plasma", "OxygenFullburn", defaults.plasma_oxygen_fullburn),
+        .plasma_burn_rate_delta = get_or("Plasma", "BurnRateDelta", defaults.plasma_burn_rate_delta),
+
+        // [Tritium]
+        .tritium_burn_oxy_factor = get_or("Tritium", "BurnOxyFactor", defaults.tritium_burn_oxy_factor),
+        .tritium_burn_trit_factor = get_or("Tritium", "BurnTritFactor", defaults.tritium_burn_trit_factor),
+        .tritium_burn_fuel_ratio = get_or("Tritium", "BurnFuelRatio", defaults.tritium_burn_fuel_ratio),
+
+        // [Frezon]
+        .frezon_cool_lower_temperature = get_or("Frezon", "CoolLowerTemperature", defaults.frezon_cool_lower_temperature),
+        .frezon_cool_mid_temperature = get_or("Frezon", "CoolMidTemperature", defaults.frezon_cool_mid_temperature),
+        .frezon_cool_maximum_energy_modifier = get_or("Frezon", "CoolMaximumEnergyModifier", defaults.frezon_cool_maximum_energy_modifier),
+        .frezon_nitrogen_cool_ratio = get_or("Frezon", "NitrogenCoolRatio", defaults.frezon_nitrogen_cool_ratio),
+        .frezon_cool_rate_modifier = get_or("Frezon", "CoolRateModifier", defaults.frezon_cool_rate_modifier),
+        .frezon_production_temp = get_or("Frezon", "ProductionTemp", defaults.frezon_production_temp),
+        .frezon_production_max_efficiency_temperature = get_or("Frezon", "ProductionMaxEfficiencyTemperature", defaults.frezon_production_max_efficiency_temperature),
+        .frezon_production_nitrogen_ratio = get_or("Frezon", "ProductionNitrogenRatio", defaults.frezon_production_nitrogen_ratio),
+        .frezon_production_trit_ratio = get_or("Frezon", "ProductionTritRatio", defaults.frezon_production_trit_ratio),
+        .frezon_production_conversion_rate = get_or("Frezon", "ProductionConversionRate", defaults.frezon_production_conversion_rate),
+
+        // [N20]
+        .N2Odecomposition_rate = get_or("N20", "DecompositionRate", defaults.N2Odecomposition_rate),
+
+        // [Nitrium]
+        .nitrium_decomposition_energy = get_or("Nitrium", "DecompositionEnergy", defaults.nitrium_decomposition_energy),
+
+        // [Reactions]
+        .reaction_min_gas = get_or("Reactions", "ReactionMinGas", defaults.reaction_min_gas),
+        .plasma_fire_temp = get_or("Reactions", "PlasmaFireTemp", defaults.plasma_fire_temp),
+        .trit_fire_temp = get_or("Reactions", "TritiumFireTemp", defaults.trit_fire_temp),
+        .frezon_cool_temp = get_or("Reactions", "FrezonCoolTemp", defaults.frezon_cool_temp),
+        .n2o_decomp_temp = get_or("Reactions", "N2ODecomposionTemp", defaults.n2o_decomp_temp),
+
+        // [Canister]
+        .pressure_cap = get_or("Canister", "TransferPressureCap", defaults.pressure_cap),
+        .required_transfer_volume = get_or("Canister", "RequiredTransferVolume", defaults.required_transfer_volume),
+
+        // [Tank]
+        .tank_volume = get_or("Tank", "Volume", defaults.tank_volume),
+
+        // [Misc]
+        .tickrate = get_or("Misc", "Tickrate", defaults.tickrate),
+    };
+
+    // derived values, now defaulted from the values above
+    // configs hold energies unscaled
+    auto scaled = [&](std::string_view section, std::string_view key, float& value) {
+        if (std::optional<float> v = get(section, key)) value = *v * rules.heat_scale;
+    };
+    scaled("Plasma", "FireEnergyReleased", rules.fire_plasma_energy_released);
+    rules.super_saturation_ends = get_or("Plasma", "SuperSaturationEnds", rules.super_saturation_ends);
+    rules.plasma_minimum_burn_temperature = get_or("Plasma", "MinimumBurnTemperature", rules.plasma_minimum_burn_temperature);
+    rules.plasma_upper_temperature = get_or("Plasma", "UpperTemperature", rules.plasma_upper_temperature);
+    scaled("Tritium", "FireEnergyReleased", rules.fire_hydrogen_energy_released);
+    scaled("Tritium", "MinimumOxyburnEnergy", rules.minimum_tritium_oxyburn_energy);
+    scaled("Frezon", "CoolEnergyReleased", rules.frezon_cool_energy_released);
+    rules.nitrium_decomp_temp = get_or("Reactions", "NitriumDecompositionTemp", rules.nitrium_decomp_temp);
+    rules.tank_leak_pressure = get_or("Tank", "LeakPressure", rules.tank_leak_pressure);
+    rules.tank_rupture_pressure = get_or("Tank", "RupturePressure", rules.tank_rupture_pressure);
+    rules.tank_fragment_pressure = get_or("Tank", "FragmentPressure", rules.tank_fragment_pressure);
+    rules.tank_fragment_scale = get_or("Tank", "FragmentScale", rules.tank_fragment_scale);
+    return rules;
+}
+
+inline ruleset ruleset::load_file(std::string_view path) {
+    return load(toml::parse_file(path));
+}
+
 inline static toml::table config = []() {
     char* path = std::getenv("ATMOSIM_CONFIG");
     if (path != nullptr)
@@ -13,78 +221,21 @@ inline static toml::table config = []() {
     return toml::table();
 }();
 
-inline const float // goobstation (non-reforged) defaults, up to date as of 14.02.2026
-// [Atmosim]
-default_tol = config["Atmosim"]["DefaultTolerance"].value_or(0.95f),
-
-// [Cvars]
-heat_scale = config["Cvars"]["HeatScale"].value_or(1.0 / 8.f), // inverted
-
-// [Atmospherics]
-R = config["Atmospherics"]["R"].value_or(8.314462618f),
-one_atmosphere = config["Atmospherics"]["OneAtmosphere"].value_or(101.325f),
-TCMB = config["Atmospherics"]["TCMB"].value_or(2.7f),
-T0C = config["Atmospherics"]["T0C"].value_or(273.15f),
-T20C = config["Atmospherics"]["T20C"].value_or(293.15f),
-minimum_heat_capacity = config["Atmospherics"]["MinimumHeatCapacity"].value_or(0.0003f),
-
-// [Plasma]
-fire_plasma_energy_released = config["Plasma"]["FireEnergyReleased"].value_or(160000.f) * heat_scale,
-super_saturation_threshold = config["Plasma"]["SuperSaturationThreshold"].value_or(96.f),
-super_saturation_ends = config["Plasma"]["SuperSaturationEnds"].value_or(super_saturation_threshold / 3.f),
-oxygen_burn_rate_base = config["Plasma"]["OxygenBurnRateBase"].value_or(1.4f),
-plasma_minimum_burn_temperature = config["Plasma"]["MinimumBurnTemperature"].value_or(100.f + T0C),
-plasma_upper_temperature = config["Plasma"]["UpperTemperature"].value_or(1370.f + T0C),
-plasma_oxygen_fullburn = config["Plasma"]["OxygenFullburn"].value_or(10.f),
-plasma_burn_rate_delta = config["Plasma"]["BurnRateDelta"].value_or(9.f),
-
-// [Tritium]
-fire_hydrogen_energy_released = config["Tritium"]["FireEnergyReleased"].value_or(284000.f) * heat_scale,
-minimum_tritium_oxyburn_energy = config["Tritium"]["MinimumOxyburnEnergy"].value_or(143000.f) * heat_scale,
-tritium_burn_oxy_factor = config["Tritium"]["BurnOxyFactor"].value_or(100.f),
-tritium_burn_trit_factor = config["Tritium"]["BurnTritFactor"].value_or(10.f),
-tritium_burn_fuel_ratio = config["Tritium"]["BurnFuelRatio"].value_or(0.f),
-
-// [Frezon]
-frezon_cool_lower_temperature = config["Frezon"]["CoolLowerTemperature"].value_or(23.15f),
-frezon_cool_mid_temperature = config["Frezon"]["CoolMidTemperature"].value_or(373.15f),
-frezon_cool_maximum_energy_modifier = config["Frezon"]["CoolMaximumEnergyModifier"].value_or(10.f),
-frezon_nitrogen_cool_ratio = config["Frezon"]["NitrogenCoolRatio"].value_or(5.f),
-frezon_cool_energy_released = config["Frezon"]["CoolEnergyReleased"].value_or(-600000.f) * heat_scale,
-frezon_cool_rate_modifier = config["Frezon"]["CoolRateModifier"].value_or(20.f),
-frezon_production_temp = config["Frezon"]["ProductionTemp"].value_or(73.15f),
-frezon_production_max_efficiency_temperature = config["Frezon"]["ProductionMaxEfficiencyTemperature"].value_or(73.15f),
-frezon_production_nitrogen_ratio = config["Frezon"]["ProductionNitrogenRatio"].value_or(10.f),
-frezon_production_trit_ratio = config["Frezon"]["ProductionTritRatio"].value_or(50.f),
-frezon_production_conversion_rate = config["Frezon"]["ProductionConversionRate"].value_or(50.f),
-
-// [N20]
-N2Odecomposition_rate = config["N20"]["DecompositionRate"].value_or(1.f / 2.f), // inverted
-
-// [Nitrium]
-nitrium_decomposition_energy = config["Nitrium"]["DecompositionEnergy"].value_or(30000.f),
-
-// [Reactions]
-reaction_min_gas = config["Reactions"]["ReactionMinGas"].value_or(0.01f),
-plasma_fire_temp = config["Reactions"]["PlasmaFireTemp"].value_or(373.149f),
-trit_fire_temp = config["Reactions"]["TritiumFireTemp"].value_or(373.149f),
-frezon_cool_temp = config["Reactions"]["FrezonCoolTemp"].value_or(23.15f),
-n2o_decomp_temp = config["Reactions"]["N2ODecomposionTemp"].value_or(850.f),
-nitrium_decomp_temp = config["Reactions"]["NitriumDecompositionTemp"].value_or(T0C + 70.f),
-
-// [Canister]
-pressure_cap = config["Canister"]["TransferPressureCap"].value_or(1013.25f),
-required_transfer_volume = config["Canister"]["RequiredTransferVolume"].value_or(1500.f + 200.f * 2), // canister + two pipes volume
-
-// [Tank]
-tank_volume = config["Tank"]["Volume"].value_or(5.f),
-tank_leak_pressure = config["Tank"]["LeakPressure"].value_or(30.f * one_atmosphere),
-tank_rupture_pressure = config["Tank"]["RupturePressure"].value_or(40.f * one_atmosphere),
-tank_fragment_pressure = config["Tank"]["FragmentPressure"].value_or(50.f * one_atmosphere),
-tank_fragment_scale = config["Tank"]["FragmentScale"].value_or(2.25f * one_atmosphere),
-
-// [Misc]
-tickrate = config["Misc"]["Tickrate"].value_or(0.5f);
+#ifdef ASIM_BAKED_CONFIG
+}
+
+// generated by cmake/bake_config.cmake, defines baked_config_path and baked_config_values
+#include "baked_config.hpp"
+
+namespace asim {
+
+// the ruleset baked in at build time, the only one this build can simulate
+// mixtures point at it through a constexpr pointer, so the kernels see every constant as a literal
+inline constexpr ruleset default_ruleset = ruleset::from_values(baked_config_values);
+#else
+// the ruleset from ATMOSIM_CONFIG, used wherever no other is given
+inline const ruleset default_ruleset = ruleset::load(config);
+#endif
 
 inline const size_t round_temp_dig = 2, round_pressure_dig = 1;
 
@@ -1,12 +1,18 @@
 #pragma once
 
+#include <bit>
+#include <cstdint>
 #include <map>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 #include <argparse/read.hpp>
 
 // TODO: make this not required
 #include "constants.hpp"
+#include "utility.hpp"
 
 namespace asim {
 
@@ -14,10 +20,11 @@ namespace asim {
 
 // a gas type definition
 struct gas_type {
-    float specific_heat;
+    // before the ruleset's heat_scale
+    float unscaled_heat;
     std::string name;
 
-    gas_type(float specheat, std::string_view name): specific_heat(specheat), name(name) {};
+    gas_type(float unscaled_heat, std::string_view name): unscaled_heat(unscaled_heat), name(name) {};
     gas_type() = delete;
     gas_type(const gas_type& rhs) = delete;
 };
@@ -25,25 +32,25 @@ struct gas_type {
 // all supported gases - if it's not here, it's not supported
 // UP TO DATE AS OF: 21.06.2025
 inline const gas_type gas_types[] {
-    {20.f  * heat_scale, "oxygen"},
-    {30.f  * heat_scale, "nitrogen"},
-    {200.f * heat_scale, "plasma"},
-    {10.f  * heat_scale, "tritium"},
-    {40.f  * heat_scale, "water_vapour"},
-    {30.f  * heat_scale, "carbon_dioxide"},
-    {600.f * heat_scale, "frezon"},
-    {40.f  * heat_scale, "nitrous_oxide"},
-    {10.f  * heat_scale, "nitrium"}
+    {20.f,  "oxygen"},
+    {30.f,  "nitrogen"},
+    {200.f, "plasma"},
+    {10.f,  "tritium"},
+    {40.f,  "water_vapour"},
+    {30.f,  "carbon_dioxide"},
+    {600.f, "frezon"},
+    {40.f,  "nitrous_oxide"},
+    {10.f,  "nitrium"}
 };
 
-inline const size_t gas_count = std::end(gas_types) - std::begin(gas_types);
+inline constexpr size_t gas_count = std::size(gas_types);
 
 // convenience wrapper for gas type index
 struct gas_ref {
     size_t idx = -1;
 
-    float specific_heat() const {
-        return gas_types[idx].specific_heat;
+    float specific_heat(const ruleset& rules) const {
+        return gas_types[idx].unscaled_heat * rules.heat_scale;
     }
 
     std::string_view name() const {
@@ -68,15 +75,91 @@ inline const std::map<std::string, gas_ref> string_gas_map = []() {
     return map;
 }();
 
-inline const gas_ref oxygen =         string_gas_map.at("oxygen");
-inline const gas_ref nitrogen =       string_gas_map.at("nitrogen");
-inline const gas_ref plasma =         string_gas_map.at("plasma");
-inline const gas_ref tritium =        string_gas_map.at("tritium");
-inline const gas_ref water_vapour =   string_gas_map.at("water_vapour");
-inline const gas_ref carbon_dioxide = string_gas_map.at("carbon_dioxide");
-inline const gas_ref frezon =         string_gas_map.at("frezon");
-inline const gas_ref nitrous_oxide =  string_gas_map.at("nitrous_oxide");
-inline const gas_ref nitrium =        string_gas_map.at("nitrium");
+// in gas_types order, constexpr so code templated on which gases exist can use them
+inline constexpr gas_ref oxygen =         {0};
+inline constexpr gas_ref nitrogen =       {1};
+inline constexpr gas_ref plasma =         {2};
+inline constexpr gas_ref tritium =        {3};
+inline constexpr gas_ref water_vapour =   {4};
+inline constexpr gas_ref carbon_dioxide = {5};
+inline constexpr gas_ref frezon =         {6};
+inline constexpr gas_ref nitrous_oxide =  {7};
+inline constexpr gas_ref nitrium =        {8};
+
+// set of gases, bit N set means gas_types[N] is in it
+typedef uint32_t gas_mask;
+
+inline constexpr gas_mask all_gases_mask = (1u << gas_count) - 1;
+
+constexpr gas_mask mask_of(gas_ref gas) {
+    return 1u << gas.idx;
+}
+
+template<typename C>
+constexpr gas_mask mask_of(const C& gases) {
+    gas_mask mask = 0;
+    for (gas_ref gas : gases) mask |= mask_of(gas);
+    return mask;
+}
+
+// set of reactions, one bit per reaction
+typedef uint32_t reaction_mask;
+
+enum reaction_bits : reaction_mask {
+    r_frezon_production =     1 << 0,
+    r_nitrium_decomposition = 1 << 1,
+    r_frezon_coolant =        1 << 2,
+    r_N2O_decomposition =     1 << 3,
+    r_tritium_fire =          1 << 4,
+    r_plasma_fire =           1 << 5
+};
+
+inline constexpr reaction_mask all_reactions_mask = (1u << 6) - 1;
+
+// what a reaction needs to happen at all and what it can produce, see gas_mixture_t::reaction_tick()
+struct reaction_info {
+    reaction_mask reaction;
+    gas_mask reactants, products;
+};
+
+inline constexpr reaction_info reaction_infos[] {
+    {r_frezon_production,     mask_of(oxygen) | mask_of(nitrogen) | mask_of(tritium), mask_of(frezon) | mask_of(nitrogen)},
+    {r_nitrium_decomposition, mask_of(oxygen) | mask_of(nitrium),                     mask_of(water_vapour) | mask_of(nitrogen)},
+    {r_frezon_coolant,        mask_of(nitrogen) | mask_of(frezon),                    mask_of(nitrous_oxide)},
+    {r_N2O_decomposition,     mask_of(nitrous_oxide),                                 mask_of(nitrogen) | mask_of(oxygen)},
+    {r_tritium_fire,          mask_of(oxygen) | mask_of(tritium),                     mask_of(water_vapour)},
+    {r_plasma_fire,           mask_of(oxygen) | mask_of(plasma),                      mask_of(tritium) | mask_of(carbon_dioxide)}
+};
+
+// every gas that can ever be present in a mix starting with the given gases, following reaction products
+constexpr gas_mask reachable_gases(gas_mask gases) {
+    gas_mask last = 0;
+    while (last != gases) {
+        last = gases;
+        for (const reaction_info& info : reaction_infos) {
+            if ((gases & info.reactants) == info.reactants) gases |= info.products;
+        }
+    }
+    return gases;
+}
+
+// every reaction that can ever happen in a mix starting with the given gases
+constexpr reaction_mask possible_reactions(gas_mask gases) {
+    gases = reachable_gases(gases);
+    reaction_mask reactions = 0;
+    for (const reaction_info& info : reaction_infos) {
+        if ((gases & info.reactants) == info.reactants) reactions |= info.reaction;
+    }
+    return reactions;
+}
+
+// gas sets gas_mixture_t and gas_tank_t are compiled for, smallest first
+// anything not covered by a smaller one falls back to all gases
+inline constexpr gas_mask fire_gases_mask = reachable_gases(mask_of(oxygen) | mask_of(plasma) | mask_of(tritium));
+inline constexpr gas_mask no_nitrium_gases_mask = all_gases_mask & ~mask_of(nitrium);
+inline constexpr gas_mask compiled_gas_masks[] {fire_gases_mask, no_nitrium_gases_mask, all_gases_mask};
+
+static_assert(reachable_gases(no_nitrium_gases_mask) == no_nitrium_gases_mask);
 
 bool is_valid_gas(std::string_view name);
 
@@ -88,21 +171,74 @@ std::string list_gases(std::string_view sep = ", ");
 
 /// <gas_mixture>
 
-struct gas_mixture {
-    float amounts[gas_count] {0.f};
-    float temperature = T20C;
+// gas mixture that can only hold the gases in Mask
+// storage, loops and reactions only cover those gases, so mixes with few possible gases simulate faster
+// gases are stored in gas_types order, and results are identical to gas_mixture for any mix it can hold
+// Mask has to contain the products of every reaction its gases can do, see reachable_gases()
+template<gas_mask Mask>
+struct gas_mixture_t {
+    static_assert(reachable_gases(Mask) == Mask, "gas mixture can't hold its own reaction products");
+
+    static constexpr size_t slot_count = std::popcount(Mask);
+
+    static constexpr bool has(gas_ref gas) {
+        return Mask & mask_of(gas);
+    }
+
+    // storage index of a gas
+    static constexpr size_t slot_of(gas_ref gas) {
+        return std::popcount(Mask & (mask_of(gas) - 1));
+    }
+
+    // gas stored at a storage index
+    static constexpr gas_ref gas_at(size_t slot) {
+        size_t idx = 0;
+        for (size_t i = 0; i <= slot; ++idx) i += (Mask >> idx) & 1;
+        return {idx - 1};
+    }
+
+    // never null, shared by every mix a simulation touches
+#ifdef ASIM_BAKED_CONFIG
+    static constexpr const ruleset* rules = &default_ruleset;
+#else
+    const ruleset* rules;
+#endif
+    float amounts[slot_count] {0.f};
+    float temperature = rules->T20C;
     float volume;
 
     // pressure() is enough of a hotspot for this to be worth it performance-wise
-    float rvol = R / volume;
-
-    gas_mixture(float volume): volume(volume) {};
+    float rvol = rules->R / volume;
+
+    // sums over amounts, kept up to date by everything here that changes them so total_gas() and heat_capacity() are O(1)
+    // call refresh_cache() after writing to amounts directly
+    float cached_total_gas = 0.f;
+    float cached_heat_capacity = 0.f;
+
+#ifdef ASIM_BAKED_CONFIG
+    gas_mixture_t(float volume, const ruleset& rules = default_ruleset): volume(volume) {
+        CHECKEXCEPT {
+            if (&rules != this->rules) throw std::runtime_error("this build can only simulate its baked config");
+        }
+    };
+#else
+    gas_mixture_t(float volume, const ruleset& rules = default_ruleset): rules(&rules), volume(volume) {};
+#endif
 
     float amount_of(gas_ref gas) const;
     float total_gas() const;
     float heat_capacity() const;
     float heat_energy() const;
     float pressure() const;
+    // a pressure the mix can never get above from here, whatever happens to it, for checking the given reactions
+    // only worked out for fires, with any other reaction possible this is the largest float
+    // it never goes up as the mix is ticked, so once it's under some pressure the mix stays under it too
+    float pressure_bound(reaction_mask reactions) const;
+
+    // the sums from scratch, what the cached ones should match up to rounding
+    float compute_total_gas() const;
+    float compute_heat_capacity() const;
+    void refresh_cache();
 
     void set_amount_of(gas_ref gas, float to);
     void adjust_amount_of(gas_ref gas, float by);
@@ -114,20 +250,50 @@ struct gas_mixture {
     void canister_fill_to(gas_ref gas, float to_pressure);
     // NOTE: for optimisation purposes, this takes fractions and not ratios
     // if you want to use those with ratios, call get_fractions first
-    void canister_fill_to(const std::vector<gas_ref>& gases, const std::vector<float>& fractions, float temperature, float to_pressure);
-    void canister_fill_to(const std::vector<gas_ref>& gases, const std::vector<float>& fractions, float to_pressure);
+    void canister_fill_to(std::span<const gas_ref> gases, std::span<const float> fractions, float temperature, float to_pressure);
+    void canister_fill_to(std::span<const gas_ref> gases, std::span<const float> fractions, float to_pressure);
     void canister_fill_to(const std::vector<std::pair<gas_ref, float>>& gases, float temperature, float to_pressure);
     void canister_fill_to(const std::vector<std::pair<gas_ref, float>>& gases, float to_pressure);
 
-    gas_mixture& operator+=(const gas_mixture& rhs);
+    gas_mixture_t& operator+=(const gas_mixture_t& rhs);
+
+    // copy gases from a mixture with a different gas set
+    // the gases of from missing from us have to be empty
+    template<gas_mask M>
+    void assign(const gas_mixture_t<M>& from) {
+        for (size_t i = 0; i < gas_count; ++i) {
+            gas_ref gas = {i};
+            CHECKEXCEPT {
+                if (!has(gas) && from.amount_of(gas) != 0.f) throw std::runtime_error("tried to assign gas mixture with gases we can't hold");
+            }
+            if (has(gas)) amounts[slot_of(gas)] = from.amount_of(gas);
+        }
+#ifndef ASIM_BAKED_CONFIG
+        rules = from.rules;
+#endif
+        temperature = from.temperature;
+        volume = from.volume;
+        rvol = from.rvol;
+        // the gases we lack are empty so the sums are the same
+        cached_total_gas = from.cached_total_gas;
+        cached_heat_capacity = from.cached_heat_capacity;
+    }
 
     std::string to_string(char sep = ' ') const;
 
     // do gas reactions
-    // returns: whether anything happened
-    bool reaction_tick();
+    // returns: the reactions that happened, 0 if none
+    reaction_mask reaction_tick();
+
+    typedef reaction_mask (gas_mixture_t::*reaction_tick_t)();
+    // reaction_tick() only checking for the given reactions
+    // for mixes where the others can never happen, see possible_reactions(), the result is the same as reaction_tick()
+    static reaction_tick_t reaction_tick_for(reaction_mask reactions);
 
 private:
+    template<reaction_mask Reactions>
+    reaction_mask reaction_tick_only();
+
     void adjust_gas_cached_heat(gas_ref gas, float by, float&);
 
     // all supported reactions - if it's not here, it's not supported
@@ -140,20 +306,28 @@ private:
     bool react_nitrium_decomposition(float&);
 };
 
+// gas mixture that can hold any gas
+typedef gas_mixture_t<all_gases_mask> gas_mixture;
+
+// defined in gas.cpp for these
+extern template struct gas_mixture_t<fire_gases_mask>;
+extern template struct gas_mixture_t<no_nitrium_gases_mask>;
+extern template struct gas_mixture_t<all_gases_mask>;
+
 /// </gas_mixture>
 
 /// <utility>
 
 // function arguments should be in P,V,N,T order for consistency
 
-float to_mols(float pressure, float volume, float temp);
-float to_pressure(float volume, float mols, float temp);
-float to_volume(float pressure, float mols, float temp);
+float to_mols(float pressure, float volume, float temp, const ruleset& rules = default_ruleset);
+float to_pressure(float volume, float mols, float temp, const ruleset& rules = default_ruleset);
+float to_volume(float pressure, float mols, float temp, const ruleset& rules = default_ruleset);
 // get temperature you would get after mixing 2 gases
 float to_mix_temp(float lhs_c, float lhs_n, float lhs_t, float rhs_c, float rhs_n, float rhs_t);
 
 // call with get_fractions() to get specific heat
-float get_mix_heat_capacity(const std::vector<gas_ref>& gases, const std::vector<float>& amounts);
+float get_mix_heat_capacity(std::span<const gas_ref> gases, std::span<const float> amounts, const ruleset& rules);
 
 /// </utility>
 
@@ -4,15 +4,23 @@
 #include <atomic>
 #include <chrono>
 #include <cmath>
-#include <condition_variable>
 #include <format>
 #include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <random>
+#include <span>
 #include <thread>
 #include <vector>
 
+#include "profile.hpp"
+#include "rng.hpp"
+#include "surrogate.hpp"
+#include "thread_pool.hpp"
+#include "timeline.hpp"
 #include "utility.hpp"
 
 namespace asim {
@@ -21,6 +29,8 @@ template<typename T, typename R>
 struct optimiser {
     // generic optimiser configuration
     std::function<R(const std::vector<float>&, const T&)> funct;
+    // optional: evaluates several inputs at once, used instead of funct if set
+    std::function<void(std::span<const std::vector<float>>, const T&, std::span<R>)> batch_funct;
     T args;
     std::vector<float> lower_bounds;
     std::vector<float> upper_bounds;
@@ -28,6 +38,12 @@ struct optimiser {
     duration_t max_duration;
     size_t log_level;
     size_t n_threads = 1;
+    // budget samples instead of time if set, split evenly between rounds and threads
+    // samplers then only hear of each other between rounds, so with a seed the same budget always finds the same result,
+    // unless they share a population or funct depends on timing, e.g. giving up on inputs that can't beat a best found meanwhile
+    size_t max_samples = 0;
+    // seeds every sampler's random stream if set, otherwise they're seeded randomly
+    std::optional<uint64_t> seed;
 
     // specific optimiser configuration
     float bounds_scale;
@@ -40,6 +56,43 @@ struct optimiser {
     float mutation_factor = 0.6f;
     // Crossover probability (0.8 - 1.0)
     float crossover_prob = 0.9f;
+    // rand_1_bin: fixed F and CR above
+    // shade: F and CR are learnt from trials that improved on their target, starting from the ones above,
+    //   with current-to-pbest/1 mutation and an archive of replaced members, see Tanabe & Fukunaga 2013
+    //   shared populations always use rand_1_bin
+    enum struct strategy {rand_1_bin, shade};
+    strategy de_strategy = strategy::rand_1_bin;
+    // how many generations' worth of successful F and CR SHADE remembers
+    size_t history_size = 6;
+    // How many trials to hand to batch_funct at once
+    size_t batch_size = 16;
+
+    // Island model, used with more than one thread
+    // every migration_spacing generations each sampler sends its best members to another, 0 to disable
+    // when disabled, every sampler is handed the best anyone found instead
+    size_t migration_spacing = 0;
+    size_t migrants = 2;
+    enum struct topology {ring, random};
+    topology migration_topology = topology::ring;
+    // Steady-state DE on one population shared by every sampler instead, used with more than one thread
+    bool share_population = false;
+
+    // Surrogate prescreening, for when a simulation is expensive
+    // each sampler models its last surrogate_points results and skips trials it's confident can't beat their target, 0 to disable
+    size_t surrogate_points = 0;
+    // how many standard deviations of benefit of the doubt a trial gets
+    float surrogate_z = 0.5f;
+    // share of trials simulated regardless, so the model keeps finding out where it's wrong
+    float surrogate_explore = 0.1f;
+
+    // optional: fills in details of a result that is about to become a best, so funct can return cheap results
+    std::function<void(const std::vector<float>&, const T&, R&)> materialise_funct;
+    // optional: told about every new best result a sampler finds, e.g. so funct can give up on inputs that can't beat it
+    std::function<void(const R&)> best_funct;
+    // optional: extra status appended to the progress line
+    std::function<std::string()> status_funct;
+    // print where time went once done, only does anything when built with ASIM_PROFILE
+    bool print_profile = false;
 
     // Reporting
     duration_t poll_spacing = as_seconds(0.025f);
@@ -53,6 +106,129 @@ struct optimiser {
     std::vector<float> best_arg;
     R best_result;
 
+    // State shared with running samplers
+    // best and current bounds are only written by find_best(), under shared_mutex, which then bumps shared_version
+    mutable std::mutex shared_mutex;
+    std::atomic<size_t> shared_version{0};
+    std::vector<float> cur_lower_bounds;
+    std::vector<float> cur_upper_bounds;
+    std::atomic<bool> stop_sampling{false};
+    // random stream number stream of this run, jumped ahead of the ones before it
+    xoshiro256ss make_rng(size_t stream) const {
+        xoshiro256ss rng = seed ? xoshiro256ss(*seed) : xoshiro256ss::random();
+        for (size_t i = 0; i < stream; ++i) rng.jump();
+        return rng;
+    }
+
+    // samplers of the running find_best(), for migration
+    struct sampler;
+    std::vector<sampler*> islands;
+
+    // one population evolved by every sampler at once, a trial replaces its target as soon as it's evaluated
+    // coordinates are read optimistically under a per-member seqlock, a writer holds a member by making its sequence odd
+    struct shared_population {
+        struct alignas(64) member {
+            std::atomic<uint32_t> seq{0};
+            // whether fitness is for the current coordinates, members moved by reproject() aren't
+            std::atomic<bool> evaluated{false};
+            // only touched while holding the member
+            R fitness;
+        };
+        struct alignas(64) line {
+            std::atomic<float> v[16];
+        };
+
+        size_t size, dims;
+        size_t lines_per_member;
+        std::vector<member> members;
+        // coordinates, each member starting on a new cache line
+        std::vector<line> lines;
+        // targets are claimed in order, so concurrent trials rarely share one
+        std::atomic<size_t> next_target{0};
+
+        shared_population(size_t size, const std::vector<float>& lower_bounds, const std::vector<float>& upper_bounds, xoshiro256ss& rng)
+            : size(size), dims(lower_bounds.size()), lines_per_member((dims + 15) / 16),
+              members(size), lines(size * lines_per_member) {
+
+            for (size_t i = 0; i < size; ++i) {
+                write(i, random_vec(lower_bounds, upper_bounds, rng));
+            }
+        }
+
+        std::atomic<float>& coord(size_t i, size_t j) {
+            return lines[i * lines_per_member + j / 16].v[j % 16];
+        }
+
+        // copy out member i
+        // returns: its sequence number, the member is unchanged if it's the same once held
+        uint32_t read(size_t i, std::vector<float>& out, bool& evaluated) {
+            member& m = members[i];
+            while (true) {
+                uint32_t before = m.seq.load(std::memory_order_acquire);
+                if (before & 1) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                for (size_t j = 0; j < dims; ++j) {
+                    out[j] = coord(i, j).load(std::memory_order_relaxed);
+                }
+                evaluated = m.evaluated.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (m.seq.load(std::memory_order_relaxed) == before) return before;
+            }
+        }
+
+        // returns: the sequence number before we took it
+        uint32_t hold(size_t i) {
+            std::atomic<uint32_t>& seq = members[i].seq;
+            uint32_t was = seq.load(std::memory_order_relaxed);
+            while ((was & 1) || !seq.compare_exchange_weak(was, was + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                std::this_thread::yield();
+                was = seq.load(std::memory_order_relaxed);
+            }
+            // readers that see any write below see the odd sequence on their second check
+            std::atomic_thread_fence(std::memory_order_release);
+            return was;
+        }
+
+        void release(size_t i, uint32_t was) {
+            members[i].seq.store(was + 2, std::memory_order_release);
+        }
+
+        // only while holding member i, or before anyone else can see it
+        void write(size_t i, const std::vector<float>& at) {
+            for (size_t j = 0; j < dims; ++j) {
+                coord(i, j).store(at[j], std::memory_order_relaxed);
+            }
+        }
+
+        // bounds got zoomed: members outside the new bounds are mapped to the same relative position in them, to be evaluated again
+        void reproject(const std::vector<float>& old_lower, const std::vector<float>& old_upper,
+                       const std::vector<float>& new_lower, const std::vector<float>& new_upper) {
+            std::vector<float> at(dims);
+            for (size_t i = 0; i < size; ++i) {
+                uint32_t was = hold(i);
+                bool inside = true;
+                for (size_t j = 0; j < dims; ++j) {
+                    at[j] = coord(i, j).load(std::memory_order_relaxed);
+                    inside &= at[j] >= new_lower[j] && at[j] <= new_upper[j];
+                }
+                if (!inside) {
+                    for (size_t j = 0; j < dims; ++j) {
+                        float old_span = old_upper[j] - old_lower[j];
+                        float rel = old_span > 0.f ? (at[j] - old_lower[j]) / old_span : 0.5f;
+                        float val = new_lower[j] + rel * (new_upper[j] - new_lower[j]);
+                        at[j] = std::max(new_lower[j], std::min(new_upper[j], val));
+                    }
+                    write(i, at);
+                    members[i].evaluated.store(false, std::memory_order_relaxed);
+                }
+                release(i, was);
+            }
+        }
+    };
+    std::unique_ptr<shared_population> shared_pop;
+
     // Dimensions we don't want to be stepping in
     std::vector<bool> fixed_dims;
 
@@ -119,64 +295,89 @@ struct optimiser {
         float F, CR;
 
         // state
+        // only this sampler writes these, others read them under best_mutex
         std::vector<float> best_arg;
         R best_result;
+        std::mutex best_mutex;
 
         time_point_t until;
 
-        std::atomic<bool> should_terminate{false};
-        std::atomic<bool> running{false};
-        std::unique_ptr<std::thread> worker = nullptr;
-        std::mutex ready_mutex;
-        std::condition_variable cv;
-
         // state fed to us
         std::string worker_prefix = "";
         std::vector<float> cur_lower_bounds;
         std::vector<float> cur_upper_bounds;
+        // last parent shared_version we copied state from
+        size_t seen_version = -1;
+
+        // DE population, kept across polls and sample rounds so evolution carries on where it left off
+        std::vector<std::vector<float>> population;
+        std::vector<R> fitness;
+        // bounds the population currently lives in
+        std::vector<float> pop_lower_bounds;
+        std::vector<float> pop_upper_bounds;
+        // next population member step() makes a trial for
+        size_t next_trial = 0;
+        std::vector<std::vector<float>> trials;
+        std::vector<R> trial_res;
+
+        // SHADE state
+        std::vector<float> memory_F, memory_CR;
+        size_t memory_next = 0;
+        // members that were replaced by better trials, as extra donors
+        std::vector<std::vector<float>> archive;
+        // population indices, best first
+        std::vector<size_t> ranking;
+        // F and CR each trial of the chunk in flight was made with
+        std::vector<float> trial_F, trial_CR;
+        // this generation's F and CR of trials that improved on their target, weighted by how much
+        std::vector<float> success_F, success_CR, success_weight;
+
+        // surrogate prescreening state
+        std::unique_ptr<surrogate> model;
+        // 1 / bound width per dimension, so the model measures distance relative to the bounds
+        std::vector<float> model_scale;
+        // trial k of the chunk in flight is for member next_trial + trial_of[k]
+        std::vector<size_t> trial_of;
+
+        // shared population state, per trial of the chunk in flight
+        std::vector<size_t> targets;
+        std::vector<uint32_t> target_seqs;
+        std::vector<char> target_evaluated;
+        std::vector<float> target_arg;
+        std::vector<std::vector<float>> donors;
+
+        // island model state
+        // migrants sent to us, a newer packet replaces one we haven't taken yet
+        struct migration {
+            std::vector<std::vector<float>> args;
+            std::vector<R> results;
+        };
+        std::atomic<migration*> mailbox{nullptr};
+        // our index in parent.islands, -1 if we aren't in it
+        int island;
+        size_t generation = 0;
 
         // state for logging
         std::atomic<size_t> sample_count{0};
         std::atomic<size_t> valid_sample_count{0};
+        std::atomic<size_t> skipped_count{0};
+        // samples ever taken, only touched by whoever runs us
+        size_t samples_taken = 0;
 
         // RNG
-        std::mt19937 rng;
+        xoshiro256ss rng;
+        std::vector<float> draw_buffer;
 
-        sampler(const optimiser<T, R>& parent, int index = -1, bool do_threading = true)
-            : parent(parent), rng(std::random_device{}()) {
+        sampler(const optimiser<T, R>& parent, int index = -1)
+            : parent(parent), island(index), rng(parent.make_rng(std::max(index, 0))) {
 
             if (index >= 0) {
                 worker_prefix = std::format("[{}]: ", index);
             }
-
-            if (do_threading) {
-                worker = std::make_unique<std::thread>([this] {
-                    std::mutex mutex;
-                    std::unique_lock lock(mutex);
-                    while (true) {
-                        cv.wait(lock, [this]{ return running.load() || should_terminate.load() || status_SIGINT; });
-                        if (should_terminate.load() || status_SIGINT) break;
-
-                        ready_mutex.lock();
-                        while (main_clock.now() < until) {
-                            if(status_SIGINT) break;
-                            do_sampling();
-                        }
-                        ready_mutex.unlock();
-
-                        running = false;
-                    }
-                });
-            }
         }
 
         ~sampler() {
-            if (worker) {
-                running = false;
-                should_terminate = true;
-                cv.notify_all();
-                worker->join();
-            }
+            delete mailbox.exchange(nullptr);
         }
 
         void reset(const std::vector<float>& lower_bounds, const std::vector<float>& upper_bounds) {
@@ -186,41 +387,400 @@ struct optimiser {
             pop_size = parent.pop_size;
             F = parent.mutation_factor;
             CR = parent.crossover_prob;
+            if (memory_F.size() != parent.history_size) {
+                memory_F.assign(parent.history_size, parent.mutation_factor);
+                memory_CR.assign(parent.history_size, parent.crossover_prob);
+                memory_next = 0;
+            }
 
-            best_arg = parent.best_arg;
-            best_result = parent.best_result;
+            // we may have found something better than the parent knows about yet
+            if (parent.better_than(parent.best_result, best_result, maximise)) {
+                std::lock_guard lock(best_mutex);
+                best_arg = parent.best_arg;
+                best_result = parent.best_result;
+            }
             cur_lower_bounds = lower_bounds;
             cur_upper_bounds = upper_bounds;
         }
 
-        void start_sampling(time_point_t until) {
-            this->until = until;
-            running = true;
-            if (worker) {
-                cv.notify_one();
+        // pick up new bounds and best result if the parent published any
+        // returns: whether anything changed
+        bool sync() {
+            if (parent.shared_version == seen_version) return false;
+
+            timeline_span span("sync", "island", island);
+            std::lock_guard lock(parent.shared_mutex);
+            seen_version = parent.shared_version;
+            reset(parent.cur_lower_bounds, parent.cur_upper_bounds);
+            return true;
+        }
+
+        // sample on the calling thread until the until time
+        void do_sampling() {
+            prepare();
+            while (main_clock.now() < until && !status_SIGINT) {
+                step();
+            }
+        }
+
+        // sample on the calling thread until quota more samples were taken
+        // the last chunk is cut short to land on it, only making a new population can take more
+        void sample_for(size_t quota) {
+            size_t until_count = samples_taken + quota;
+            if (parent.shared_pop) {
+                if (targets.size() != chunk_size()) prepare_shared();
+                while (samples_taken < until_count && !status_SIGINT) step_shared(*parent.shared_pop, until_count - samples_taken);
+                return;
+            }
+            prepare();
+            while (samples_taken < until_count && !status_SIGINT) {
+                step(until_count - samples_taken);
+            }
+        }
+
+        // sample on the pool, one step per task, until the parent says to stop
+        void run(thread_pool& pool) {
+            if (parent.stop_sampling || status_SIGINT) return;
+
+            if (parent.shared_pop) {
+                sync();
+                if (targets.size() != chunk_size()) prepare_shared();
+                step_shared(*parent.shared_pop);
             } else {
-                while (main_clock.now() < until) {
-                    if(status_SIGINT) break;
-                    do_sampling();
+                if (sync() || population.size() != pop_size) {
+                    prepare();
                 }
-                running = false;
+                step();
             }
+            pool.submit([this, &pool]{ run(pool); });
         }
 
-        void wait_ready() {
-            ready_mutex.lock();
-            ready_mutex.unlock();
+        size_t chunk_size() const {
+            return parent.batch_funct ? std::max((size_t)1, parent.batch_size) : 1;
         }
 
-        void do_sampling() {
-            // Differential Evolution Implementation
+        // Differential Evolution Implementation
+        // get a population: make a new one the first time, otherwise move the old one into the current bounds
+        void prepare() {
+            timeline_span span("prepare", "island", island);
+            size_t dims = cur_lower_bounds.size();
+            size_t chunk = chunk_size();
+
+            if (population.size() != pop_size) {
+                init_population(chunk);
+            } else if (pop_lower_bounds != cur_lower_bounds || pop_upper_bounds != cur_upper_bounds) {
+                reproject_population(chunk);
+            }
+            inject_best();
+
+            trials.assign(chunk, std::vector<float>(dims));
+            trial_res.assign(chunk, R());
+            trial_F.assign(chunk, F);
+            trial_CR.assign(chunk, CR);
+            trial_of.resize(chunk);
+
+            if (parent.surrogate_points != 0 && (!model || model->capacity != parent.surrogate_points)) {
+                model = std::make_unique<surrogate>(parent.surrogate_points);
+            }
+            model_scale.resize(dims);
+            for (size_t j = 0; j < dims; ++j) {
+                float span = cur_upper_bounds[j] - cur_lower_bounds[j];
+                model_scale[j] = span > 0.f ? 1.f / span : 0.f;
+            }
+        }
+
+        // evolve the next chunk of the population
+        // trials are made and evaluated chunk trials at a time, so batch_funct can simulate them together
+        // limit: at most how many trials to make
+        void step(size_t limit = std::numeric_limits<size_t>::max()) {
+            timeline_span span("sample", "island", island);
+            size_t i = next_trial;
+            size_t n = std::min({trials.size(), pop_size - i, limit});
+            bool shade = parent.de_strategy == strategy::shade;
+            size_t m = n;
+            {
+                profile_scope scope(profile_phase::trial);
+                if (shade) rank_population();
+                for (size_t k = 0; k < n; ++k) {
+                    if (shade) {
+                        make_shade_trial(i + k, k);
+                    } else {
+                        make_trial(population, i + k, trials[k]);
+                    }
+                }
+
+                for (size_t k = 0; k < n; ++k) trial_of[k] = k;
+                if (model) m = prescreen(i, n);
+            }
+
+            sample_batch({trials.data(), m}, {trial_res.data(), m});
+
+            // Selection
+            profile_scope scope(profile_phase::select);
+            for (size_t k = 0; k < m; ++k) {
+                size_t t = i + trial_of[k];
+                if (parent.better_eq_than(trial_res[k], fitness[t], maximise)) {
+                    if (shade && parent.better_than(trial_res[k], fitness[t], maximise)) {
+                        note_success(k, std::abs(trial_res[k].rating() - fitness[t].rating()));
+                        archive_member(population[t]);
+                    }
+                    population[t] = trials[k];
+                    fitness[t] = trial_res[k];
+                }
+            }
+            next_trial = i + n == pop_size ? 0 : i + n;
+
+            if (next_trial == 0) {
+                ++generation;
+                if (shade) update_memory();
+                // with a sample budget, the parent migrates between rounds instead
+                if (parent.migration_spacing != 0 && parent.max_samples == 0 && generation % parent.migration_spacing == 0) {
+                    immigrate();
+                    emigrate();
+                }
+            }
+        }
+
+        // send copies of our best members to the next island, never blocks
+        void emigrate() {
+            size_t n_islands = parent.islands.size();
+            if (island < 0 || n_islands < 2) return;
+
+            size_t to = (island + 1) % n_islands;
+            if (parent.migration_topology == topology::random) {
+                to = rng.below(n_islands - 1);
+                to += to >= (size_t)island;
+            }
+
+            std::vector<size_t> order(pop_size);
+            for (size_t i = 0; i < pop_size; ++i) order[i] = i;
+            size_t count = std::min(parent.migrants, pop_size);
+            std::partial_sort(order.begin(), order.begin() + count, order.end(), [&](size_t a, size_t b) {
+                return parent.better_than(fitness[a], fitness[b], maximise);
+            });
+
+            timeline_instant("emigrate", "to", to);
+            migration* packet = new migration;
+            for (size_t k = 0; k < count && fitness[order[k]].valid(); ++k) {
+                packet->args.push_back(population[order[k]]);
+                packet->results.push_back(fitness[order[k]]);
+            }
+            delete parent.islands[to]->mailbox.exchange(packet);
+        }
+
+        // take in migrants sent to us, each replacing our worst member if it's better
+        void immigrate() {
+            std::unique_ptr<migration> packet(mailbox.exchange(nullptr));
+            if (!packet) return;
+            timeline_instant("immigrate", "migrants", packet->args.size());
+
+            size_t dims = cur_lower_bounds.size();
+            for (size_t k = 0; k < packet->args.size(); ++k) {
+                const std::vector<float>& arg = packet->args[k];
+                // the sender may not have picked up our bounds yet
+                bool inside = true;
+                for (size_t j = 0; j < dims; ++j) {
+                    inside &= arg[j] >= cur_lower_bounds[j] && arg[j] <= cur_upper_bounds[j];
+                }
+                if (!inside || std::find(population.begin(), population.end(), arg) != population.end()) continue;
+
+                size_t worst = 0;
+                for (size_t i = 1; i < pop_size; ++i) {
+                    if (parent.better_than(fitness[worst], fitness[i], maximise)) worst = i;
+                }
+                if (!parent.better_than(packet->results[k], fitness[worst], maximise)) continue;
+                population[worst] = arg;
+                fitness[worst] = packet->results[k];
+            }
+        }
+
+        void prepare_shared() {
+            timeline_span span("prepare", "island", island);
+            size_t dims = cur_lower_bounds.size();
+            size_t chunk = chunk_size();
+            trials.assign(chunk, std::vector<float>(dims));
+            trial_res.assign(chunk, R());
+            targets.assign(chunk, 0);
+            target_seqs.assign(chunk, 0);
+            target_evaluated.assign(chunk, false);
+            target_arg.assign(dims, 0.f);
+            donors.assign(3, std::vector<float>(dims));
+        }
+
+        // steady-state DE: make a trial for each of the next chunk targets and have it replace its target if it's better
+        // a target that isn't evaluated yet is evaluated itself instead
+        void step_shared(shared_population& pop, size_t limit = std::numeric_limits<size_t>::max()) {
+            timeline_span span("sample", "island", island);
+            size_t n = std::min(targets.size(), limit);
+            size_t first = pop.next_target.fetch_add(n, std::memory_order_relaxed);
+            {
+                profile_scope scope(profile_phase::trial);
+                for (size_t k = 0; k < n; ++k) {
+                    size_t i = (first + k) % pop.size;
+                    targets[k] = i;
+                    bool evaluated;
+                    target_seqs[k] = pop.read(i, target_arg, evaluated);
+                    target_evaluated[k] = evaluated;
+                    if (!evaluated) {
+                        trials[k] = target_arg;
+                        continue;
+                    }
+
+                    size_t a, b, c;
+                    pick_donors(pop.size, i, a, b, c);
+                    pop.read(a, donors[0], evaluated);
+                    pop.read(b, donors[1], evaluated);
+                    pop.read(c, donors[2], evaluated);
+                    make_trial(target_arg, donors[0], donors[1], donors[2], trials[k]);
+                }
+            }
+
+            sample_batch({trials.data(), n}, {trial_res.data(), n});
+
+            profile_scope scope(profile_phase::select);
+            for (size_t k = 0; k < n; ++k) {
+                size_t i = targets[k];
+                uint32_t was = pop.hold(i);
+                typename shared_population::member& m = pop.members[i];
+                if (m.evaluated.load(std::memory_order_relaxed)) {
+                    // someone may have replaced or evaluated it meanwhile, so compare against what's there now
+                    if (parent.better_eq_than(trial_res[k], m.fitness, maximise)) {
+                        pop.write(i, trials[k]);
+                        m.fitness = trial_res[k];
+                    }
+                } else if (!target_evaluated[k] && was == target_seqs[k]) {
+                    m.fitness = trial_res[k];
+                    m.evaluated.store(true, std::memory_order_relaxed);
+                }
+                // otherwise it was moved since we read it, and what we evaluated is out of date
+                pop.release(i, was);
+            }
+        }
+
+        // move the chunk's trials worth simulating to its front, skipping ones the model is confident are worse than their target
+        // returns: how many are worth simulating
+        size_t prescreen(size_t i, size_t n) {
+            float sign = maximise ? 1.f : -1.f;
+            size_t m = 0;
+            for (size_t k = 0; k < n; ++k) {
+                const R& target = fitness[i + k];
+                bool keep = true;
+                float mean, sd;
+                if (target.valid() && rng.uniform() >= parent.surrogate_explore && model->predict(trials[k], model_scale, mean, sd)) {
+                    keep = sign * (mean - target.rating()) + parent.surrogate_z * sd >= 0.f;
+                }
+                if (!keep) {
+                    ++skipped_count;
+                    continue;
+                }
+                if (m != k) {
+                    std::swap(trials[m], trials[k]);
+                    std::swap(trial_F[m], trial_F[k]);
+                    std::swap(trial_CR[m], trial_CR[k]);
+                }
+                trial_of[m++] = k;
+            }
+            return m;
+        }
+
+        void rank_population() {
+            ranking.resize(pop_size);
+            for (size_t i = 0; i < pop_size; ++i) ranking[i] = i;
+            std::sort(ranking.begin(), ranking.end(), [&](size_t a, size_t b) {
+                return parent.better_than(fitness[a], fitness[b], maximise);
+            });
+        }
+
+        // SHADE: F and CR drawn around a remembered pair, then current-to-pbest/1/bin
+        // mutant = target + F * (pbest - target) + F * (r1 - r2), pbest being one of the best p of the population
+        void make_shade_trial(size_t i, size_t k) {
             size_t dims = cur_lower_bounds.size();
 
-            // Population initialization
-            std::vector<std::vector<float>> population(pop_size);
-            std::vector<R> fitness(pop_size);
+            size_t r = rng.below(memory_F.size());
+            float cr = std::clamp(std::normal_distribution<float>(memory_CR[r], 0.1f)(rng), 0.f, 1.f);
+            float f;
+            do { f = std::cauchy_distribution<float>(memory_F[r], 0.1f)(rng); } while (f <= 0.f);
+            f = std::min(f, 1.f);
+            trial_F[k] = f;
+            trial_CR[k] = cr;
+
+            // p is drawn from [2 / pop_size, 0.2]
+            float p = rng.uniform(2.f / pop_size, 0.2f);
+            size_t top = std::max((size_t)1, (size_t)(p * pop_size));
+            const std::vector<float>& pbest = population[ranking[rng.below(top)]];
+            size_t r1, r2;
+            do { r1 = rng.below(pop_size); } while (r1 == i);
+            // r2 is drawn from the population and archive together
+            do { r2 = rng.below(pop_size + archive.size()); } while (r2 == i || r2 == r1);
+            const std::vector<float>& x1 = population[r1];
+            const std::vector<float>& x2 = r2 < pop_size ? population[r2] : archive[r2 - pop_size];
+            const std::vector<float>& target = population[i];
+            std::vector<float>& trial = trials[k];
+
+            size_t R_idx = rng.below(dims);
+            std::span<float> draws = crossover_draws(dims);
+            for (size_t j = 0; j < dims; ++j) {
+                if (parent.fixed_dims[j]) {
+                    trial[j] = cur_lower_bounds[j];
+                    continue;
+                }
+
+                if (draws[j] < cr || j == R_idx) {
+                    float val = target[j] + f * (pbest[j] - target[j]) + f * (x1[j] - x2[j]);
+                    // out of bounds goes halfway between the target and the bound, so the bounds don't collect members
+                    if (val < cur_lower_bounds[j]) val = (cur_lower_bounds[j] + target[j]) * 0.5f;
+                    if (val > cur_upper_bounds[j]) val = (cur_upper_bounds[j] + target[j]) * 0.5f;
+                    trial[j] = val;
+                } else {
+                    trial[j] = target[j];
+                }
+            }
+        }
+
+        void note_success(size_t k, float improvement) {
+            success_F.push_back(trial_F[k]);
+            success_CR.push_back(trial_CR[k]);
+            success_weight.push_back(improvement);
+        }
+
+        void archive_member(const std::vector<float>& member) {
+            if (archive.size() < pop_size) {
+                archive.push_back(member);
+            } else {
+                archive[rng.below(pop_size)] = member;
+            }
+        }
+
+        // remember this generation's successful F and CR: weighted Lehmer mean of F, weighted mean of CR
+        void update_memory() {
+            if (success_F.empty()) return;
+
+            float total = 0.f;
+            for (float w : success_weight) total += w;
+            float cr = 0.f, f_sq = 0.f, f_sum = 0.f;
+            for (size_t s = 0; s < success_F.size(); ++s) {
+                // improvements can all be 0 if e.g. they were invalid before
+                float w = total > 0.f ? success_weight[s] / total : 1.f / success_F.size();
+                cr += w * success_CR[s];
+                f_sq += w * success_F[s] * success_F[s];
+                f_sum += w * success_F[s];
+            }
+            memory_CR[memory_next] = cr;
+            memory_F[memory_next] = f_sq / f_sum;
+            memory_next = (memory_next + 1) % memory_F.size();
+
+            success_F.clear();
+            success_CR.clear();
+            success_weight.clear();
+        }
 
-            std::uniform_real_distribution<float> dist01(0.f, 1.f);
+        void init_population(size_t chunk) {
+            population.assign(pop_size, {});
+            archive.clear();
+            fitness.assign(pop_size, R());
+            next_trial = 0;
+            pop_lower_bounds = cur_lower_bounds;
+            pop_upper_bounds = cur_upper_bounds;
 
             // if we already have a best result, keep it as the first element of the population
             size_t start = 0;
@@ -230,128 +790,295 @@ struct optimiser {
                 start = 1;
             }
 
-            // 1. Initialize Population
-            for (size_t i = start; i < pop_size; ++i) {
-                population[i] = random_vec(cur_lower_bounds, cur_upper_bounds);
-                fitness[i] = sample(population[i]);
+            for (size_t i = start; i < pop_size; i += chunk) {
+                size_t n = std::min(chunk, pop_size - i);
+                for (size_t k = 0; k < n; ++k) {
+                    population[i + k] = random_vec(cur_lower_bounds, cur_upper_bounds, rng);
+                }
+                sample_batch({population.data() + i, n}, {fitness.data() + i, n});
             }
+        }
 
-            std::vector<float> trial(dims);
+        // bounds got zoomed: members still inside keep their position and fitness
+        // members outside are mapped to the same relative position in the new bounds and re-evaluated
+        void reproject_population(size_t chunk) {
+            size_t dims = cur_lower_bounds.size();
+            std::vector<size_t> moved;
+            for (size_t i = 0; i < pop_size; ++i) {
+                std::vector<float>& member = population[i];
+                bool inside = true;
+                for (size_t j = 0; j < dims; ++j) {
+                    inside &= member[j] >= cur_lower_bounds[j] && member[j] <= cur_upper_bounds[j];
+                }
+                if (inside) continue;
 
-            // 2. Evolution Loop
-            // We run generation by generation until the 'until' time is hit
-            // The outer loop in sampler handles the timing check
+                for (size_t j = 0; j < dims; ++j) {
+                    float old_span = pop_upper_bounds[j] - pop_lower_bounds[j];
+                    float rel = old_span > 0.f ? (member[j] - pop_lower_bounds[j]) / old_span : 0.5f;
+                    float val = cur_lower_bounds[j] + rel * (cur_upper_bounds[j] - cur_lower_bounds[j]);
+                    member[j] = std::max(cur_lower_bounds[j], std::min(cur_upper_bounds[j], val));
+                }
+                moved.push_back(i);
+            }
+            pop_lower_bounds = cur_lower_bounds;
+            pop_upper_bounds = cur_upper_bounds;
+            // archived members may be outside the new bounds
+            archive.clear();
+
+            std::vector<std::vector<float>> at(chunk);
+            std::vector<R> res(chunk);
+            for (size_t i = 0; i < moved.size(); i += chunk) {
+                size_t n = std::min(chunk, moved.size() - i);
+                for (size_t k = 0; k < n; ++k) {
+                    at[k] = population[moved[i + k]];
+                }
+                sample_batch({at.data(), n}, {res.data(), n});
+                for (size_t k = 0; k < n; ++k) {
+                    fitness[moved[i + k]] = res[k];
+                }
+            }
+        }
 
-            while (main_clock.now() < until && !status_SIGINT) {
-                for (size_t i = 0; i < pop_size; ++i) {
-                    // Pick 3 distinct random indices (a, b, c) != i
-                    size_t a, b, c;
-                    do { a = std::uniform_int_distribution<size_t>(0, pop_size - 1)(rng); } while(a == i);
-                    do { b = std::uniform_int_distribution<size_t>(0, pop_size - 1)(rng); } while(b == i || b == a);
-                    do { c = std::uniform_int_distribution<size_t>(0, pop_size - 1)(rng); } while(c == i || c == a || c == b);
+        // the best result may have come from another sampler, so replace our worst member with it if we don't have it
+        void inject_best() {
+            if (!best_result.valid()) return;
+            for (size_t j = 0; j < best_arg.size(); ++j) {
+                if (best_arg[j] < cur_lower_bounds[j] || best_arg[j] > cur_upper_bounds[j]) return;
+            }
+
+            size_t worst = 0;
+            for (size_t i = 0; i < pop_size; ++i) {
+                if (!parent.better_than(best_result, fitness[i], maximise)) return;
+                if (parent.better_than(fitness[worst], fitness[i], maximise)) worst = i;
+            }
+            population[worst] = best_arg;
+            fitness[worst] = best_result;
+        }
 
-                    // Mutation & Crossover
-                    // DE/rand/1/bin strategy
-                    // Mutant = a + F * (b - c)
-                    size_t R_idx = std::uniform_int_distribution<size_t>(0, dims - 1)(rng);
+        // a fresh uniform per dimension of a trial, deciding which ones cross over, drawn at once
+        std::span<float> crossover_draws(size_t dims) {
+            draw_buffer.resize(dims);
+            rng.uniform(draw_buffer);
+            return draw_buffer;
+        }
 
-                    for (size_t j = 0; j < dims; ++j) {
-                        if (parent.fixed_dims[j]) {
-                            trial[j] = cur_lower_bounds[j];
-                            continue;
-                        }
-
-                        if (frand() < CR || j == R_idx) {
-                            float val = population[a][j] + F * (population[b][j] - population[c][j]);
-                            // Bound handling: Clamp
-                            val = std::max(cur_lower_bounds[j], std::min(cur_upper_bounds[j], val));
-                            trial[j] = val;
-                        } else {
-                            trial[j] = population[i][j];
-                        }
-                    }
+        // Pick 3 distinct random indices (a, b, c) != i
+        void pick_donors(size_t size, size_t i, size_t& a, size_t& b, size_t& c) {
+            do { a = rng.below(size); } while(a == i);
+            do { b = rng.below(size); } while(b == i || b == a);
+            do { c = rng.below(size); } while(c == i || c == a || c == b);
+        }
 
-                    // Selection
-                    R trial_res = sample(trial);
+        void make_trial(const std::vector<std::vector<float>>& population, size_t i, std::vector<float>& trial) {
+            size_t a, b, c;
+            pick_donors(pop_size, i, a, b, c);
+            make_trial(population[i], population[a], population[b], population[c], trial);
+        }
 
-                    if (parent.better_eq_than(trial_res, fitness[i], maximise)) {
-                        population[i] = trial;
-                        fitness[i] = trial_res;
-                    }
+        void make_trial(const std::vector<float>& target, const std::vector<float>& a, const std::vector<float>& b,
+                        const std::vector<float>& c, std::vector<float>& trial) {
+            size_t dims = cur_lower_bounds.size();
+
+            // Mutation & Crossover
+            // DE/rand/1/bin strategy
+            // Mutant = a + F * (b - c)
+            size_t R_idx = rng.below(dims);
+            std::span<float> draws = crossover_draws(dims);
+
+            for (size_t j = 0; j < dims; ++j) {
+                if (parent.fixed_dims[j]) {
+                    trial[j] = cur_lower_bounds[j];
+                    continue;
+                }
+
+                if (draws[j] < CR || j == R_idx) {
+                    float val = a[j] + F * (b[j] - c[j]);
+                    // Bound handling: Clamp
+                    val = std::max(cur_lower_bounds[j], std::min(cur_upper_bounds[j], val));
+                    trial[j] = val;
+                } else {
+                    trial[j] = target[j];
                 }
             }
         }
 
         R sample(const std::vector<float>& at) {
             R res = parent.funct(at, parent.args);
+            record(at, res);
+            return res;
+        }
 
+        void sample_batch(std::span<const std::vector<float>> at, std::span<R> res) {
+            {
+                profile_scope scope(profile_phase::evaluate);
+                if (parent.batch_funct) {
+                    parent.batch_funct(at, parent.args, res);
+                } else {
+                    for (size_t k = 0; k < at.size(); ++k) {
+                        res[k] = parent.funct(at[k], parent.args);
+                    }
+                }
+            }
+            profile_scope scope(profile_phase::select);
+            for (size_t k = 0; k < at.size(); ++k) {
+                record(at[k], res[k]);
+            }
+        }
+
+        void record(const std::vector<float>& at, const R& res) {
+            ++samples_taken;
             ++sample_count;
             valid_sample_count += res.valid();
+            if (model && res.valid()) model->add(at, res.rating());
 
             // Check against local best
             if (parent.better_than(res, best_result, maximise)) {
+                if (parent.best_funct) parent.best_funct(res);
+                timeline_instant("new best", "rating", res.rating());
+                R best = res;
+                if (parent.materialise_funct) parent.materialise_funct(at, parent.args, best);
                 // Log only occasionally or if significantly better to avoid spam
-                log([&]{ return std::format("{}New local best: {}", worker_prefix, res.rating_str()); }, log_level, LOG_DEBUG);
-                best_result = res;
+                log([&]{ return std::format("{}New local best: {}", worker_prefix, best.rating_str()); }, log_level, LOG_DEBUG);
+                std::lock_guard lock(best_mutex);
+                best_result = std::move(best);
                 best_arg = at;
             }
-
-            return res;
         }
     };
 
     void find_best() {
+        PROFILE if (print_profile) profile_reset();
         std::vector<std::unique_ptr<sampler>> samplers;
         for (size_t i = 0; i < n_threads; ++i) {
-            samplers.emplace_back(std::make_unique<sampler>(*this, i, n_threads != 1));
+            samplers.emplace_back(std::make_unique<sampler>(*this, i));
+        }
+        islands.clear();
+        for (std::unique_ptr<sampler>& samp : samplers) {
+            islands.push_back(samp.get());
         }
 
         bool any_valid = false;
-        size_t sample_count = 0, valid_sample_count = 0;
+        size_t sample_count = 0, valid_sample_count = 0, skipped_count = 0;
         size_t last_sample_count = 0, last_valid_sample_count = 0;
         float speed_iters, speed_valid_iters;
 
-        std::vector<float> cur_lower_bounds(lower_bounds);
-        std::vector<float> cur_upper_bounds(upper_bounds);
+        {
+            std::lock_guard lock(shared_mutex);
+            cur_lower_bounds = lower_bounds;
+            cur_upper_bounds = upper_bounds;
+            ++shared_version;
+        }
+
+        // aggregate sampler data
+        // samplers keep running meanwhile, so counts are taken from atomics and bests under their own locks
+        auto aggregate = [&]() {
+            timeline_span span("aggregate");
+            for (const std::unique_ptr<sampler>& samp : samplers) {
+                sample_count += samp->sample_count.exchange(0);
+                valid_sample_count += samp->valid_sample_count.exchange(0);
+                skipped_count += samp->skipped_count.exchange(0);
+
+                // copy out first, samplers take best_mutex while holding shared_mutex
+                std::unique_lock samp_lock(samp->best_mutex);
+                any_valid |= samp->best_result.valid();
+                if (!better_than(samp->best_result, best_result, maximise)) continue;
+                R samp_result = samp->best_result;
+                std::vector<float> samp_arg = samp->best_arg;
+                samp_lock.unlock();
+
+                std::lock_guard lock(shared_mutex);
+                best_result = samp_result;
+                best_arg = samp_arg;
+                // islands only hear of each other's bests through migration, or when bounds get zoomed around them
+                // a shared population already has it
+                if (migration_spacing == 0 && !shared_pop) ++shared_version;
+            }
+        };
+
+        // with more than one thread the samplers run continuously on a pool, otherwise they run on this thread between polls
+        std::unique_ptr<thread_pool> pool;
+        if (n_threads != 1) {
+            stop_sampling = false;
+            if (share_population) {
+                // at least a target per trial in flight
+                size_t chunk = batch_funct ? std::max((size_t)1, batch_size) : 1;
+                xoshiro256ss pop_rng = make_rng(n_threads);
+                shared_pop = std::make_unique<shared_population>(std::max(pop_size, n_threads * chunk + 3), cur_lower_bounds, cur_upper_bounds, pop_rng);
+            }
+            pool = std::make_unique<thread_pool>(n_threads);
+            // with a sample budget, they're instead handed their share of each round
+            if (max_samples == 0) {
+                for (std::unique_ptr<sampler>& samp : samplers) {
+                    pool->submit([&samp, &pool]{ samp->run(*pool); });
+                }
+            }
+        }
 
         for (size_t samp_idx = 0; samp_idx < sample_rounds; ++samp_idx) {
             if (status_SIGINT) break;
+            timeline_span round_span("sample round", "round", samp_idx + 1);
 
             time_point_t s_time = main_clock.now();
             // Divide total runtime by rounds
             duration_t round_duration = max_duration / sample_rounds;
             time_point_t end_time = s_time + round_duration;
 
-            while (main_clock.now() < end_time) {
+            if (max_samples != 0) {
+                // split what's left of the budget evenly over the rounds left, then over the samplers
+                // so it adds up to max_samples exactly, whatever any round took over
+                size_t left = max_samples - std::min(sample_count, max_samples);
+                size_t round_quota = left / (sample_rounds - samp_idx);
+                if (samp_idx + 1 == sample_rounds) round_quota = left;
+                for (size_t i = 0; i < samplers.size(); ++i) {
+                    std::unique_ptr<sampler>& samp = samplers[i];
+                    size_t quota = round_quota * (i + 1) / samplers.size() - round_quota * i / samplers.size();
+                    if (quota == 0) continue;
+                    auto task = [&samp, quota]{
+                        samp->sync();
+                        samp->sample_for(quota);
+                    };
+                    if (pool) {
+                        pool->submit(task);
+                    } else {
+                        task();
+                    }
+                }
+                if (pool) {
+                    timeline_span span("round barrier");
+                    pool->wait_idle();
+                }
+                // in a fixed order, so the outcome doesn't depend on which thread finished first
+                if (migration_spacing != 0) {
+                    timeline_span span("migrate");
+                    for (std::unique_ptr<sampler>& samp : samplers) samp->emigrate();
+                    for (std::unique_ptr<sampler>& samp : samplers) samp->immigrate();
+                }
+                aggregate();
+                log([&]{ return std::format("{} ({} valid) Samples, best: {}{}{}",
+                                            sample_count, valid_sample_count,
+                                            best_result.rating(),
+                                            surrogate_points != 0 ? std::format(", skipped: {}", skipped_count) : "",
+                                            status_funct ? ", " + status_funct() : "");
+                }, log_level, LOG_INFO, false);
+            }
+
+            while (max_samples == 0 && main_clock.now() < end_time) {
                 if (status_SIGINT) break;
 
                 time_point_t from = main_clock.now();
                 time_point_t time_to = std::min(end_time, from + poll_spacing);
 
-                for (std::unique_ptr<sampler>& samp : samplers) {
-                    // Update bounds for the samplers (in case we tightened them previous round)
-                    samp->reset(cur_lower_bounds, cur_upper_bounds);
-                    samp->start_sampling(time_to);
-                }
-
-                // just sleep until the samplers are done
-                std::this_thread::sleep_until(time_to);
-
-                // aggregate sampler data
-                for (const std::unique_ptr<sampler>& samp : samplers) {
-                    samp->wait_ready();
-                    sample_count += samp->sample_count;
-                    valid_sample_count += samp->valid_sample_count;
-                    samp->sample_count = 0;
-                    samp->valid_sample_count = 0;
-                    any_valid |= samp->best_result.valid();
-
-                    if (better_than(samp->best_result, best_result, maximise)) {
-                        best_result = samp->best_result;
-                        best_arg = samp->best_arg;
-                    }
+                if (pool) {
+                    std::this_thread::sleep_until(time_to);
+                } else {
+                    sampler& samp = *samplers[0];
+                    samp.sync();
+                    samp.until = time_to;
+                    samp.do_sampling();
                 }
 
+                aggregate();
+
                 if (log_level >= LOG_INFO) {
                     auto now = main_clock.now();
                     duration_t speed_tdiff = now - last_speed_update_time;
@@ -364,12 +1091,13 @@ struct optimiser {
                         last_speed_update_time = now;
                     }
                     last_poll_time = now;
-                    log([&]{ return std::format("{} ({} valid) Samples ({:.0f} ({:.0f}) samples/s), best: {}",
+                    log([&]{ return std::format("{} ({} valid) Samples ({:.0f} ({:.0f}) samples/s), best: {}{}{}",
                                                 sample_count, valid_sample_count,
                                                 speed_iters, speed_valid_iters,
-                                                best_result.rating());
+                                                best_result.rating(),
+                                                surrogate_points != 0 ? std::format(", skipped: {}", skipped_count) : "",
+                                                status_funct ? ", " + status_funct() : "");
                     }, log_level, LOG_INFO, false);
-                    std::flush(std::cout);
                 }
             }
 
@@ -387,6 +1115,11 @@ struct optimiser {
                     // Contract bounds around the best known argument to refine precision
                     float c_scale = std::pow(bounds_scale, samp_idx + 1);
 
+                    timeline_span span("zoom", "round", samp_idx + 1);
+                    std::lock_guard lock(shared_mutex);
+                    ++shared_version;
+                    std::vector<float> old_lower_bounds = cur_lower_bounds, old_upper_bounds = cur_upper_bounds;
+
                     // Ensure we don't collapse to zero width on dimensions that need variation
                     for(size_t d=0; d<cur_lower_bounds.size(); ++d) {
                         if(fixed_dims[d]) continue;
@@ -399,12 +1132,25 @@ struct optimiser {
                         cur_upper_bounds[d] = std::min(upper_bounds[d], best_arg[d] + current_span / 2.f);
                     }
 
+                    if (shared_pop) shared_pop->reproject(old_lower_bounds, old_upper_bounds, cur_lower_bounds, cur_upper_bounds);
                     log([&]{ return std::format("New bounds: [{}] to [{}]", vec_to_str(cur_lower_bounds), vec_to_str(cur_upper_bounds)); }, log_level, LOG_INFO);
                 }
             }
         }
 
+        if (pool) {
+            timeline_span span("stop");
+            stop_sampling = true;
+            pool->wait_idle();
+            aggregate();
+        }
+        islands.clear();
+        shared_pop.reset();
+
+        PROFILE if (print_profile) log(profile_report, log_level, LOG_NONE, false);
         log([&]() { return std::format("Finished with {} ({}) samples", sample_count, valid_sample_count); }, log_level, LOG_BASIC);
+        // callers go on to print results themselves
+        log_flush();
     }
 
     static bool better_than(const R& what, const R& than, bool maximise) {
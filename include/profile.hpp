@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "gas.hpp"
+
+// define this to count and time the phases of simulating and sampling, see profile_report()
+// without it, everything here compiles to nothing
+#ifdef ASIM_PROFILE
+#define PROFILE if constexpr (true)
+#else
+#define PROFILE if constexpr (false)
+#endif
+
+namespace asim {
+
+// for code that does something else when profiling is compiled out
+#ifdef ASIM_PROFILE
+inline constexpr bool profiling_enabled = true;
+#else
+inline constexpr bool profiling_enabled = false;
+#endif
+
+// timed phases, the sim ones happen within evaluate
+enum struct profile_phase : uint8_t {
+    // optimiser: making trials, including prescreening them
+    trial,
+    // optimiser: simulating them
+    evaluate,
+    // optimiser: selection, recording results and migration
+    select,
+    // do_sim(): reading and rounding inputs
+    sim_read,
+    // do_sim(): looking the inputs up in the cache
+    sim_cache,
+    // do_sim(): filling the tank with canister_fill_to()
+    sim_fill,
+    // do_sim(): checking restrictions
+    sim_restrict,
+    // do_sim(): ticking
+    sim_tick,
+    count
+};
+
+// counted events of do_sim()
+enum struct profile_event : uint8_t {
+    // mix-to temperature isn't between the fuel and primer's
+    rejected_order,
+    // fuel pressure came out above the fill pressure, or negative
+    rejected_pressure,
+    rejected_pre_restrictions,
+    failed_post_restrictions,
+    cache_hit,
+    given_up,
+    simulated,
+    count
+};
+
+inline constexpr size_t profile_phase_count = (size_t)profile_phase::count;
+inline constexpr size_t profile_event_count = (size_t)profile_event::count;
+// ticks per simulated bomb, bucket i holding [2^(i-1), 2^i)
+inline constexpr size_t profile_tick_buckets = 24;
+inline constexpr size_t profile_reaction_buckets = std::popcount(all_reactions_mask) + 1;
+
+// one thread's counters, plain numbers since only their thread writes them
+// read them merged with profile_merged() once the threads are done
+struct profile_data {
+    uint64_t calls[profile_phase_count] = {};
+    uint64_t cycles[profile_phase_count] = {};
+    uint64_t events[profile_event_count] = {};
+    uint64_t ticks[profile_tick_buckets] = {};
+    // how many reactions happened each tick
+    uint64_t reactions[profile_reaction_buckets] = {};
+
+    profile_data& operator+=(const profile_data& other);
+};
+
+// TSC cycles where there is one, otherwise nanoseconds
+inline uint64_t profile_clock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// this thread's counters
+profile_data& profile_local();
+// every thread's counters summed, including threads that have exited since
+profile_data profile_merged();
+// zero every thread's counters, while none are running
+void profile_reset();
+// table of where time went and histograms, from profile_merged()
+std::string profile_report();
+
+// times its scope as phase
+struct profile_scope {
+    profile_phase phase;
+    uint64_t start = 0;
+
+    explicit profile_scope(profile_phase phase): phase(phase) {
+        PROFILE start = profile_clock();
+    }
+    ~profile_scope() {
+        PROFILE {
+            profile_data& data = profile_local();
+            ++data.calls[(size_t)phase];
+            data.cycles[(size_t)phase] += profile_clock() - start;
+        }
+    }
+};
+
+inline void profile_count(profile_event event) {
+    PROFILE ++profile_local().events[(size_t)event];
+}
+
+inline void profile_ticks(size_t ticks) {
+    PROFILE ++profile_local().ticks[std::min((size_t)std::bit_width(ticks), profile_tick_buckets - 1)];
+}
+
+inline void profile_reactions(reaction_mask fired) {
+    PROFILE ++profile_local().reactions[std::popcount(fired & all_reactions_mask)];
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+namespace asim {
+
+// __extension__ keeps -pedantic quiet about the 128-bit type
+__extension__ typedef unsigned __int128 uint128_t;
+
+// xoshiro256**, see Blackman & Vigna 2018
+// a few adds, shifts and a multiply per draw, and jump() splits it into 2^128 non-overlapping streams, one per thread
+// also works as a UniformRandomBitGenerator for the std distributions
+struct xoshiro256ss {
+    using result_type = uint64_t;
+
+    uint64_t s[4];
+
+    // the state is spread out from seed with splitmix64, so nearby seeds give unrelated streams
+    explicit xoshiro256ss(uint64_t seed = 0);
+    void seed(uint64_t seed);
+    // seeded from std::random_device
+    static xoshiro256ss random();
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()() {
+        uint64_t out = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return out;
+    }
+
+    // advance as if by 2^128 draws
+    void jump();
+    // a copy of us, then jump, so the copy and us never draw the same numbers
+    xoshiro256ss split();
+
+    // uniform in [0, 1)
+    float uniform() {
+        return (float)(operator()() >> 40) * 0x1.0p-24f;
+    }
+    float uniform(float from, float to) {
+        return from + uniform() * (to - from);
+    }
+    // fills out with uniforms in [0, 1), two per draw
+    void uniform(std::span<float> out) {
+        size_t n = out.size();
+        size_t i = 0;
+        for (; i + 2 <= n; i += 2) {
+            uint64_t r = operator()();
+            out[i] = (float)(r >> 40) * 0x1.0p-24f;
+            out[i + 1] = (float)((r >> 16) & 0xffffff) * 0x1.0p-24f;
+        }
+        if (i < n) out[i] = uniform();
+    }
+    // uniform in [0, n), n > 0
+    // by multiplying instead of taking a remainder, see Lemire 2019; biased by at most n / 2^64, so not worth rejecting for
+    size_t below(size_t n) {
+        return (size_t)(((uint128_t)operator()() * n) >> 64);
+    }
+
+    static constexpr uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+}
@@ -1,12 +1,18 @@
 #pragma once
 
+#include <atomic>
+#include <format>
+#include <memory>
+#include <span>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <argparse/read.hpp>
 
 #include "gas.hpp"
 #include "tank.hpp"
+#include "trace.hpp"
 #include "utility.hpp"
 
 namespace asim {
@@ -79,6 +85,8 @@ inline std::istream& operator>>(std::istream& stream, field_restriction<T>& re)
 
 extern std::string params_supported_str;
 
+struct sim_cache;
+
 struct bomb_data {
     std::vector<float> mix_ratios, primer_ratios;
     float to_pressure, fuel_temp, fuel_pressure, thir_temp, mix_to_temp;
@@ -102,7 +110,14 @@ struct bomb_data {
         tank(tank),
         round_pressure_to(round_pressure_to), round_temp_to(round_temp_to), round_ratio_to(round_ratio_to) {};
 
-    void sim_ticks(size_t up_to, field_ref<bomb_data> optstat_ref, bool measure_pre);
+    // gases, reactions: every gas the tank may hold and reaction that may happen in it, used to simulate faster
+    // give_up_under: see gas_tank::tick_n()
+    // returns: false if the simulation gave up, leaving us unfinished
+    bool sim_ticks(size_t up_to, field_ref<bomb_data> optstat_ref, bool measure_pre,
+                   gas_mask gases = all_gases_mask, reaction_mask reactions = all_reactions_mask, float give_up_under = 0.f);
+    // sim_ticks() split in two, for when the tank is simulated elsewhere
+    void begin_sim(field_ref<bomb_data> optstat_ref, bool measure_pre);
+    void finish_sim(size_t sim_ticks, field_ref<bomb_data> optstat_ref, bool measure_pre);
 
     std::string mix_string(const std::vector<gas_ref>& gases, const std::vector<float>& fractions) const;
     std::string mix_string_simple(const std::vector<gas_ref>& gases, const std::vector<float>& fractions) const;
@@ -112,9 +127,9 @@ struct bomb_data {
 
     std::string serialize() const;
     // deserialises us from an input string - note that this gives an unsimulated tank
-    static bomb_data deserialize(std::string_view str);
+    static bomb_data deserialize(std::string_view str, const ruleset& rules = default_ruleset);
 
-    std::string measure_tolerances(float tol = default_tol) const;
+    std::string measure_tolerances(float tol = default_ruleset.default_tol) const;
 
     static const field_ref<bomb_data> radius_field;
     static const field_ref<bomb_data> ticks_field;
@@ -125,36 +140,71 @@ struct bomb_data {
 
 std::istream& operator>>(std::istream& stream, field_ref<bomb_data>& re);
 
+// what the optimiser needs to know about a simulated bomb
+// kept small and trivially copyable so evaluating a bomb doesn't allocate
+struct sim_result {
+    float optstat = 0.f;
+    float fin_radius = 0.f, fin_pressure = 0.f, fuel_pressure = 0.f;
+    int ticks = 0;
+    bool valid = false;
+    // given up on as it couldn't beat the best result so far, see radius_to_beat, also invalid
+    bool dominated = false;
+};
+static_assert(std::is_trivially_copyable_v<sim_result>);
+
 // wrapper for bomb_data for use by the optimiser
 struct opt_val_wrap {
+    sim_result res;
+    // full bomb, only set once materialise_result() was called on this
     std::shared_ptr<bomb_data> data = nullptr;
-    bool valid_v = true;
 
-    opt_val_wrap(): valid_v(false) {}
-    opt_val_wrap(std::shared_ptr<bomb_data>& d): data(d), valid_v(d != nullptr) {}
-    opt_val_wrap(std::shared_ptr<bomb_data>& d, bool val): data(d), valid_v(val) {}
+    opt_val_wrap() {}
+    opt_val_wrap(const sim_result& res): res(res) {}
     // methods below required for optimiser
     bool valid() const {
-        return valid_v;
+        return res.valid;
     }
     float rating() const {
-        return valid() ? data->optstat : 0.f;
+        return valid() ? res.optstat : 0.f;
     }
     std::string rating_str() const {
-        if (!data) return "[INVALID BOMB]";
-        return data->print_inline();
+        if (data) return data->print_inline();
+        if (res.dominated) return "[DOMINATED BOMB]";
+        if (!valid()) return "[INVALID BOMB]";
+        return std::format("S: [ time {:.1f}s | radius {:.2f}til | optstat {} ]", res.ticks * default_ruleset.tickrate, res.fin_radius, res.optstat);
     }
     bool operator>(const opt_val_wrap& rhs) const {
-        return data->optstat == rhs.data->optstat ? data->fin_radius > rhs.data->fin_radius : data->optstat > rhs.data->optstat;
+        return res.optstat == rhs.res.optstat ? res.fin_radius > rhs.res.fin_radius : res.optstat > rhs.res.optstat;
     }
     bool operator>=(const opt_val_wrap& rhs) const {
-        return data->optstat >= rhs.data->optstat;
+        return res.optstat >= rhs.res.optstat;
     }
     bool operator==(const opt_val_wrap& rhs) const {
-        return data->optstat == rhs.data->optstat;
+        return res.optstat == rhs.res.optstat;
     }
 };
 
+// false if no bomb can meet these, e.g. an empty range or more ticks than tick_cap
+bool restrictions_satisfiable(const std::vector<field_restriction<bomb_data>>& pre_restrictions,
+                              const std::vector<field_restriction<bomb_data>>& post_restrictions, size_t tick_cap);
+// ticks to simulate for: a bomb still going after this many breaks an upper bound on ticks, so it's invalid however it ends
+size_t restricted_tick_limit(const std::vector<field_restriction<bomb_data>>& post_restrictions, size_t tick_cap);
+// pressure a bomb has to be able to get over to meet a lower bound on radius, 0 if there's none
+// bombs whose pressure bound falls under it are invalid however they end, so they're given up on like with radius_to_beat
+float restricted_min_pressure(const std::vector<field_restriction<bomb_data>>& post_restrictions, const ruleset& rules);
+
+// the best radius found so far, shared by everything simulating for one optimiser maximising radius
+// bombs whose pressure bound shows they can't beat it are given up on, see gas_mixture_t::pressure_bound()
+struct radius_to_beat {
+    std::atomic<float> radius{0.f};
+    std::atomic<size_t> dominated{0};
+
+    // raise radius to this if it's higher, for every new best result
+    void offer(float new_radius);
+    // pressure a bomb has to be able to get over to beat radius, 0 if there's nothing to beat yet
+    float pressure(const ruleset& rules) const;
+};
+
 struct bomb_args {
     const std::vector<gas_ref>& mix_gases;
     const std::vector<gas_ref>& primer_gases;
@@ -166,10 +216,46 @@ struct bomb_args {
     field_ref<bomb_data> opt_param;
     const std::vector<field_restriction<bomb_data>>& pre_restrictions;
     const std::vector<field_restriction<bomb_data>>& post_restrictions;
+    // optional: results are looked up here before simulating and stored after
+    sim_cache* cache = nullptr;
+    const ruleset* rules = &default_ruleset;
+    // optional: give up on bombs that can't beat this, only for maximising fin_radius measured after the simulation
+    radius_to_beat* to_beat = nullptr;
+    // derived from the above: what can ever be in the tank and happen in it
+    gas_mask gases = reachable_gases(mask_of(mix_gases) | mask_of(primer_gases));
+    reaction_mask reactions = possible_reactions(gases);
+    // what the restrictions rule out before simulating: whether any bomb can meet them, after how many ticks none can and under what pressure
+    bool satisfiable = restrictions_satisfiable(pre_restrictions, post_restrictions, tick_cap);
+    size_t tick_limit = restricted_tick_limit(post_restrictions, tick_cap);
+    float min_pressure = restricted_min_pressure(post_restrictions, *rules);
 };
 
 // args: target_temp, fuel_temp, thir_temp, mix ratios..., primer ratios...
 opt_val_wrap do_sim(const std::vector<float>& in_args, const bomb_args& args);
+// same as do_sim but for many inputs at once, simulated batch_width tanks at a time
+void do_sim_batch(std::span<const std::vector<float>> in_args, const bomb_args& args, std::span<opt_val_wrap> out);
+// fills in res.data with the full bomb for in_args, simulating it again
+void materialise_result(const std::vector<float>& in_args, const bomb_args& args, opt_val_wrap& res);
+
+// the same bombs simulated under several rulesets, e.g. the configs of different servers
+// a bomb is rated by its worst result, so only ones that work everywhere score well
+struct multi_bomb_args {
+    // one per ruleset, each with its own cache if any
+    std::vector<bomb_args> per_ruleset;
+    bool maximise;
+};
+
+// the worse of two results for the same bomb: invalid if either is
+sim_result worse_result(const sim_result& lhs, const sim_result& rhs, bool maximise);
+
+opt_val_wrap do_sim_multi(const std::vector<float>& in_args, const multi_bomb_args& args);
+void do_sim_multi_batch(std::span<const std::vector<float>> in_args, const multi_bomb_args& args, std::span<opt_val_wrap> out);
+// the full bomb is the one simulated under the ruleset it did worst under, so it shows what it was rated by
+// returns: the args of that ruleset
+const bomb_args& materialise_multi(const std::vector<float>& in_args, const multi_bomb_args& args, opt_val_wrap& res);
+
+// simulate a serialised bomb again under args' rules, recording its ticks into trace
+void trace_bomb(std::string_view serialized, const bomb_args& args, tick_trace& trace);
 
 }
 
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gas.hpp"
+#include "sim.hpp"
+
+namespace asim {
+
+// identifies a simulated bomb: its gas sets and its inputs after rounding
+// rounded inputs are points on the round_*_to lattice, so their float bits identify the lattice point exactly
+struct sim_key {
+    static constexpr size_t max_len = 4 + 2 * gas_count;
+
+    // gas sets, one gas index per 4 bits
+    uint64_t mix_gases = 0, primer_gases = 0;
+    uint32_t values[max_len] {};
+    uint32_t len = 0;
+
+    sim_key(const std::vector<gas_ref>& mix_gases, const std::vector<gas_ref>& primer_gases);
+
+    void push(float value);
+    size_t hash() const;
+
+    bool operator==(const sim_key& rhs) const = default;
+};
+
+// bounded, thread-safe memo of do_sim results
+// split into shards each with its own lock, entries are evicted with the CLOCK algorithm once a shard is full
+// only valid for one set of bomb_args: results depend on the tick cap, parameter and restrictions too
+struct sim_cache {
+    sim_cache(size_t capacity, size_t shard_count = 64);
+
+    // returns: whether the key was found, in which case out is set
+    bool get(const sim_key& key, sim_result& out);
+    void put(const sim_key& key, const sim_result& value);
+
+    size_t hits() const;
+    size_t misses() const;
+    float hit_rate() const;
+    // hit rate since the last call, and overall
+    std::string status_str();
+
+private:
+    struct key_hash {
+        size_t operator()(const sim_key& key) const {
+            return key.hash();
+        }
+    };
+
+    struct entry {
+        sim_key key;
+        sim_result value;
+        // CLOCK reference bit: set on access, cleared as the hand sweeps past
+        bool referenced = false;
+    };
+
+    struct alignas(64) shard {
+        std::mutex mutex;
+        std::unordered_map<sim_key, size_t, key_hash> index;
+        std::vector<entry> entries;
+        size_t hand = 0;
+        size_t capacity = 0;
+        // counted per shard so threads don't all hit one cache line
+        std::atomic<size_t> hits{0};
+        std::atomic<size_t> misses{0};
+    };
+
+    std::vector<std::unique_ptr<shard>> shards;
+    size_t last_hits = 0, last_misses = 0;
+
+    shard& shard_for(const sim_key& key);
+};
+
+}
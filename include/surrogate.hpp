@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace asim {
+
+// online model of how good an input is, fit to the last capacity results seen
+// predicts by kernel-weighted nearest neighbours, with their spread and distance as uncertainty
+// adding a result is O(dimensions) and predicting is O(capacity * dimensions), so capacity bounds its cost
+struct surrogate {
+    static constexpr size_t max_neighbours = 32;
+
+    size_t capacity;
+    size_t neighbours;
+    size_t dims = 0;
+
+    // inputs, stored by dimension as dims columns of capacity, and their ratings, oldest overwritten first
+    std::vector<float> points;
+    std::vector<float> ratings;
+    // squared distances of every point to the one being predicted
+    mutable std::vector<float> distances;
+    size_t count = 0;
+    size_t next = 0;
+
+    // neighbours: how many nearest results a prediction looks at, at most max_neighbours
+    surrogate(size_t capacity, size_t neighbours = 8);
+
+    void add(const std::vector<float>& at, float rating);
+    // scale: per-dimension factor making distances comparable, e.g. 1 / bound width, 0 to ignore a dimension
+    // returns: false if the model knows too little to guess yet, otherwise sets mean and sd
+    bool predict(const std::vector<float>& at, const std::vector<float>& scale, float& mean, float& sd) const;
+    void clear();
+    size_t size() const;
+};
+
+}
@@ -4,28 +4,83 @@
 
 namespace asim {
 
-struct gas_tank {
+// what every gas_tank_t shares
+// no data members here, so tanks stay standard-layout
+struct gas_tank_base {
     enum tank_state {
         st_intact = 0,
         st_ruptured = 1,
         st_exploded = 2
     };
 
-    gas_mixture mix = gas_mixture(tank_volume);
+    // what tick_n() returns when it gave up
+    static constexpr size_t gave_up = -1;
+    // how many ticks apart tick_n() checks whether to give up
+    static constexpr size_t give_up_check_spacing = 8;
+
+    static float calc_radius(float pressure, const ruleset& rules = default_ruleset);
+};
+
+// tick_n() observer that watches nothing, so observing costs nothing unless asked for
+struct no_tick_observer {
+    template<typename Tank>
+    void operator()(const Tank&, size_t, reaction_mask) {}
+};
+
+// tank whose mix can only hold the gases in Mask, see gas_mixture_t
+template<gas_mask Mask>
+struct gas_tank_t : gas_tank_base {
+    gas_mixture_t<Mask> mix;
     tank_state state = st_intact;
     int integrity = 3;
 
+    gas_tank_t(const ruleset& rules = default_ruleset): mix(rules.tank_volume, rules) {}
+
     // go forward in time one tick
     // returns: whether anything happened
     bool tick();
     // simulate until the tank is no longer intact, up to ticks_limit ticks
-    // returns: how many ticks we went forward
-    size_t tick_n(size_t ticks_limit);
+    // reactions: reactions to check for, leaving out ones that can't happen saves time, see possible_reactions()
+    // give_up_under: stop once mix.pressure_bound() shows the pressure will stay under this, for when that's not worth simulating
+    // returns: how many ticks we went forward, or gave_up
+    size_t tick_n(size_t ticks_limit, reaction_mask reactions = all_reactions_mask, float give_up_under = 0.f);
+    // tick_n(), calling observer(*this, tick, reactions that happened) after every tick
+    // ticks skipped once the tank stops changing aren't observed, they'd all be the same as the last one
+    // compiled for no_tick_observer and tick_trace
+    template<typename Observer>
+    size_t tick_n(size_t ticks_limit, reaction_mask reactions, float give_up_under, Observer& observer);
+
+    // copy mix and state from a tank with a different gas set
+    template<gas_mask M>
+    void assign(const gas_tank_t<M>& from) {
+        mix.assign(from.mix);
+        state = from.state;
+        integrity = from.integrity;
+    }
 
     float calc_radius();
-    static float calc_radius(float pressure);
+    using gas_tank_base::calc_radius;
 
     std::string get_status();
+
+private:
+    // fired: set to the reactions that happened
+    bool tick(typename gas_mixture_t<Mask>::reaction_tick_t react, reaction_mask& fired);
+    // bitwise, so a tick from either state gives the same result
+    bool same_state(const gas_tank_t& other) const;
 };
 
+// tank that can hold any gas
+typedef gas_tank_t<all_gases_mask> gas_tank;
+
+// defined in tank.cpp for these
+extern template struct gas_tank_t<fire_gases_mask>;
+extern template struct gas_tank_t<no_nitrium_gases_mask>;
+extern template struct gas_tank_t<all_gases_mask>;
+
+// tick_n a tank with a gas_tank_t only holding the given gases, or the smallest compiled one holding them
+// gases has to include everything already in the tank and be closed under reactions, see reachable_gases()
+// results are the same as tank.tick_n(ticks_limit, reactions, give_up_under)
+size_t tick_n_subset(gas_tank& tank, size_t ticks_limit, gas_mask gases, reaction_mask reactions = all_reactions_mask, float give_up_under = 0.f);
+
 }
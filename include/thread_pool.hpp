@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace asim {
+
+// fixed-size pool of worker threads with one task deque per worker
+// a worker takes tasks from the back of its own deque and steals from the front of the others' when it runs dry
+struct thread_pool {
+    typedef std::function<void()> task_t;
+
+    thread_pool(size_t n_threads);
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    // tasks submitted from a worker go to that worker's own deque, others are spread round-robin
+    void submit(task_t task);
+    // block until every submitted task, including ones submitted by tasks, has finished
+    void wait_idle();
+
+    size_t size() const;
+
+private:
+    struct worker_queue {
+        std::mutex mutex;
+        std::deque<task_t> tasks;
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::vector<std::thread> workers;
+
+    // tasks sitting in deques
+    std::atomic<size_t> queued{0};
+    // tasks submitted and not yet finished
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> sleeping{0};
+    std::atomic<size_t> next_queue{0};
+    std::atomic<bool> stopping{false};
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    std::mutex idle_mutex;
+    std::condition_variable idle_cv;
+
+    void worker_loop(size_t index);
+    bool try_pop(size_t index, task_t& task);
+};
+
+}
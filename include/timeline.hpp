@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace asim {
+
+// what happened when on which thread during a run, written in Chrome's trace event format for Perfetto or chrome://tracing
+// off unless timeline_start() was called, so recording costs a relaxed load until then
+// each thread records into its own buffer, they're only read by timeline_write() once the threads are done
+struct timeline_event {
+    // static strings, so recording doesn't allocate
+    const char* name;
+    // ns since timeline_start()
+    uint64_t start, duration;
+    // 'X' for a span, 'i' for an instant
+    char kind;
+    // optional number shown with the event
+    const char* arg_name = nullptr;
+    double arg = 0.0;
+};
+
+inline std::atomic<bool> timeline_enabled = false;
+// spans with the same name and argument less than this many ns apart on a thread are recorded as one
+inline constexpr uint64_t timeline_merge_gap = 10000;
+
+// clears what was recorded and starts recording
+void timeline_start();
+void timeline_stop();
+// names the calling thread in the timeline
+void timeline_thread_name(std::string name);
+uint64_t timeline_now();
+void timeline_record(const timeline_event& event);
+// every thread's events as a trace event JSON object
+void timeline_write(std::ostream& out);
+
+inline void timeline_instant(const char* name, const char* arg_name = nullptr, double arg = 0.0) {
+    if (!timeline_enabled.load(std::memory_order_relaxed)) return;
+    timeline_record({name, timeline_now(), 0, 'i', arg_name, arg});
+}
+
+// records its scope as a span
+struct timeline_span {
+    const char* name;
+    const char* arg_name;
+    double arg;
+    uint64_t start = 0;
+    bool enabled;
+
+    explicit timeline_span(const char* name, const char* arg_name = nullptr, double arg = 0.0)
+        : name(name), arg_name(arg_name), arg(arg), enabled(timeline_enabled.load(std::memory_order_relaxed)) {
+        if (enabled) start = timeline_now();
+    }
+    ~timeline_span() {
+        if (enabled) timeline_record({name, start, timeline_now() - start, 'X', arg_name, arg});
+    }
+};
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "gas.hpp"
+#include "tank.hpp"
+
+namespace asim {
+
+// tick_n() observer keeping the last capacity ticks of a tank, see gas_tank_t::tick_n()
+// everything is allocated up front and stored by column, so recording a tick is a handful of stores
+//
+// a trace file is any number of traces one after another, each being:
+//   the magic "ASIMTRC1", u32 label length, the label, u32 gas count, u32 record count, u64 ticks recorded in total
+//   then each column, oldest record first: u32 tick, f32 temperature, f32 pressure, f32 amounts per gas in gas_types order,
+//   i8 integrity, u8 state, u8 reactions that happened
+// numbers are stored as laid out in memory, so traces only read back on machines with the same endianness
+struct tick_trace {
+    size_t capacity;
+    // records ever made, the last min(recorded, capacity) of them are kept
+    uint64_t recorded = 0;
+    // where the next record goes
+    size_t next = 0;
+
+    std::vector<uint32_t> ticks;
+    std::vector<float> temperatures;
+    std::vector<float> pressures;
+    // gas_count columns of capacity each
+    std::vector<float> amounts;
+    std::vector<int8_t> integrities;
+    std::vector<uint8_t> states;
+    std::vector<uint8_t> reactions;
+
+    explicit tick_trace(size_t capacity);
+
+    template<gas_mask Mask>
+    void operator()(const gas_tank_t<Mask>& tank, size_t tick, reaction_mask fired) {
+        size_t at = next;
+        next = next + 1 == capacity ? 0 : next + 1;
+        ++recorded;
+        ticks[at] = tick;
+        // straight from the fields, the getters aren't inline
+        temperatures[at] = tank.mix.temperature;
+        pressures[at] = tank.mix.cached_total_gas * tank.mix.temperature * tank.mix.rvol;
+        using mix_t = gas_mixture_t<Mask>;
+        for (size_t i = 0; i < gas_count; ++i) {
+            amounts[i * capacity + at] = mix_t::has({i}) ? tank.mix.amounts[mix_t::slot_of({i})] : 0.f;
+        }
+        integrities[at] = tank.integrity;
+        states[at] = tank.state;
+        reactions[at] = fired;
+    }
+
+    // how many records are kept
+    size_t size() const;
+    // storage index of the i-th oldest record kept
+    size_t slot(size_t i) const;
+    void clear();
+
+    // label: what this is a trace of, e.g. a serialised bomb
+    void write(std::ostream& out, std::string_view label) const;
+    // read the next trace of a trace file, replacing what we hold
+    // returns: false if there are no traces left, throws if the file is malformed
+    bool read(std::istream& in, std::string& label);
+
+    // header line then one line per record, oldest first
+    std::string to_csv() const;
+};
+
+}
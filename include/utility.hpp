@@ -10,6 +10,8 @@
 #include <string>
 #include <vector>
 
+#include "rng.hpp"
+
 // define this to omit exception checks in hotcode
 #ifdef ASIM_NOEXCEPT
 #define CHECKEXCEPT if constexpr (false)
@@ -17,6 +19,13 @@
 #define CHECKEXCEPT if constexpr (true)
 #endif
 
+// define this to check incrementally kept values against recomputing them, slow
+#ifdef ASIM_CHECK_CACHES
+#define CHECKCACHE if constexpr (true)
+#else
+#define CHECKCACHE if constexpr (false)
+#endif
+
 namespace asim {
 
 float frand();
@@ -54,6 +63,7 @@ std::vector<float> normalized(const std::vector<float>& vec);
 std::vector<float> random_vec(size_t dims, float scale);
 std::vector<float> random_vec(size_t dims, float scale, float len);
 std::vector<float> random_vec(const std::vector<float>& lower_bounds, const std::vector<float>& upper_bounds);
+std::vector<float> random_vec(const std::vector<float>& lower_bounds, const std::vector<float>& upper_bounds, xoshiro256ss& rng);
 std::vector<float> orthogonal_noise(const std::vector<float>& dir, float strength);
 
 // ->num non-modifying operations
@@ -66,9 +76,11 @@ bool vec_in_bounds(const std::vector<float>& vec, const std::vector<float>& lowe
 void space_vectors(std::vector<std::vector<float>>& vecs, float strength);
 
 inline const size_t LOG_NONE = 0, LOG_BASIC = 1, LOG_INFO = 2, LOG_DEBUG = 3, LOG_TRACE = 4;
-inline std::mutex log_mutex;
 
+// str is formatted by the caller then written in the background, see log_flush()
 void log(std::function<std::string()>&& str, size_t log_level, size_t level, bool endl = true, bool clear = true);
+// wait for everything logged so far to be written, before writing to std::cout directly
+void log_flush();
 
 
 inline std::chrono::system_clock main_clock;
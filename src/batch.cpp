@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "batch.hpp"
+#include "profile.hpp"
+#include "utility.hpp"
+
+namespace asim {
+
+static bool any_lane(const int* mask) {
+    bool any = false;
+    for (size_t l = 0; l < batch_width; ++l) {
+        any |= mask[l];
+    }
+    return any;
+}
+
+/// <gas_mixture_batch>
+
+void gas_mixture_batch::load(size_t lane, const gas_mixture& mix) {
+    CHECKEXCEPT {
+        if (mix.rules != rules) throw std::runtime_error("loaded gas mixture uses different rules than its batch");
+    }
+    for (size_t i = 0; i < gas_count; ++i) {
+        amounts[i][lane] = mix.amounts[i];
+    }
+    temperature[lane] = mix.temperature;
+    cached_total_gas[lane] = mix.cached_total_gas;
+    cached_heat_capacity[lane] = mix.cached_heat_capacity;
+}
+
+void gas_mixture_batch::store(size_t lane, gas_mixture& mix) const {
+    for (size_t i = 0; i < gas_count; ++i) {
+        mix.amounts[i] = amounts[i][lane];
+    }
+    mix.temperature = temperature[lane];
+    mix.cached_total_gas = cached_total_gas[lane];
+    mix.cached_heat_capacity = cached_heat_capacity[lane];
+}
+
+// mirrors gas_mixture::refresh_cache(), summing in the same order
+void gas_mixture_batch::refresh_cache(const int* lanes) {
+    alignas(64) float total_gas[batch_width] {};
+    alignas(64) float heat_capacity[batch_width] {};
+    for (size_t i = 0; i < gas_count; ++i) {
+        float specific_heat = gas_ref{i}.specific_heat(*rules);
+        for (size_t l = 0; l < batch_width; ++l) {
+            total_gas[l] += amounts[i][l];
+            heat_capacity[l] += specific_heat * amounts[i][l];
+        }
+    }
+    for (size_t l = 0; l < batch_width; ++l) {
+        cached_total_gas[l] = lanes[l] ? total_gas[l] : cached_total_gas[l];
+        cached_heat_capacity[l] = lanes[l] ? heat_capacity[l] : cached_heat_capacity[l];
+    }
+}
+
+void gas_mixture_batch::heat_capacity(float* out) const {
+    for (size_t l = 0; l < batch_width; ++l) {
+        out[l] = cached_heat_capacity[l];
+    }
+}
+
+void gas_mixture_batch::pressure(float* out) const {
+    for (size_t l = 0; l < batch_width; ++l) {
+        out[l] = cached_total_gas[l] * temperature[l] * rvol;
+    }
+}
+
+// mirrors gas_mixture::reaction_tick()
+void gas_mixture_batch::reaction_tick(const int* active, int* reacted) {
+    // local copies of the constants, so the compiler knows stores to the lanes can't change them
+    const float tritium_burn_fuel_ratio = rules->tritium_burn_fuel_ratio, frezon_production_temp = rules->frezon_production_temp,
+                nitrium_decomp_temp = rules->nitrium_decomp_temp, frezon_cool_temp = rules->frezon_cool_temp,
+                n2o_decomp_temp = rules->n2o_decomp_temp, trit_fire_temp = rules->trit_fire_temp, plasma_fire_temp = rules->plasma_fire_temp,
+                reaction_min_gas = rules->reaction_min_gas;
+    const reaction_mask reactions = this->reactions;
+    float* heat_capacity_cache = cached_heat_capacity;
+    alignas(64) float temp[batch_width];
+    alignas(64) int gate[batch_width];
+    for (size_t l = 0; l < batch_width; ++l) {
+        temp[l] = temperature[l];
+        reacted[l] = 0;
+    }
+    const float* oxy = amounts[oxygen.idx];
+    const float* nit = amounts[nitrogen.idx];
+    const float* pla = amounts[plasma.idx];
+    const float* tri = amounts[tritium.idx];
+    const float* fre = amounts[frezon.idx];
+    const float* nox = amounts[nitrous_oxide.idx];
+    const float* ntr = amounts[nitrium.idx];
+
+    if (reactions & r_frezon_production) {
+        for (size_t l = 0; l < batch_width; ++l) {
+            gate[l] = active[l] && temp[l] < frezon_production_temp && oxy[l] >= reaction_min_gas && nit[l] >= reaction_min_gas && tri[l] >= reaction_min_gas;
+        }
+        if (any_lane(gate)) react_frezon_production(gate, heat_capacity_cache, reacted);
+    }
+    if (reactions & r_nitrium_decomposition) {
+        for (size_t l = 0; l < batch_width; ++l) {
+            gate[l] = active[l] && temp[l] < nitrium_decomp_temp && oxy[l] >= reaction_min_gas && ntr[l] >= reaction_min_gas;
+        }
+        if (any_lane(gate)) react_nitrium_decomposition(gate, heat_capacity_cache, reacted);
+    }
+    if (reactions & r_frezon_coolant) {
+        for (size_t l = 0; l < batch_width; ++l) {
+            gate[l] = active[l] && temp[l] >= frezon_cool_temp && nit[l] >= reaction_min_gas && fre[l] >= reaction_min_gas;
+        }
+        if (any_lane(gate)) react_frezon_coolant(gate, heat_capacity_cache, reacted);
+    }
+    if (reactions & r_N2O_decomposition) {
+        for (size_t l = 0; l < batch_width; ++l) {
+            gate[l] = active[l] && temp[l] >= n2o_decomp_temp && nox[l] >= reaction_min_gas;
+        }
+        if (any_lane(gate)) react_N2O_decomposition(gate, heat_capacity_cache, reacted);
+    }
+    if (reactions & r_tritium_fire) {
+        for (size_t l = 0; l < batch_width; ++l) {
+            gate[l] = active[l] && temp[l] >= trit_fire_temp && oxy[l] >= reaction_min_gas && tri[l] >= reaction_min_gas;
+        }
+        if (any_lane(gate)) {
+            if (tritium_burn_fuel_ratio > 0) {
+                react_tritium_fire_new(gate, heat_capacity_cache, reacted);
+            } else {
+                react_tritium_fire_old(gate, heat_capacity_cache, reacted);
+            }
+        }
+    }
+    if (reactions & r_plasma_fire) {
+        for (size_t l = 0; l < batch_width; ++l) {
+            gate[l] = active[l] && temp[l] >= plasma_fire_temp && oxy[l] >= reaction_min_gas && pla[l] >= reaction_min_gas;
+        }
+        if (any_lane(gate)) react_plasma_fire(gate, heat_capacity_cache, reacted);
+    }
+}
+
+// the reactions below compute every branch for every lane and then select, instead of branching
+// the arithmetic on each path is kept in the exact order used by gas_mixture so the results stay bit-identical
+
+void gas_mixture_batch::react_plasma_fire(const int* gate, float* heat_capacity_cache, int* reacted) {
+    // local copies of the constants, so the compiler knows stores to the lanes can't change them
+    const float plasma_upper_temperature = rules->plasma_upper_temperature,
+                plasma_minimum_burn_temperature = rules->plasma_minimum_burn_temperature,
+                oxygen_burn_rate_base = rules->oxygen_burn_rate_base, plasma_oxygen_fullburn = rules->plasma_oxygen_fullburn,
+                plasma_burn_rate_delta = rules->plasma_burn_rate_delta, minimum_heat_capacity = rules->minimum_heat_capacity,
+                super_saturation_ends = rules->super_saturation_ends, super_saturation_threshold = rules->super_saturation_threshold,
+                fire_plasma_energy_released = rules->fire_plasma_energy_released;
+    float* oxy = amounts[oxygen.idx];
+    float* pla = amounts[plasma.idx];
+    float* tri = amounts[tritium.idx];
+    float* co2 = amounts[carbon_dioxide.idx];
+    const float oxy_heat = oxygen.specific_heat(*rules), pla_heat = plasma.specific_heat(*rules), tri_heat = tritium.specific_heat(*rules), co2_heat = carbon_dioxide.specific_heat(*rules);
+
+    #pragma GCC ivdep
+    for (size_t l = 0; l < batch_width; ++l) {
+        float temp = temperature[l];
+        float oxy_v = oxy[l], pla_v = pla[l];
+        float old_heat_capacity = heat_capacity_cache[l];
+
+        float temperature_scale = temp > plasma_upper_temperature ? 1.f : (temp - plasma_minimum_burn_temperature) / (plasma_upper_temperature - plasma_minimum_burn_temperature);
+        float oxygen_burn_rate = oxygen_burn_rate_base - temperature_scale;
+        float plasma_burn_rate = temperature_scale * (oxy_v > pla_v * plasma_oxygen_fullburn ? pla_v / plasma_burn_rate_delta : oxy_v / plasma_oxygen_fullburn / plasma_burn_rate_delta);
+        int burns = gate[l] && temperature_scale > 0.f && plasma_burn_rate > minimum_heat_capacity;
+
+        plasma_burn_rate = std::min(plasma_burn_rate, std::min(pla_v, oxy_v / oxygen_burn_rate));
+        float supersaturation = std::min(1.f, std::max((oxy_v / pla_v - super_saturation_ends) / (super_saturation_threshold - super_saturation_ends), 0.f));
+
+        float heat_capacity = old_heat_capacity;
+        float pla_delta = -plasma_burn_rate;
+        heat_capacity += pla_heat * pla_delta;
+        float oxy_delta = -plasma_burn_rate * oxygen_burn_rate;
+        heat_capacity += oxy_heat * oxy_delta;
+        float trit_delta = plasma_burn_rate * supersaturation;
+        heat_capacity += tri_heat * trit_delta;
+        float carbon_delta = plasma_burn_rate - trit_delta;
+        heat_capacity += co2_heat * carbon_delta;
+        float total_gas = cached_total_gas[l] + pla_delta + oxy_delta + trit_delta + carbon_delta;
+
+        pla[l] = burns ? pla_v + pla_delta : pla_v;
+        oxy[l] = burns ? oxy_v + oxy_delta : oxy_v;
+        tri[l] = burns ? tri[l] + trit_delta : tri[l];
+        co2[l] = burns ? co2[l] + carbon_delta : co2[l];
+        cached_total_gas[l] = burns ? total_gas : cached_total_gas[l];
+        heat_capacity = burns ? heat_capacity : old_heat_capacity;
+        float energy_released = burns ? fire_plasma_energy_released * plasma_burn_rate : 0.f;
+
+        int heats = gate[l] && heat_capacity > minimum_heat_capacity;
+        temperature[l] = heats ? (temp * old_heat_capacity + energy_released) / heat_capacity : temp;
+        heat_capacity_cache[l] = heat_capacity;
+        reacted[l] |= (gate[l] && energy_released > 0.f) * r_plasma_fire;
+    }
+}
+
+void gas_mixture_batch::react_tritium_fire_old(const int* gate, float* heat_capacity_cache, int* reacted) {
+    // local copies of the constants, so the compiler knows stores to the lanes can't change them
+    const float minimum_heat_capacity = rules->minimum_heat_capacity, minimum_tritium_oxyburn_energy = rules->minimum_tritium_oxyburn_energy,
+                tritium_burn_oxy_factor = rules->tritium_burn_oxy_factor, tritium_burn_trit_factor = rules->tritium_burn_trit_factor,
+                fire_hydrogen_energy_released = rules->fire_hydrogen_energy_released;
+    float* oxy = amounts[oxygen.idx];
+    float* tri = amounts[tritium.idx];
+    float* wat = amounts[water_vapour.idx];
+    const float oxy_heat = oxygen.specific_heat(*rules), tri_heat = tritium.specific_heat(*rules), wat_heat = water_vapour.specific_heat(*rules);
+
+    #pragma GCC ivdep
+    for (size_t l = 0; l < batch_width; ++l) {
+        float temp = temperature[l];
+        float oxy_v = oxy[l], tri_v = tri[l];
+        float old_heat_capacity = heat_capacity_cache[l];
+        int low_energy = oxy_v < tri_v || minimum_tritium_oxyburn_energy > temp * old_heat_capacity;
+
+        // low energy burn
+        float burned_low = std::min(tri_v, oxy_v / tritium_burn_oxy_factor);
+        float trit_delta_low = -burned_low;
+        float heat_capacity_low = old_heat_capacity + tri_heat * trit_delta_low;
+        float total_gas_low = cached_total_gas[l] + trit_delta_low;
+
+        // full burn - note the oxygen removed depends on the tritium left over
+        float burned_full = tri_v;
+        float trit_delta_full = -tri_v / tritium_burn_trit_factor;
+        float heat_capacity_full = old_heat_capacity + tri_heat * trit_delta_full;
+        float tri_full = tri_v + trit_delta_full;
+        float oxy_delta_full = -tri_full;
+        heat_capacity_full += oxy_heat * oxy_delta_full;
+        float total_gas_full = cached_total_gas[l] + trit_delta_full + oxy_delta_full;
+        float energy_full = fire_hydrogen_energy_released * burned_full * (tritium_burn_trit_factor - 1.f);
+
+        float burned_fuel = low_energy ? burned_low : burned_full;
+        float heat_capacity = low_energy ? heat_capacity_low : heat_capacity_full;
+        float total_gas = low_energy ? total_gas_low : total_gas_full;
+        float tri_new = low_energy ? tri_v + trit_delta_low : tri_full;
+        float oxy_new = low_energy ? oxy_v : oxy_v + oxy_delta_full;
+        float energy_released = low_energy ? 0.f : energy_full;
+
+        int burned = burned_fuel > 0.f;
+        energy_released = burned ? energy_released + fire_hydrogen_energy_released * burned_fuel : energy_released;
+        heat_capacity = burned ? heat_capacity + wat_heat * burned_fuel : heat_capacity;
+        total_gas = burned ? total_gas + burned_fuel : total_gas;
+        float wat_new = burned ? wat[l] + burned_fuel : wat[l];
+
+        tri[l] = gate[l] ? tri_new : tri_v;
+        oxy[l] = gate[l] ? oxy_new : oxy_v;
+        wat[l] = gate[l] ? wat_new : wat[l];
+        cached_total_gas[l] = gate[l] ? total_gas : cached_total_gas[l];
+        heat_capacity = gate[l] ? heat_capacity : old_heat_capacity;
+
+        int heats = gate[l] && heat_capacity > minimum_heat_capacity;
+        temperature[l] = heats ? (temp * old_heat_capacity + energy_released) / heat_capacity : temp;
+        heat_capacity_cache[l] = heat_capacity;
+        reacted[l] |= (gate[l] && burned) * r_tritium_fire;
+    }
+}
+
+void gas_mixture_batch::react_tritium_fire_new(const int* gate, float* heat_capacity_cache, int* reacted) {
+    // local copies of the constants, so the compiler knows stores to the lanes can't change them
+    const float minimum_heat_capacity = rules->minimum_heat_capacity, minimum_tritium_oxyburn_energy = rules->minimum_tritium_oxyburn_energy,
+                tritium_burn_oxy_factor = rules->tritium_burn_oxy_factor, tritium_burn_trit_factor = rules->tritium_burn_trit_factor,
+                fire_hydrogen_energy_released = rules->fire_hydrogen_energy_released,
+                tritium_burn_fuel_ratio = rules->tritium_burn_fuel_ratio;
+    float* oxy = amounts[oxygen.idx];
+    float* tri = amounts[tritium.idx];
+    float* wat = amounts[water_vapour.idx];
+    const float oxy_heat = oxygen.specific_heat(*rules), tri_heat = tritium.specific_heat(*rules), wat_heat = water_vapour.specific_heat(*rules);
+
+    #pragma GCC ivdep
+    for (size_t l = 0; l < batch_width; ++l) {
+        float temp = temperature[l];
+        float oxy_v = oxy[l], tri_v = tri[l];
+        float old_heat_capacity = heat_capacity_cache[l];
+        int low_energy = oxy_v < tri_v || minimum_tritium_oxyburn_energy > temp * old_heat_capacity;
+
+        // both burns consume the same gases, they only differ in how much fuel gets burned
+        float burned_low = std::min(tri_v, oxy_v / tritium_burn_oxy_factor);
+        float burned_full = std::min(tri_v, oxy_v / tritium_burn_fuel_ratio / tritium_burn_trit_factor);
+        float burned_fuel = low_energy ? burned_low : burned_full;
+
+        float heat_capacity = old_heat_capacity;
+        float trit_delta = -burned_fuel;
+        heat_capacity += tri_heat * trit_delta;
+        float oxy_delta = -burned_fuel / tritium_burn_fuel_ratio;
+        heat_capacity += oxy_heat * oxy_delta;
+        float total_gas = cached_total_gas[l] + trit_delta + oxy_delta;
+        float energy_released = low_energy ? 0.f : fire_hydrogen_energy_released * burned_fuel * (tritium_burn_trit_factor - 1.f);
+
+        int burned = burned_fuel > 0.f;
+        energy_released = burned ? energy_released + fire_hydrogen_energy_released * burned_fuel : energy_released;
+        heat_capacity = burned ? heat_capacity + wat_heat * burned_fuel : heat_capacity;
+        total_gas = burned ? total_gas + burned_fuel : total_gas;
+        float wat_new = burned ? wat[l] + burned_fuel : wat[l];
+
+        tri[l] = gate[l] ? tri_v + trit_delta : tri_v;
+        oxy[l] = gate[l] ? oxy_v + oxy_delta : oxy_v;
+        wat[l] = gate[l] ? wat_new : wat[l];
+        cached_total_gas[l] = gate[l] ? total_gas : cached_total_gas[l];
+        heat_capacity = gate[l] ? heat_capacity : old_heat_capacity;
+
+        int heats = gate[l] && heat_capacity > minimum_heat_capacity;
+        temperature[l] = heats ? (temp * old_heat_capacity + energy_released) / heat_capacity : temp;
+        heat_capacity_cache[l] = heat_capacity;
+        reacted[l] |= (gate[l] && burned) * r_tritium_fire;
+    }
+}
+
+void gas_mixture_batch::react_N2O_decomposition(const int* gate, float* heat_capacity_cache, int* reacted) {
+    // local copies of the constants, so the compiler knows stores to the lanes can't change them
+    const float N2Odecomposition_rate = rules->N2Odecomposition_rate;
+    float* oxy = amounts[oxygen.idx];
+    float* nit = amounts[nitrogen.idx];
+    float* nox = amounts[nitrous_oxide.idx];
+    const float oxy_heat = oxygen.specific_heat(*rules), nit_heat = nitrogen.specific_heat(*rules), nox_heat = nitrous_oxide.specific_heat(*rules);
+
+    #pragma GCC ivdep
+    for (size_t l = 0; l < batch_width; ++l) {
+        float burned_fuel = nox[l] * N2Odecomposition_rate;
+        float heat_capacity = heat_capacity_cache[l];
+        float nox_delta = -burned_fuel;
+        heat_capacity += nox_heat * nox_delta;
+        heat_capacity += nit_heat * burned_fuel;
+        float oxy_delta = burned_fuel * 0.5f;
+        heat_capacity += oxy_heat * oxy_delta;
+        float total_gas = cached_total_gas[l] + nox_delta + burned_fuel + oxy_delta;
+
+        // does not update temperature - this is accurate to the source
+        nox[l] = gate[l] ? nox[l] + nox_delta : nox[l];
+        nit[l] = gate[l] ? nit[l] + burned_fuel : nit[l];
+        oxy[l] = gate[l] ? oxy[l] + oxy_delta : oxy[l];
+        heat_capacity_cache[l] = gate[l] ? heat_capacity : heat_capacity_cache[l];
+        cached_total_gas[l] = gate[l] ? total_gas : cached_total_gas[l];
+        reacted[l] |= (gate[l] && burned_fuel > 0.f) * r_N2O_decomposition;
+    }
+}
+
+void gas_mixture_batch::react_frezon_production(const int* gate, float* heat_capacity_cache, int* reacted) {
+    // local copies of the constants, so the compiler knows stores to the lanes can't change them
+    const float frezon_production_max_efficiency_temperature = rules->frezon_production_max_efficiency_temperature,
+                frezon_production_nitrogen_ratio = rules->frezon_production_nitrogen_ratio,
+                frezon_production_trit_ratio = rules->frezon_production_trit_ratio,
+                frezon_production_conversion_rate = rules->frezon_production_conversion_rate;
+    float* oxy = amounts[oxygen.idx];
+    float* nit = amounts[nitrogen.idx];
+    float* tri = amounts[tritium.idx];
+    float* fre = amounts[frezon.idx];
+    const float oxy_heat = oxygen.specific_heat(*rules), nit_heat = nitrogen.specific_heat(*rules), tri_heat = tritium.specific_heat(*rules), fre_heat = frezon.specific_heat(*rules);
+
+    #pragma GCC ivdep
+    for (size_t l = 0; l < batch_width; ++l) {
+        float efficiency = temperature[l] / frezon_production_max_efficiency_temperature;
+        float loss = 1.f - efficiency;
+
+        float catalyst_limit = nit[l] * (frezon_production_nitrogen_ratio / efficiency);
+        float oxy_limit = std::min(oxy[l], catalyst_limit) / frezon_production_trit_ratio;
+
+        float trit_burned = std::min(oxy_limit, tri[l]);
+        float oxy_burned = trit_burned * frezon_production_trit_ratio;
+
+        float oxy_conversion = oxy_burned / frezon_production_conversion_rate;
+        float trit_conversion = trit_burned / frezon_production_conversion_rate;
+        float total = oxy_conversion + trit_conversion;
+
+        float heat_capacity = heat_capacity_cache[l];
+        float oxy_delta = -oxy_conversion;
+        heat_capacity += oxy_heat * oxy_delta;
+        float trit_delta = -trit_conversion;
+        heat_capacity += tri_heat * trit_delta;
+        float frezon_delta = total * efficiency;
+        heat_capacity += fre_heat * frezon_delta;
+        float nit_delta = total * loss;
+        heat_capacity += nit_heat * nit_delta;
+        float total_gas = cached_total_gas[l] + oxy_delta + trit_delta + frezon_delta + nit_delta;
+
+        oxy[l] = gate[l] ? oxy[l] + oxy_delta : oxy[l];
+        tri[l] = gate[l] ? tri[l] + trit_delta : tri[l];
+        fre[l] = gate[l] ? fre[l] + frezon_delta : fre[l];
+        nit[l] = gate[l] ? nit[l] + nit_delta : nit[l];
+        heat_capacity_cache[l] = gate[l] ? heat_capacity : heat_capacity_cache[l];
+        cached_total_gas[l] = gate[l] ? total_gas : cached_total_gas[l];
+        reacted[l] |= gate[l] * r_frezon_production;
+    }
+}
+
+void gas_mixture_batch::react_frezon_coolant(const int* gate, float* heat_capacity_cache, int* reacted) {
+    // local copies of the constants, so the compiler knows stores to the lanes can't change them
+    const float minimum_heat_capacity = rules->minimum_heat_capacity, frezon_cool_lower_temperature = rules->frezon_cool_lower_temperature,
+                frezon_cool_mid_temperature = rules->frezon_cool_mid_temperature,
+                frezon_cool_maximum_energy_modifier = rules->frezon_cool_maximum_energy_modifier,
+                frezon_cool_rate_modifier = rules->frezon_cool_rate_modifier, frezon_nitrogen_cool_ratio = rules->frezon_nitrogen_cool_ratio,
+                frezon_cool_energy_released = rules->frezon_cool_energy_released;
+    float* nit = amounts[nitrogen.idx];
+    float* fre = amounts[frezon.idx];
+    float* nox = amounts[nitrous_oxide.idx];
+    const float nit_heat = nitrogen.specific_heat(*rules), fre_heat = frezon.specific_heat(*rules), nox_heat = nitrous_oxide.specific_heat(*rules);
+
+    #pragma GCC ivdep
+    for (size_t l = 0; l < batch_width; ++l) {
+        float temp = temperature[l];
+        float old_heat_capacity = heat_capacity_cache[l];
+        float scale = (temp - frezon_cool_lower_temperature) / (frezon_cool_mid_temperature - frezon_cool_lower_temperature);
+        float energy_modifier = scale > 1.f ? std::min(scale, frezon_cool_maximum_energy_modifier) : 1.f;
+        scale = scale > 1.f ? 1.f : scale;
+
+        float burn_rate = fre[l] * scale / frezon_cool_rate_modifier;
+        int burns = gate[l] && burn_rate > minimum_heat_capacity;
+
+        float nit_delta = -std::min(burn_rate * frezon_nitrogen_cool_ratio, nit[l]);
+        float frezon_delta = -std::min(burn_rate, fre[l]);
+        float heat_capacity = old_heat_capacity;
+        heat_capacity += nit_heat * nit_delta;
+        heat_capacity += fre_heat * frezon_delta;
+        float nox_delta = -nit_delta - frezon_delta;
+        heat_capacity += nox_heat * nox_delta;
+        float total_gas = cached_total_gas[l] + nit_delta + frezon_delta + nox_delta;
+
+        nit[l] = burns ? nit[l] + nit_delta : nit[l];
+        fre[l] = burns ? fre[l] + frezon_delta : fre[l];
+        nox[l] = burns ? nox[l] + nox_delta : nox[l];
+        cached_total_gas[l] = burns ? total_gas : cached_total_gas[l];
+        heat_capacity = burns ? heat_capacity : old_heat_capacity;
+        float energy_released = burns ? burn_rate * frezon_cool_energy_released * energy_modifier : 0.f;
+
+        int heats = gate[l] && heat_capacity > minimum_heat_capacity;
+        temperature[l] = heats ? (temp * old_heat_capacity + energy_released) / heat_capacity : temp;
+        heat_capacity_cache[l] = heat_capacity;
+        reacted[l] |= (gate[l] && energy_released > 0.f) * r_frezon_coolant;
+    }
+}
+
+void gas_mixture_batch::react_nitrium_decomposition(const int* gate, float* heat_capacity_cache, int* reacted) {
+    // local copies of the constants, so the compiler knows stores to the lanes can't change them
+    const float minimum_heat_capacity = rules->minimum_heat_capacity, nitrium_decomposition_energy = rules->nitrium_decomposition_energy;
+    float* nit = amounts[nitrogen.idx];
+    float* wat = amounts[water_vapour.idx];
+    float* ntr = amounts[nitrium.idx];
+    const float nit_heat = nitrogen.specific_heat(*rules), wat_heat = water_vapour.specific_heat(*rules), ntr_heat = nitrium.specific_heat(*rules);
+
+    #pragma GCC ivdep
+    for (size_t l = 0; l < batch_width; ++l) {
+        float temp = temperature[l];
+        float efficiency = std::min(temp / 2984.f, ntr[l]);
+        int decomposes = gate[l] && !(ntr[l] - efficiency < 0.f);
+
+        float heat_capacity = heat_capacity_cache[l];
+        float ntr_delta = -efficiency;
+        heat_capacity += ntr_heat * ntr_delta;
+        heat_capacity += wat_heat * efficiency;
+        heat_capacity += nit_heat * efficiency;
+        float total_gas = cached_total_gas[l] + ntr_delta + efficiency + efficiency;
+
+        ntr[l] = decomposes ? ntr[l] + ntr_delta : ntr[l];
+        wat[l] = decomposes ? wat[l] + efficiency : wat[l];
+        nit[l] = decomposes ? nit[l] + efficiency : nit[l];
+        cached_total_gas[l] = decomposes ? total_gas : cached_total_gas[l];
+        heat_capacity = decomposes ? heat_capacity : heat_capacity_cache[l];
+
+        float energy_released = efficiency * nitrium_decomposition_energy;
+        int heats = decomposes && heat_capacity > minimum_heat_capacity;
+        temperature[l] = heats ? (temp * heat_capacity + energy_released) / heat_capacity : temp;
+        heat_capacity_cache[l] = heat_capacity;
+        reacted[l] |= (decomposes && energy_released > 0.f) * r_nitrium_decomposition;
+    }
+}
+
+/// </gas_mixture_batch>
+
+/// <gas_tank_batch>
+
+void gas_tank_batch::load(size_t lane, const gas_tank& tank) {
+    mix.load(lane, tank.mix);
+    state[lane] = tank.state;
+    integrity[lane] = tank.integrity;
+    ticks[lane] = 0;
+    active[lane] = ticks_limit > 0;
+}
+
+void gas_tank_batch::store(size_t lane, gas_tank& tank) const {
+    mix.store(lane, tank.mix);
+    tank.state = (gas_tank::tank_state)state[lane];
+    tank.integrity = integrity[lane];
+}
+
+size_t gas_tank_batch::active_count() const {
+    size_t count = 0;
+    for (size_t l = 0; l < batch_width; ++l) {
+        count += active[l];
+    }
+    return count;
+}
+
+// mirrors gas_tank::tick() and the exit conditions of gas_tank::tick_n()
+size_t gas_tank_batch::tick() {
+    // local copies of the constants, so the compiler knows stores to the lanes can't change them
+    const float tank_fragment_pressure = mix.rules->tank_fragment_pressure, tank_rupture_pressure = mix.rules->tank_rupture_pressure,
+                tank_leak_pressure = mix.rules->tank_leak_pressure;
+    alignas(64) int reacted[batch_width];
+    alignas(64) int exploding[batch_width];
+    alignas(64) int discard[batch_width];
+    alignas(64) int leaking[batch_width];
+    alignas(64) float pressure[batch_width];
+
+    mix.reaction_tick(active, reacted);
+    PROFILE {
+        for (size_t l = 0; l < batch_width; ++l) {
+            if (active[l]) profile_reactions(reacted[l]);
+        }
+    }
+    mix.pressure(pressure);
+
+    for (size_t l = 0; l < batch_width; ++l) {
+        exploding[l] = active[l] && pressure[l] > tank_fragment_pressure;
+    }
+    if (any_lane(exploding)) {
+        for (int i = 0; i < 3; ++i) {
+            mix.reaction_tick(exploding, discard);
+        }
+    }
+
+    for (size_t l = 0; l < batch_width; ++l) {
+        float p = pressure[l];
+        int integ = integrity[l];
+        bool ruptures = p > tank_rupture_pressure;
+        bool leaks = !ruptures && p > tank_leak_pressure;
+        bool calm = !ruptures && !leaks;
+
+        int new_state = exploding[l] ? gas_tank::st_exploded : ruptures && integ <= 0 ? gas_tank::st_ruptured : gas_tank::st_intact;
+        int new_integ = (ruptures || leaks) && integ > 0 ? integ - 1 : calm && integ < 3 ? integ + 1 : integ;
+        bool result = !calm || exploding[l] || reacted[l];
+
+        bool live = active[l] && !exploding[l];
+        leaking[l] = live && leaks && integ <= 0;
+        integrity[l] = live ? new_integ : integrity[l];
+        state[l] = active[l] ? new_state : state[l];
+        ticks[l] += active[l];
+        active[l] = active[l] && result && new_state == gas_tank::st_intact && ticks[l] < ticks_limit;
+    }
+
+    if (any_lane(leaking)) {
+        for (size_t i = 0; i < gas_count; ++i) {
+            for (size_t l = 0; l < batch_width; ++l) {
+                mix.amounts[i][l] = leaking[l] ? mix.amounts[i][l] * 0.75f : mix.amounts[i][l];
+            }
+        }
+        mix.refresh_cache(leaking);
+    }
+
+    return active_count();
+}
+
+void gas_tank_batch::tick_n() {
+    while (active_count() > 0) {
+        tick();
+    }
+}
+
+/// </gas_tank_batch>
+
+}
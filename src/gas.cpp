@@ -1,7 +1,12 @@
+#include <array>
+#include <cmath>
+#include <format>
+#include <limits>
 #include <map>
 #include <numeric>
 #include <stdexcept>
 #include <string>
+#include <utility>
 
 #include "gas.hpp"
 #include "utility.hpp"
@@ -37,61 +42,158 @@ std::string list_gases(std::string_view sep) {
 
 /// <gas_mixture>
 
-float gas_mixture::amount_of(gas_ref gas) const {
-    return amounts[gas.idx];
+template<gas_mask Mask>
+float gas_mixture_t<Mask>::amount_of(gas_ref gas) const {
+    return has(gas) ? amounts[slot_of(gas)] : 0.f;
 }
 
-float gas_mixture::total_gas() const {
+// cached sums drift from the real ones by rounding as gases get adjusted, allow for that
+[[maybe_unused]] static void check_cached(float cached, float computed, const char* what) {
+    if (std::abs(cached - computed) > 1e-3f * std::abs(computed) + 1e-6f) {
+        throw std::runtime_error(std::format("cached {} {} doesn't match actual {}", what, cached, computed));
+    }
+}
+
+template<gas_mask Mask>
+float gas_mixture_t<Mask>::total_gas() const {
+    CHECKCACHE {
+        check_cached(cached_total_gas, compute_total_gas(), "total gas");
+    }
+    return cached_total_gas;
+}
+
+template<gas_mask Mask>
+float gas_mixture_t<Mask>::heat_capacity() const {
+    CHECKCACHE {
+        check_cached(cached_heat_capacity, compute_heat_capacity(), "heat capacity");
+    }
+    return cached_heat_capacity;
+}
+
+template<gas_mask Mask>
+float gas_mixture_t<Mask>::compute_total_gas() const {
     return std::accumulate(std::begin(amounts), std::end(amounts), 0.f);
 }
 
-float gas_mixture::heat_capacity() const {
+template<gas_mask Mask>
+float gas_mixture_t<Mask>::compute_heat_capacity() const {
     float sum = 0.f;
-    for (size_t i = 0; i < gas_count; ++i) {
-        gas_ref gas(i);
-        sum += gas.specific_heat() * amount_of(gas);
+    for (size_t i = 0; i < slot_count; ++i) {
+        sum += gas_at(i).specific_heat(*rules) * amounts[i];
     }
     return sum;
 }
 
-float gas_mixture::heat_energy() const {
+template<gas_mask Mask>
+void gas_mixture_t<Mask>::refresh_cache() {
+    cached_total_gas = compute_total_gas();
+    cached_heat_capacity = compute_heat_capacity();
+}
+
+template<gas_mask Mask>
+float gas_mixture_t<Mask>::heat_energy() const {
     return heat_capacity() * temperature;
 }
 
-float gas_mixture::pressure() const {
+template<gas_mask Mask>
+float gas_mixture_t<Mask>::pressure() const {
     return total_gas() * temperature * rvol;
 }
 
-void gas_mixture::set_amount_of(gas_ref gas, float to) {
-    amounts[gas.idx] = to;
+// fires only ever take gas away, so pressure can only rise by the fuel heating what's left
+// bounds the energy still in the fuel and how little heat capacity what's left can have, each step uses up at least as much bound as it releases
+template<gas_mask Mask>
+float gas_mixture_t<Mask>::pressure_bound(reaction_mask reactions) const {
+    if (reactions & ~(r_plasma_fire | r_tritium_fire)) return std::numeric_limits<float>::max();
+
+    const ruleset& r = *rules;
+    float oxy = amount_of(oxygen);
+    // plasma takes at least oxygen_burn_rate_base - 1 oxygen per mol burnt, and makes up to as much tritium
+    float oxy_per_plasma = r.oxygen_burn_rate_base - 1.f;
+    float plasma_burnt = oxy_per_plasma > 0.f ? std::min(amount_of(plasma), oxy / oxy_per_plasma) : amount_of(plasma);
+    float trit_burnt = amount_of(tritium) + plasma_burnt;
+    // tritium energy in units of fire_hydrogen_energy_released
+    float trit_factor = std::max(1.f, r.tritium_burn_trit_factor);
+    float trit_energy;
+    if (r.tritium_burn_fuel_ratio > 0.f) {
+        // up to trit_factor per mol, each mol taking 1 / fuel_ratio oxygen
+        trit_energy = trit_factor * std::min(trit_burnt, oxy * r.tritium_burn_fuel_ratio);
+    } else {
+        // a hot burn releases trit_factor per mol present but only uses up 1 / trit_factor of them, taking the rest in oxygen
+        // a cold one releases 1 per mol and takes no oxygen
+        trit_energy = trit_factor * trit_factor * trit_burnt;
+        if (trit_factor > 1.f) {
+            trit_energy = std::min(trit_energy, trit_burnt + trit_factor * trit_factor / (trit_factor - 1.f) * oxy);
+        }
+    }
+    float energy = heat_energy() + std::max(0.f, r.fire_plasma_energy_released) * plasma_burnt
+                                 + std::max(0.f, r.fire_hydrogen_energy_released) * trit_energy;
+
+    // nothing burns what isn't fuel, and burnt fuel turns into fire gases with at least the lowest heat capacity of them
+    constexpr gas_mask fuel_mask = mask_of(oxygen) | mask_of(plasma) | mask_of(tritium);
+    float min_heat = std::numeric_limits<float>::max();
+    for (size_t i = 0; i < gas_count; ++i) {
+        gas_ref gas = {i};
+        if (fire_gases_mask & mask_of(gas)) min_heat = std::min(min_heat, gas.specific_heat(r));
+    }
+    float total = 0.f, kept = 0.f, kept_heat_capacity = 0.f;
+    for (size_t i = 0; i < slot_count; ++i) {
+        total += amounts[i];
+        if (fuel_mask & mask_of(gas_at(i))) continue;
+        kept += amounts[i];
+        kept_heat_capacity += gas_at(i).specific_heat(r) * amounts[i];
+    }
+    float min_heat_capacity = kept_heat_capacity + (total - kept) * min_heat;
+    if (!(min_heat_capacity > 0.f)) return 0.f;
+    // floats round differently from the maths above, leave some room for that
+    return total * energy / min_heat_capacity * rvol * 1.01f;
+}
+
+template<gas_mask Mask>
+void gas_mixture_t<Mask>::set_amount_of(gas_ref gas, float to) {
+    CHECKEXCEPT {
+        if (!has(gas)) throw std::runtime_error("gas mixture can't hold " + std::string(gas.name()));
+    }
+    amounts[slot_of(gas)] = to;
+    refresh_cache();
 }
 
-void gas_mixture::adjust_amount_of(gas_ref gas, float by) {
-    amounts[gas.idx] += by;
+template<gas_mask Mask>
+void gas_mixture_t<Mask>::adjust_amount_of(gas_ref gas, float by) {
+    CHECKEXCEPT {
+        if (!has(gas)) throw std::runtime_error("gas mixture can't hold " + std::string(gas.name()));
+    }
+    amounts[slot_of(gas)] += by;
+    cached_total_gas += by;
+    cached_heat_capacity += gas.specific_heat(*rules) * by;
 }
 
-void gas_mixture::adjust_pressure_of(gas_ref gas, float by) {
-    amounts[gas.idx] += to_mols(by, volume, temperature);
+template<gas_mask Mask>
+void gas_mixture_t<Mask>::adjust_pressure_of(gas_ref gas, float by) {
+    adjust_amount_of(gas, to_mols(by, volume, temperature, *rules));
 }
 
-void gas_mixture::canister_fill_to(gas_ref gas, float temperature, float to_pressure) {
-    gas_mixture fill_mix(volume);
+template<gas_mask Mask>
+void gas_mixture_t<Mask>::canister_fill_to(gas_ref gas, float temperature, float to_pressure) {
+    gas_mixture_t fill_mix(volume, *rules);
     fill_mix.temperature = temperature;
     fill_mix.adjust_pressure_of(gas, to_pressure - pressure());
 
     *this += fill_mix;
 }
 
-void gas_mixture::canister_fill_to(gas_ref gas, float to_pressure) {
+template<gas_mask Mask>
+void gas_mixture_t<Mask>::canister_fill_to(gas_ref gas, float to_pressure) {
     canister_fill_to(gas, temperature, to_pressure);
 }
 
-void gas_mixture::canister_fill_to(const std::vector<gas_ref>& gases, const std::vector<float>& fractions, float temperature, float to_pressure) {
+template<gas_mask Mask>
+void gas_mixture_t<Mask>::canister_fill_to(std::span<const gas_ref> gases, std::span<const float> fractions, float temperature, float to_pressure) {
     CHECKEXCEPT {
         if (gases.size() != fractions.size()) throw std::runtime_error("amount of gases not equal to amount of fractions");
         if (std::abs(std::accumulate(fractions.begin(), fractions.end(), 0.f) - 1.f) > 0.001f) throw std::runtime_error("fractions did not sum up to 1");
     }
-    gas_mixture fill_mix(volume);
+    gas_mixture_t fill_mix(volume, *rules);
     fill_mix.temperature = temperature;
     float delta_p = to_pressure - pressure();
     size_t gasc = gases.size();
@@ -102,12 +204,14 @@ void gas_mixture::canister_fill_to(const std::vector<gas_ref>& gases, const std:
     *this += fill_mix;
 }
 
-void gas_mixture::canister_fill_to(const std::vector<gas_ref>& gases, const std::vector<float>& fractions, float to_pressure) {
+template<gas_mask Mask>
+void gas_mixture_t<Mask>::canister_fill_to(std::span<const gas_ref> gases, std::span<const float> fractions, float to_pressure) {
     canister_fill_to(gases, fractions, temperature, to_pressure);
 }
 
-void gas_mixture::canister_fill_to(const std::vector<std::pair<gas_ref, float>>& gases, float temperature, float to_pressure) {
-    gas_mixture fill_mix(volume);
+template<gas_mask Mask>
+void gas_mixture_t<Mask>::canister_fill_to(const std::vector<std::pair<gas_ref, float>>& gases, float temperature, float to_pressure) {
+    gas_mixture_t fill_mix(volume, *rules);
     fill_mix.temperature = temperature;
     float delta_p = to_pressure - pressure();
     size_t gasc = gases.size();
@@ -118,25 +222,28 @@ void gas_mixture::canister_fill_to(const std::vector<std::pair<gas_ref, float>>&
     *this += fill_mix;
 }
 
-void gas_mixture::canister_fill_to(const std::vector<std::pair<gas_ref, float>>& gases, float to_pressure) {
+template<gas_mask Mask>
+void gas_mixture_t<Mask>::canister_fill_to(const std::vector<std::pair<gas_ref, float>>& gases, float to_pressure) {
     canister_fill_to(gases, temperature, to_pressure);
 }
 
-gas_mixture& gas_mixture::operator+=(const gas_mixture& rhs) {
+template<gas_mask Mask>
+gas_mixture_t<Mask>& gas_mixture_t<Mask>::operator+=(const gas_mixture_t& rhs) {
     float energy = heat_energy();
-    for (size_t i = 0; i < gas_count; ++i) {
-        gas_ref gas = {i};
-        adjust_amount_of(gas, rhs.amount_of(gas));
+    for (size_t i = 0; i < slot_count; ++i) {
+        amounts[i] += rhs.amounts[i];
     }
+    refresh_cache();
     temperature = (energy + rhs.heat_energy()) / heat_capacity();
     return *this;
 }
 
-std::string gas_mixture::to_string(char sep) const {
+template<gas_mask Mask>
+std::string gas_mixture_t<Mask>::to_string(char sep) const {
     std::string out_str;
-    for (size_t i = 0; i < gas_count; ++i) {
-        gas_ref gas = {i};
-        float amt = amount_of(gas);
+    for (size_t i = 0; i < slot_count; ++i) {
+        gas_ref gas = gas_at(i);
+        float amt = amounts[i];
         if (amt > 0.f) {
             if (!out_str.empty()) out_str += sep;
             out_str += std::string(gas.name()) + " " + std::to_string(amt) + "mol";
@@ -145,58 +252,90 @@ std::string gas_mixture::to_string(char sep) const {
     return out_str;
 }
 
+template<gas_mask Mask>
+reaction_mask gas_mixture_t<Mask>::reaction_tick() {
+    return reaction_tick_only<possible_reactions(Mask)>();
+}
+
+template<gas_mask Mask>
+typename gas_mixture_t<Mask>::reaction_tick_t gas_mixture_t<Mask>::reaction_tick_for(reaction_mask reactions) {
+    // one specialisation per reaction set, reactions impossible for our gases are always left out
+    static constexpr auto table = []<size_t... I>(std::index_sequence<I...>) {
+        return std::array<reaction_tick_t, sizeof...(I)>{&gas_mixture_t::reaction_tick_only<I & possible_reactions(Mask)>...};
+    }(std::make_index_sequence<all_reactions_mask + 1>());
+    return table[reactions & all_reactions_mask];
+}
+
 // UP TO DATE AS OF: 21.06.2025
-bool gas_mixture::reaction_tick() {
-    // calculating heat capacity is somewhat expensive, so cache it
-    float heat_capacity_cache = heat_capacity();
+template<gas_mask Mask>
+template<reaction_mask Reactions>
+reaction_mask gas_mixture_t<Mask>::reaction_tick_only() {
+    float& heat_capacity_cache = cached_heat_capacity;
     float temp = temperature; // original code caches temperature for some reason
-    bool reacted = false;
-    if (temp < frezon_production_temp && amount_of(oxygen) >= reaction_min_gas && amount_of(nitrogen) >= reaction_min_gas && amount_of(tritium) >= reaction_min_gas) {
-        reacted |= react_frezon_production(heat_capacity_cache);
+    reaction_mask reacted = 0;
+    if constexpr (Reactions & r_frezon_production) {
+        if (temp < rules->frezon_production_temp && amount_of(oxygen) >= rules->reaction_min_gas && amount_of(nitrogen) >= rules->reaction_min_gas && amount_of(tritium) >= rules->reaction_min_gas) {
+            if (react_frezon_production(heat_capacity_cache)) reacted |= r_frezon_production;
+        }
     }
-    if (temp < nitrium_decomp_temp && amount_of(oxygen) >= reaction_min_gas && amount_of(nitrium) >= reaction_min_gas) {
-        reacted |= react_nitrium_decomposition(heat_capacity_cache);
+    if constexpr (Reactions & r_nitrium_decomposition) {
+        if (temp < rules->nitrium_decomp_temp && amount_of(oxygen) >= rules->reaction_min_gas && amount_of(nitrium) >= rules->reaction_min_gas) {
+            if (react_nitrium_decomposition(heat_capacity_cache)) reacted |= r_nitrium_decomposition;
+        }
     }
-    if (temp >= frezon_cool_temp && amount_of(nitrogen) >= reaction_min_gas && amount_of(frezon) >= reaction_min_gas) {
-        reacted |= react_frezon_coolant(heat_capacity_cache);
+    if constexpr (Reactions & r_frezon_coolant) {
+        if (temp >= rules->frezon_cool_temp && amount_of(nitrogen) >= rules->reaction_min_gas && amount_of(frezon) >= rules->reaction_min_gas) {
+            if (react_frezon_coolant(heat_capacity_cache)) reacted |= r_frezon_coolant;
+        }
     }
-    if (temp >= n2o_decomp_temp && amount_of(nitrous_oxide) >= reaction_min_gas) {
-        reacted |= react_N2O_decomposition(heat_capacity_cache);
+    if constexpr (Reactions & r_N2O_decomposition) {
+        if (temp >= rules->n2o_decomp_temp && amount_of(nitrous_oxide) >= rules->reaction_min_gas) {
+            if (react_N2O_decomposition(heat_capacity_cache)) reacted |= r_N2O_decomposition;
+        }
     }
-    if (temp >= trit_fire_temp && amount_of(oxygen) >= reaction_min_gas && amount_of(tritium) >= reaction_min_gas) {
-        if (tritium_burn_fuel_ratio > 0) {
-            reacted |= react_tritium_fire_new(heat_capacity_cache);
-        } else {
-            reacted |= react_tritium_fire_old(heat_capacity_cache);
+    if constexpr (Reactions & r_tritium_fire) {
+        if (temp >= rules->trit_fire_temp && amount_of(oxygen) >= rules->reaction_min_gas && amount_of(tritium) >= rules->reaction_min_gas) {
+            if (rules->tritium_burn_fuel_ratio > 0) {
+                if (react_tritium_fire_new(heat_capacity_cache)) reacted |= r_tritium_fire;
+            } else {
+                if (react_tritium_fire_old(heat_capacity_cache)) reacted |= r_tritium_fire;
+            }
         }
     }
-    if (temp >= plasma_fire_temp && amount_of(oxygen) >= reaction_min_gas && amount_of(plasma) >= reaction_min_gas) {
-        reacted |= react_plasma_fire(heat_capacity_cache);
+    if constexpr (Reactions & r_plasma_fire) {
+        if (temp >= rules->plasma_fire_temp && amount_of(oxygen) >= rules->reaction_min_gas && amount_of(plasma) >= rules->reaction_min_gas) {
+            if (react_plasma_fire(heat_capacity_cache)) reacted |= r_plasma_fire;
+        }
     }
     return reacted;
 }
 
-void gas_mixture::adjust_gas_cached_heat(gas_ref gas, float by, float& heat_capacity_cache) {
-    heat_capacity_cache += gas.specific_heat() * by;
-    amounts[gas.idx] += by;
+template<gas_mask Mask>
+void gas_mixture_t<Mask>::adjust_gas_cached_heat(gas_ref gas, float by, float& heat_capacity_cache) {
+    // reactions we can't do still get compiled, this keeps them in bounds
+    if (!has(gas)) return;
+    heat_capacity_cache += gas.specific_heat(*rules) * by;
+    cached_total_gas += by;
+    amounts[slot_of(gas)] += by;
 }
 
 // UP TO DATE AS OF: 21.06.2025
-bool gas_mixture::react_plasma_fire(float& heat_capacity_cache) {
+template<gas_mask Mask>
+bool gas_mixture_t<Mask>::react_plasma_fire(float& heat_capacity_cache) {
     float old_heat_capacity = heat_capacity_cache;
     float energy_released = 0.f;
     float temperature_scale = 0.f;
-    if (temperature > plasma_upper_temperature) {
+    if (temperature > rules->plasma_upper_temperature) {
         temperature_scale = 1.f;
     } else {
-        temperature_scale = (temperature - plasma_minimum_burn_temperature) / (plasma_upper_temperature - plasma_minimum_burn_temperature);
+        temperature_scale = (temperature - rules->plasma_minimum_burn_temperature) / (rules->plasma_upper_temperature - rules->plasma_minimum_burn_temperature);
     }
     if (temperature_scale > 0.f) {
-        float oxygen_burn_rate = oxygen_burn_rate_base - temperature_scale;
-        float plasma_burn_rate = temperature_scale * (amount_of(oxygen) > amount_of(plasma) * plasma_oxygen_fullburn ? amount_of(plasma) / plasma_burn_rate_delta : amount_of(oxygen) / plasma_oxygen_fullburn / plasma_burn_rate_delta);
-        if (plasma_burn_rate > minimum_heat_capacity) {
+        float oxygen_burn_rate = rules->oxygen_burn_rate_base - temperature_scale;
+        float plasma_burn_rate = temperature_scale * (amount_of(oxygen) > amount_of(plasma) * rules->plasma_oxygen_fullburn ? amount_of(plasma) / rules->plasma_burn_rate_delta : amount_of(oxygen) / rules->plasma_oxygen_fullburn / rules->plasma_burn_rate_delta);
+        if (plasma_burn_rate > rules->minimum_heat_capacity) {
             plasma_burn_rate = std::min(plasma_burn_rate, std::min(amount_of(plasma), amount_of(oxygen) / oxygen_burn_rate));
-            float supersaturation = std::min(1.f, std::max((amount_of(oxygen) / amount_of(plasma) - super_saturation_ends) / (super_saturation_threshold - super_saturation_ends), 0.f));
+            float supersaturation = std::min(1.f, std::max((amount_of(oxygen) / amount_of(plasma) - rules->super_saturation_ends) / (rules->super_saturation_threshold - rules->super_saturation_ends), 0.f));
 
             adjust_gas_cached_heat(plasma, -plasma_burn_rate, heat_capacity_cache);
 
@@ -208,39 +347,40 @@ bool gas_mixture::react_plasma_fire(float& heat_capacity_cache) {
             float carbon_delta = plasma_burn_rate - trit_delta;
             adjust_gas_cached_heat(carbon_dioxide, carbon_delta, heat_capacity_cache);
 
-            energy_released += fire_plasma_energy_released * plasma_burn_rate;
+            energy_released += rules->fire_plasma_energy_released * plasma_burn_rate;
         }
     }
-    if (heat_capacity_cache > minimum_heat_capacity) {
+    if (heat_capacity_cache > rules->minimum_heat_capacity) {
         temperature = (temperature * old_heat_capacity + energy_released) / heat_capacity_cache;
     }
     return energy_released > 0.f;
 }
 
 // UP TO DATE AS OF: 21.06.2025
-bool gas_mixture::react_tritium_fire_old(float& heat_capacity_cache) {
+template<gas_mask Mask>
+bool gas_mixture_t<Mask>::react_tritium_fire_old(float& heat_capacity_cache) {
     float old_heat_capacity = heat_capacity_cache;
     float energy_released = 0.f;
     float burned_fuel = 0.f;
-    if (amount_of(oxygen) < amount_of(tritium) || minimum_tritium_oxyburn_energy > temperature * heat_capacity_cache) {
-        burned_fuel = std::min(amount_of(tritium), amount_of(oxygen) / tritium_burn_oxy_factor);
+    if (amount_of(oxygen) < amount_of(tritium) || rules->minimum_tritium_oxyburn_energy > temperature * heat_capacity_cache) {
+        burned_fuel = std::min(amount_of(tritium), amount_of(oxygen) / rules->tritium_burn_oxy_factor);
         float trit_delta = -burned_fuel;
         adjust_gas_cached_heat(tritium, trit_delta, heat_capacity_cache);
     } else {
         burned_fuel = amount_of(tritium);
-        float trit_delta = -amount_of(tritium) / tritium_burn_trit_factor;
+        float trit_delta = -amount_of(tritium) / rules->tritium_burn_trit_factor;
 
         adjust_gas_cached_heat(tritium, trit_delta, heat_capacity_cache);
         adjust_gas_cached_heat(oxygen, -amount_of(tritium), heat_capacity_cache);
 
-        energy_released += fire_hydrogen_energy_released * burned_fuel * (tritium_burn_trit_factor - 1.f);
+        energy_released += rules->fire_hydrogen_energy_released * burned_fuel * (rules->tritium_burn_trit_factor - 1.f);
     }
     if (burned_fuel > 0.f) {
-        energy_released += fire_hydrogen_energy_released * burned_fuel;
+        energy_released += rules->fire_hydrogen_energy_released * burned_fuel;
 
         adjust_gas_cached_heat(water_vapour, burned_fuel, heat_capacity_cache);
     }
-    if (heat_capacity_cache > minimum_heat_capacity) {
+    if (heat_capacity_cache > rules->minimum_heat_capacity) {
         temperature = (temperature * old_heat_capacity + energy_released) / heat_capacity_cache;
     }
     return burned_fuel > 0.f;
@@ -248,38 +388,40 @@ bool gas_mixture::react_tritium_fire_old(float& heat_capacity_cache) {
 
 // UP TO DATE AS OF: 14.02.2026
 // post https://github.com/space-wizards/space-station-14/pull/41870
-bool gas_mixture::react_tritium_fire_new(float& heat_capacity_cache) {
+template<gas_mask Mask>
+bool gas_mixture_t<Mask>::react_tritium_fire_new(float& heat_capacity_cache) {
     float old_heat_capacity = heat_capacity_cache;
     float energy_released = 0.f;
     float burned_fuel = 0.f;
 
-    if (amount_of(oxygen) < amount_of(tritium) || minimum_tritium_oxyburn_energy > temperature * heat_capacity_cache) {
-        burned_fuel = std::min(amount_of(tritium), amount_of(oxygen) / tritium_burn_oxy_factor);
+    if (amount_of(oxygen) < amount_of(tritium) || rules->minimum_tritium_oxyburn_energy > temperature * heat_capacity_cache) {
+        burned_fuel = std::min(amount_of(tritium), amount_of(oxygen) / rules->tritium_burn_oxy_factor);
         adjust_gas_cached_heat(tritium, -burned_fuel, heat_capacity_cache);
-        adjust_gas_cached_heat(oxygen, -burned_fuel / tritium_burn_fuel_ratio, heat_capacity_cache);
+        adjust_gas_cached_heat(oxygen, -burned_fuel / rules->tritium_burn_fuel_ratio, heat_capacity_cache);
     } else {
         // it was math.max in the original PR but it got fixed
-        burned_fuel = std::min(amount_of(tritium), amount_of(oxygen) / tritium_burn_fuel_ratio / tritium_burn_trit_factor);
+        burned_fuel = std::min(amount_of(tritium), amount_of(oxygen) / rules->tritium_burn_fuel_ratio / rules->tritium_burn_trit_factor);
         adjust_gas_cached_heat(tritium, -burned_fuel, heat_capacity_cache);
-        adjust_gas_cached_heat(oxygen, -burned_fuel / tritium_burn_fuel_ratio, heat_capacity_cache);
+        adjust_gas_cached_heat(oxygen, -burned_fuel / rules->tritium_burn_fuel_ratio, heat_capacity_cache);
 
-        energy_released += fire_hydrogen_energy_released * burned_fuel * (tritium_burn_trit_factor - 1.f);
+        energy_released += rules->fire_hydrogen_energy_released * burned_fuel * (rules->tritium_burn_trit_factor - 1.f);
     }
     if (burned_fuel > 0.f) {
-        energy_released += fire_hydrogen_energy_released * burned_fuel;
+        energy_released += rules->fire_hydrogen_energy_released * burned_fuel;
 
         adjust_gas_cached_heat(water_vapour, burned_fuel, heat_capacity_cache);
     }
-    if (heat_capacity_cache > minimum_heat_capacity) {
+    if (heat_capacity_cache > rules->minimum_heat_capacity) {
         temperature = (temperature * old_heat_capacity + energy_released) / heat_capacity_cache;
     }
     return burned_fuel > 0.f;
 }
 
 // UP TO DATE AS OF: 21.06.2025
-bool gas_mixture::react_N2O_decomposition(float& heat_capacity_cache) {
+template<gas_mask Mask>
+bool gas_mixture_t<Mask>::react_N2O_decomposition(float& heat_capacity_cache) {
     float n2o = amount_of(nitrous_oxide);
-    float burned_fuel = n2o * N2Odecomposition_rate;
+    float burned_fuel = n2o * rules->N2Odecomposition_rate;
     adjust_gas_cached_heat(nitrous_oxide, -burned_fuel, heat_capacity_cache);
     adjust_gas_cached_heat(nitrogen, burned_fuel, heat_capacity_cache);
     adjust_gas_cached_heat(oxygen, burned_fuel * 0.5f, heat_capacity_cache);
@@ -288,18 +430,19 @@ bool gas_mixture::react_N2O_decomposition(float& heat_capacity_cache) {
 }
 
 // UP TO DATE AS OF: 29.06.2025
-bool gas_mixture::react_frezon_production(float& heat_capacity_cache) {
-    float efficiency = temperature / frezon_production_max_efficiency_temperature;
+template<gas_mask Mask>
+bool gas_mixture_t<Mask>::react_frezon_production(float& heat_capacity_cache) {
+    float efficiency = temperature / rules->frezon_production_max_efficiency_temperature;
     float loss = 1.f - efficiency;
 
-    float catalyst_limit = amount_of(nitrogen) * (frezon_production_nitrogen_ratio / efficiency);
-    float oxy_limit = std::min(amount_of(oxygen), catalyst_limit) / frezon_production_trit_ratio;
+    float catalyst_limit = amount_of(nitrogen) * (rules->frezon_production_nitrogen_ratio / efficiency);
+    float oxy_limit = std::min(amount_of(oxygen), catalyst_limit) / rules->frezon_production_trit_ratio;
 
     float trit_burned = std::min(oxy_limit, amount_of(tritium));
-    float oxy_burned = trit_burned * frezon_production_trit_ratio;
+    float oxy_burned = trit_burned * rules->frezon_production_trit_ratio;
 
-    float oxy_conversion = oxy_burned / frezon_production_conversion_rate;
-    float trit_conversion = trit_burned / frezon_production_conversion_rate;
+    float oxy_conversion = oxy_burned / rules->frezon_production_conversion_rate;
+    float trit_conversion = trit_burned / rules->frezon_production_conversion_rate;
     float total = oxy_conversion + trit_conversion;
 
     adjust_gas_cached_heat(oxygen, -oxy_conversion, heat_capacity_cache);
@@ -311,34 +454,36 @@ bool gas_mixture::react_frezon_production(float& heat_capacity_cache) {
 }
 
 // UP TO DATE AS OF: 21.06.2025
-bool gas_mixture::react_frezon_coolant(float& heat_capacity_cache) {
+template<gas_mask Mask>
+bool gas_mixture_t<Mask>::react_frezon_coolant(float& heat_capacity_cache) {
     float old_heat_capacity = heat_capacity_cache;
     float energy_modifier = 1.f;
-    float scale = (temperature - frezon_cool_lower_temperature) / (frezon_cool_mid_temperature - frezon_cool_lower_temperature);
+    float scale = (temperature - rules->frezon_cool_lower_temperature) / (rules->frezon_cool_mid_temperature - rules->frezon_cool_lower_temperature);
     if (scale > 1.f) {
-        energy_modifier = std::min(scale, frezon_cool_maximum_energy_modifier);
+        energy_modifier = std::min(scale, rules->frezon_cool_maximum_energy_modifier);
         scale = 1.f;
     }
-    float burn_rate = amount_of(frezon) * scale / frezon_cool_rate_modifier;
+    float burn_rate = amount_of(frezon) * scale / rules->frezon_cool_rate_modifier;
     float energy_released = 0.f;
-    if (burn_rate > minimum_heat_capacity) {
-        float nit_delta = -std::min(burn_rate * frezon_nitrogen_cool_ratio, amount_of(nitrogen));
+    if (burn_rate > rules->minimum_heat_capacity) {
+        float nit_delta = -std::min(burn_rate * rules->frezon_nitrogen_cool_ratio, amount_of(nitrogen));
         float frezon_delta = -std::min(burn_rate, amount_of(frezon));
 
         adjust_gas_cached_heat(nitrogen, nit_delta, heat_capacity_cache);
         adjust_gas_cached_heat(frezon, frezon_delta, heat_capacity_cache);
         adjust_gas_cached_heat(nitrous_oxide, -nit_delta - frezon_delta, heat_capacity_cache);
 
-        energy_released = burn_rate * frezon_cool_energy_released * energy_modifier;
+        energy_released = burn_rate * rules->frezon_cool_energy_released * energy_modifier;
     }
-    if (heat_capacity_cache > minimum_heat_capacity) {
+    if (heat_capacity_cache > rules->minimum_heat_capacity) {
         temperature = (temperature * old_heat_capacity + energy_released) / heat_capacity_cache;
     }
     return energy_released > 0.f;
 }
 
 // UP TO DATE AS OF: 21.06.2025
-bool gas_mixture::react_nitrium_decomposition(float& heat_capacity_cache) {
+template<gas_mask Mask>
+bool gas_mixture_t<Mask>::react_nitrium_decomposition(float& heat_capacity_cache) {
     float efficiency = std::min(temperature / 2984.f, amount_of(nitrium));
 
     if (amount_of(nitrium) - efficiency < 0.f)
@@ -348,27 +493,31 @@ bool gas_mixture::react_nitrium_decomposition(float& heat_capacity_cache) {
     adjust_gas_cached_heat(water_vapour, efficiency, heat_capacity_cache);
     adjust_gas_cached_heat(nitrogen, efficiency, heat_capacity_cache);
 
-    float energy_released = efficiency * nitrium_decomposition_energy;
-    if (heat_capacity_cache > minimum_heat_capacity) {
+    float energy_released = efficiency * rules->nitrium_decomposition_energy;
+    if (heat_capacity_cache > rules->minimum_heat_capacity) {
         temperature = (temperature * heat_capacity_cache + energy_released) / heat_capacity_cache;
     }
     return energy_released > 0.f;
 }
 
+template struct gas_mixture_t<fire_gases_mask>;
+template struct gas_mixture_t<no_nitrium_gases_mask>;
+template struct gas_mixture_t<all_gases_mask>;
+
 /// </gas_mixture>
 
 /// <utility>
 
-float to_mols(float pressure, float volume, float temp) {
-    return pressure*volume / (R*temp);
+float to_mols(float pressure, float volume, float temp, const ruleset& rules) {
+    return pressure*volume / (rules.R*temp);
 }
 
-float to_pressure(float volume, float mols, float temp) {
-    return mols*R*temp / volume;
+float to_pressure(float volume, float mols, float temp, const ruleset& rules) {
+    return mols*rules.R*temp / volume;
 }
 
-float to_volume(float pressure, float mols, float temp) {
-    return mols*R*temp / pressure;
+float to_volume(float pressure, float mols, float temp, const ruleset& rules) {
+    return mols*rules.R*temp / pressure;
 }
 
 float to_mix_temp(float lhs_c, float lhs_n, float lhs_t, float rhs_c, float rhs_n, float rhs_t) {
@@ -376,11 +525,11 @@ float to_mix_temp(float lhs_c, float lhs_n, float lhs_t, float rhs_c, float rhs_
     return (lhs_C * lhs_t + rhs_C * rhs_t) / (lhs_C + rhs_C);
 }
 
-float get_mix_heat_capacity(const std::vector<gas_ref>& gases, const std::vector<float>& amounts) {
+float get_mix_heat_capacity(std::span<const gas_ref> gases, std::span<const float> amounts, const ruleset& rules) {
     float total_heat_cap = 0.f;
     size_t ct = gases.size();
     for(size_t i = 0; i < ct; ++i) {
-        total_heat_cap += gases[i].specific_heat() * amounts[i];
+        total_heat_cap += gases[i].specific_heat(rules) * amounts[i];
     }
     return total_heat_cap;
 }
@@ -17,6 +17,7 @@
 #include "optimiser.hpp"
 #include "gas.hpp"
 #include "sim.hpp"
+#include "sim_cache.hpp"
 #include "utility.hpp"
 
 using namespace std;
@@ -49,6 +50,7 @@ struct AtmosimState {
     int sample_rounds = 5;
     float bounds_scale = 0.5f;
     int nthreads = 1;
+    bool shade = false;
     int tick_cap = 600;
     int log_level = 2;
 
@@ -75,10 +77,10 @@ struct AtmosimState {
     std::string tol_result_log = "";
 
     AtmosimState() {
-        pressure_bounds[0] = pressure_cap;
-        pressure_bounds[1] = pressure_cap;
-        lower_target_temp = plasma_fire_temp + 0.1f;
-        tol_val = default_tol;
+        pressure_bounds[0] = default_ruleset.pressure_cap;
+        pressure_bounds[1] = default_ruleset.pressure_cap;
+        lower_target_temp = default_ruleset.plasma_fire_temp + 0.1f;
+        tol_val = default_ruleset.default_tol;
     }
 };
 
@@ -125,11 +127,13 @@ void RunOptimizationJob(AtmosimState* state) {
             upper_bounds.push_back(state->ratio_bound);
         }
 
+        sim_cache cache(1 << 16);
+
         bomb_args b_args{
             mix_g, primer_g, state->optimise_measure_before,
             state->round_pressure_to, state->round_temp_to,
             state->round_ratio_to * 0.01f, static_cast<size_t>(state->tick_cap),
-            opt_param, pre_restrictions, post_restrictions
+            opt_param, pre_restrictions, post_restrictions, &cache
         };
 
         optimiser<bomb_args, opt_val_wrap> optim(
@@ -139,6 +143,10 @@ void RunOptimizationJob(AtmosimState* state) {
         );
 
         optim.n_threads = static_cast<size_t>(state->nthreads);
+        if (state->shade) optim.de_strategy = decltype(optim)::strategy::shade;
+        optim.batch_funct = do_sim_batch;
+        optim.materialise_funct = materialise_result;
+        optim.status_funct = [&cache]{ return cache.status_str(); };
         optim.find_best();
 
         std::ostringstream oss;
@@ -146,7 +154,7 @@ void RunOptimizationJob(AtmosimState* state) {
             oss << "Best Configuration Found:\n"
                 << optim.best_result.data->print_full() << "\n\n"
                 << "Serialized string: " << optim.best_result.data->serialize() << "\n\n"
-                << default_tol << "x Tolerances:\n" << optim.best_result.data->measure_tolerances();
+                << default_ruleset.default_tol << "x Tolerances:\n" << optim.best_result.data->measure_tolerances();
         } else {
             oss << "No viable recipes found within constraints.";
         }
@@ -190,6 +198,7 @@ void RenderOptimizerTab(AtmosimState& state) {
         ImGui::InputFloat("Max Runtime (s)", &state.max_runtime, 0.5f, 1.0f, "%.1f");
         ImGui::InputInt("Sample Rounds", &state.sample_rounds);
         ImGui::InputFloat("Bounds Scale", &state.bounds_scale, 0.1f, 0.01f, "%.2f");
+        ImGui::Checkbox("Self-adaptive Search (SHADE)", &state.shade);
         #ifndef __EMSCRIPTEN__
         ImGui::InputInt("Threads", &state.nthreads);
         #endif
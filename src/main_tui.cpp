@@ -1,14 +1,22 @@
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include <argparse/args.hpp>
 #include <argparse/read.hpp>
 
+#include "batch.hpp"
+#include "cmaes.hpp"
 #include "constants.hpp"
 #include "optimiser.hpp"
 #include "gas.hpp"
+#include "profile.hpp"
 #include "sim.hpp"
+#include "sim_cache.hpp"
+#include "timeline.hpp"
+#include "trace.hpp"
 #include "utility.hpp"
 
 using namespace std;
@@ -56,7 +64,7 @@ int main(int argc, char* argv[]) {
 
     size_t log_level = 2;
 
-    enum struct work_mode {normal, mixing, full_input, tolerances};
+    enum struct work_mode {normal, mixing, full_input, tolerances, read_trace};
     work_mode mode = work_mode::normal;
 
     bool mixing_mode = false, full_input_mode = false, tolerances_mode = false;
@@ -67,8 +75,8 @@ int main(int argc, char* argv[]) {
     float mixt1 = 0.f, mixt2 = 0.f, thirt1 = 0.f, thirt2 = 0.f;
     float ratio_bound = 3.f;
     tuple<vector<float>, vector<float>> ratio_bounds;
-    float lower_target_temp = plasma_fire_temp + 0.1f;
-    float lower_pressure = pressure_cap, upper_pressure = pressure_cap;
+    float lower_target_temp = default_ruleset.plasma_fire_temp + 0.1f;
+    float lower_pressure = default_ruleset.pressure_cap, upper_pressure = default_ruleset.pressure_cap;
     bool step_target_temp = false;
     size_t tick_cap = numeric_limits<size_t>::max(); // 10 minutes
     float round_temp_to = 0.01f, round_pressure_to = 0.1f, round_ratio_to = 0.001f; // default is 0.001% to mitigate FP inaccuracy
@@ -80,8 +88,23 @@ int main(int argc, char* argv[]) {
 
     float max_runtime = 3.f;
     size_t sample_rounds = 5;
+    size_t max_samples = 0;
+    size_t seed = 0;
     float bounds_scale = 0.5f;
     size_t nthreads = 1;
+    size_t migration_spacing = 0, migrants = 2;
+    string migration_topology = "ring";
+    bool share_population = false;
+    string de_strategy = "rand1";
+    string engine = "de";
+    size_t surrogate_points = 0;
+    size_t batch_size = batch_width;
+    size_t cache_size = 1 << 16;
+    bool prune = false;
+    vector<string> config_paths;
+    string trace_path, read_trace_path, timeline_path;
+    size_t trace_length = 1024;
+    bool profile = false;
 
     std::vector<std::shared_ptr<argp::base_argument>> args = {
         argp::make_argument("ratiob", "", "set gas ratio iteration bound", ratio_bound),
@@ -90,6 +113,7 @@ int main(int argc, char* argv[]) {
         argp::make_argument("mixingmode", "m", "UTILITY TOOL: utility to find desired mixer percentage if mixing different-temperature gases", mixing_mode),
         argp::make_argument("fullinput", "f", "UTILITY TOOL: simulate and print every tick of a bomb with chosen gases", full_input_mode),
         argp::make_argument("tolerance", "", "UTILITY TOOL: measure tolerances for a bomb serialised string", tolerances_mode),
+        argp::make_argument("readtrace", "", "UTILITY TOOL: print a trace file written by --tracebest as CSV", read_trace_path),
         argp::make_argument("mixg", "mg", "list of fuel gases (usually, in tank)", mix_gases),
         argp::make_argument("primerg", "pg", "list of primer gases (usually, in canister)", primer_gases),
         argp::make_argument("mixt1", "m1", "minimum fuel mix temperature to check, Kelvin", mixt1),
@@ -111,8 +135,25 @@ int main(int argc, char* argv[]) {
         argp::make_argument("silent", "", "output ONLY the final result, overrides loglevel", silent),
         argp::make_argument("runtime", "rt", "for how long to run in seconds (default " + to_string(max_runtime) + ")", max_runtime),
         argp::make_argument("samplerounds", "sr", "how many sampling rounds to perform, multiplies runtime (default " + to_string(sample_rounds) + ")", sample_rounds),
+        argp::make_argument("samples", "", "stop after simulating this many bombs instead of after the runtime, split evenly between sample rounds and threads, 0 to disable", max_samples),
+        argp::make_argument("seed", "", "seed the optimiser so that, with --samples, the same seed always finds the same bomb; not so with --sharepop or --prune, 0 for a random seed", seed),
         argp::make_argument("boundsscale", "", "how much to scale bounds each sample round (default " + to_string(bounds_scale) + ")", bounds_scale),
-        argp::make_argument("nthreads", "j", "number of threads for the optimiser to use", nthreads)
+        argp::make_argument("nthreads", "j", "number of threads for the optimiser to use", nthreads),
+        argp::make_argument("engine", "", "optimisation engine: de, differential evolution, or cmaes, which learns how inputs correlate and restarts with more samples once it converges; options below are for de (default " + engine + ")", engine),
+        argp::make_argument("strategy", "", "how the optimiser makes new bombs from old ones: rand1, with fixed parameters, or shade, learning them as it goes (default " + de_strategy + ")", de_strategy),
+        argp::make_argument("migrate", "", "with several threads, each evolves its own population and sends its best to another every this many generations, e.g. 10, 0 to share one best between all instead (default " + to_string(migration_spacing) + ")", migration_spacing),
+        argp::make_argument("migrants", "", "how many of its best a population sends each migration (default " + to_string(migrants) + ")", migrants),
+        argp::make_argument("topology", "", "which population migrants go to: ring, the next one, or random (default " + migration_topology + ")", migration_topology),
+        argp::make_argument("sharepop", "", "with several threads, evolve one population shared by all of them instead of one each, replacing members as soon as a better trial is found", share_population),
+        argp::make_argument("surrogate", "", "model this many of each thread's last results and skip bombs it's confident are worse than what they'd replace, 0 to disable; pays off when bombs take many ticks, e.g. with a high --ticks", surrogate_points),
+        argp::make_argument("batchsize", "bs", "how many bombs each thread simulates at once, 1 to disable batching (default " + to_string(batch_size) + ")", batch_size),
+        argp::make_argument("cachesize", "cs", "how many simulated bombs to remember so repeated inputs aren't simulated again, 0 to disable (default " + to_string(cache_size) + ")", cache_size),
+        argp::make_argument("prune", "", "when maximising radius, give up simulating bombs that provably can't beat the best found so far; pays off when many bombs burn for long", prune),
+        argp::make_argument("profile", "", "once done, print where time went and how many bombs were rejected and why; needs a build with -DATMOSIM_PROFILE=ON", profile),
+        argp::make_argument("traceout", "", "record when each thread sampled, synchronised and migrated, and write it to this JSON file, open it in Perfetto or chrome://tracing", timeline_path),
+        argp::make_argument("tracebest", "", "record the ticks of every new best bomb into this trace file, read it with --readtrace", trace_path),
+        argp::make_argument("tracelength", "", "how many of its last ticks to record per traced bomb (default " + to_string(trace_length) + ")", trace_length),
+        argp::make_argument("configs", "", "list of config files to simulate every bomb under, rating it by its worst result; utility tools use the first (default: ATMOSIM_CONFIG)", config_paths)
     };
 
     argp::parse_arguments(args, argc, argv,
@@ -151,6 +192,25 @@ int main(int argc, char* argv[]) {
     if (mixing_mode) mode = work_mode::mixing;
     if (full_input_mode) mode = work_mode::full_input;
     if (tolerances_mode) mode = work_mode::tolerances;
+    if (!read_trace_path.empty()) mode = work_mode::read_trace;
+
+#ifdef ASIM_BAKED_CONFIG
+    if (!config_paths.empty()) {
+        cout << format("This build only simulates its baked config {}", baked_config_path) << endl;
+        return 1;
+    }
+#endif
+    vector<ruleset> rulesets;
+    for (const string& path : config_paths) {
+        try {
+            rulesets.push_back(ruleset::load_file(path));
+        } catch (const exception& e) {
+            cout << format("Could not load config {}: {}", path, e.what()) << endl;
+            return 1;
+        }
+    }
+    if (rulesets.empty()) rulesets.push_back(default_ruleset);
+    const ruleset& rules = rulesets.front();
 
     switch (mode) {
         case (work_mode::mixing): {
@@ -167,7 +227,7 @@ int main(int argc, char* argv[]) {
             break;
         }
         case (work_mode::full_input): {
-            gas_tank tank;
+            gas_tank tank(rules);
 
             cout << "Normal (y) or serialized (n) input [Y/n]: ";
             bool norm_input;
@@ -178,15 +238,15 @@ int main(int argc, char* argv[]) {
                 cout << "Input serialised string: ";
                 std::string str;
                 getline(cin, str);
-                bomb_data data = bomb_data::deserialize(str);
+                bomb_data data = bomb_data::deserialize(str, rules);
                 tank = data.tank;
             } else {
                 cout << "Input number of mixes (omit for 2): ";
                 int mix_c = input_or_default(2);
                 for (int i = 0; i < mix_c; ++i) {
                     cout << format("Inputting mix {}\n", i + 1);
-                    cout << format("Input pressure to fill to (omit for {}): ", pressure_cap);
-                    float pressure_to = input_or_default(pressure_cap);
+                    cout << format("Input pressure to fill to (omit for {}): ", rules.pressure_cap);
+                    float pressure_to = input_or_default(rules.pressure_cap);
                     cout << "Input temperature: ";
                     float temperature = get_input<float>();
                     vector<pair<gas_ref, float>> gases;
@@ -231,7 +291,7 @@ int main(int argc, char* argv[]) {
             cout << "Input serialised string: ";
             std::string str;
             getline(cin, str);
-            bomb_data data = bomb_data::deserialize(str);
+            bomb_data data = bomb_data::deserialize(str, rules);
             data.ticks = data.tank.tick_n(tick_cap);
             data.fin_radius = data.tank.calc_radius();
             data.fin_pressure = data.tank.mix.pressure();
@@ -240,6 +300,24 @@ int main(int argc, char* argv[]) {
             cout << "Tolerances:\n" << data.measure_tolerances(tol) << endl;
             break;
         }
+        case (work_mode::read_trace): {
+            ifstream in(read_trace_path, ios::binary);
+            if (!in) {
+                cout << format("Could not open {}", read_trace_path) << endl;
+                return 1;
+            }
+            tick_trace trace(1);
+            string label;
+            try {
+                while (trace.read(in, label)) {
+                    cout << format("# {}\n{}", label, trace.to_csv()) << endl;
+                }
+            } catch (const exception& e) {
+                cout << format("Could not read {}: {}", read_trace_path, e.what()) << endl;
+                return 1;
+            }
+            break;
+        }
         default: {
             break;
         }
@@ -291,34 +369,168 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    optimiser<bomb_args, opt_val_wrap>
-    optim(do_sim,
-          lower_bounds,
-          upper_bounds,
-          optimise_maximise,                                                                   // convert percentage to fraction
-          {mix_gases, primer_gases, optimise_measure_before, round_pressure_to, round_temp_to, round_ratio_to * 0.01f, tick_cap, opt_param, pre_restrictions, post_restrictions},
-          as_seconds(max_runtime),
-          sample_rounds,
-          bounds_scale,
-          log_level);
-    optim.n_threads = nthreads;
-
-    optim.find_best();
-
-    const opt_val_wrap& best_res = optim.best_result;
+    // results depend on the rules, so each ruleset gets its own cache
+    vector<unique_ptr<sim_cache>> caches;
+    // a bomb's worst result across rulesets is under its result in each, so one best to beat works for all of them
+    radius_to_beat to_beat;
+    bool pruning = prune && optimise_maximise && !optimise_measure_before && opt_param.offset == bomb_data::radius_field.offset;
+    multi_bomb_args sim_args{{}, optimise_maximise};
+    for (const ruleset& r : rulesets) {
+        caches.push_back(cache_size > 0 ? make_unique<sim_cache>(cache_size) : nullptr);
+        sim_args.per_ruleset.push_back({mix_gases, primer_gases, optimise_measure_before, round_pressure_to, round_temp_to, round_ratio_to * 0.01f, // convert percentage to fraction
+                                        tick_cap, opt_param, pre_restrictions, post_restrictions, caches.back().get(), &r,
+                                        pruning ? &to_beat : nullptr});
+    }
+
+    if (!sim_args.per_ruleset.front().satisfiable) {
+        cout << "No bomb can meet the given restrictions, check their ranges and the tick limit" << endl;
+        return 1;
+    }
+
+    if (engine != "de" && engine != "cmaes") {
+        cout << format("Unknown engine {}, expected de or cmaes", engine) << endl;
+        return 1;
+    }
+    if constexpr (!profiling_enabled) {
+        if (profile) cout << "--profile needs a build with -DATMOSIM_PROFILE=ON, running without it" << endl;
+    }
+
+    ofstream trace_file;
+    mutex trace_mutex;
+    if (!trace_path.empty()) {
+        trace_file.open(trace_path, ios::binary);
+        if (!trace_file) {
+            cout << format("Could not open {}", trace_path) << endl;
+            return 1;
+        }
+    }
+
+    ofstream timeline_file;
+    if (!timeline_path.empty()) {
+        timeline_file.open(timeline_path);
+        if (!timeline_file) {
+            cout << format("Could not open {}", timeline_path) << endl;
+            return 1;
+        }
+        timeline_thread_name("main");
+        timeline_start();
+    }
+
+    // what both engines take
+    auto configure = [&](auto& optim) {
+        optim.n_threads = nthreads;
+        optim.max_samples = max_samples;
+        optim.print_profile = profile;
+        if (seed != 0) optim.seed = seed;
+        if (batch_size > 1) {
+            optim.batch_funct = do_sim_multi_batch;
+        }
+        optim.materialise_funct = materialise_multi;
+        if (trace_file.is_open()) {
+            // bests are materialised as they're found, so trace them then, simulating again from the serialised bomb
+            optim.materialise_funct = [&](const vector<float>& in_args, const multi_bomb_args& args, opt_val_wrap& res) {
+                const bomb_args& used = materialise_multi(in_args, args, res);
+                if (!res.data) return;
+                string serialized = res.data->serialize();
+                tick_trace trace(trace_length);
+                trace_bomb(serialized, used, trace);
+                lock_guard lock(trace_mutex);
+                trace.write(trace_file, serialized);
+            };
+        }
+        if (pruning) {
+            optim.best_funct = [&to_beat](const opt_val_wrap& res){ to_beat.offer(res.res.fin_radius); };
+        }
+        if (cache_size > 0 || pruning) {
+            optim.status_funct = [&]{
+                string status = cache_size > 0 ? caches.front()->status_str() : "";
+                if (pruning) status += format("{}given up on: {}", cache_size > 0 ? ", " : "", to_beat.dominated.load());
+                return status;
+            };
+        }
+    };
+
+    vector<float> best_arg;
+    opt_val_wrap best_res;
+    if (engine == "cmaes") {
+        cmaes<multi_bomb_args, opt_val_wrap>
+        optim(do_sim_multi,
+              lower_bounds,
+              upper_bounds,
+              optimise_maximise,
+              sim_args,
+              as_seconds(max_runtime),
+              log_level);
+        configure(optim);
+
+        optim.find_best();
+        best_arg = optim.best_arg;
+        best_res = optim.best_result;
+    } else {
+        optimiser<multi_bomb_args, opt_val_wrap>
+        optim(do_sim_multi,
+              lower_bounds,
+              upper_bounds,
+              optimise_maximise,
+              sim_args,
+              as_seconds(max_runtime),
+              sample_rounds,
+              bounds_scale,
+              log_level);
+        configure(optim);
+        optim.batch_size = batch_size;
+        optim.migration_spacing = migration_spacing;
+        optim.migrants = migrants;
+        optim.share_population = share_population;
+        optim.surrogate_points = surrogate_points;
+        if (de_strategy == "shade") {
+            optim.de_strategy = decltype(optim)::strategy::shade;
+        } else if (de_strategy != "rand1") {
+            cout << format("Unknown strategy {}, expected rand1 or shade", de_strategy) << endl;
+            return 1;
+        }
+        if (migration_topology == "random") {
+            optim.migration_topology = decltype(optim)::topology::random;
+        } else if (migration_topology != "ring") {
+            cout << format("Unknown migration topology {}, expected ring or random", migration_topology) << endl;
+            return 1;
+        }
+
+        optim.find_best();
+        best_arg = optim.best_arg;
+        best_res = optim.best_result;
+    }
+
     cout.clear();
     if (best_res.data != nullptr) {
         cout << (simple_output ? "" : "\nBest:\n") << (simple_output ? best_res.data->print_very_simple() : best_res.data->print_full()) << endl;
         if (!simple_output) {
             cout << "\nSerialized string: " << best_res.data->serialize() << endl;
         }
-        cout << default_tol << "x tolerances:\n" << best_res.data->measure_tolerances() << endl;
+        if (rulesets.size() > 1 && !simple_output) {
+            cout << "\nPer config:\n";
+            for (size_t i = 0; i < rulesets.size(); ++i) {
+                opt_val_wrap res = do_sim(best_arg, sim_args.per_ruleset[i]);
+                materialise_result(best_arg, sim_args.per_ruleset[i], res);
+                cout << config_paths[i] << ": " << res.rating_str() << endl;
+            }
+        }
+        string tolerances;
+        {
+            timeline_span span("tolerances");
+            tolerances = best_res.data->measure_tolerances(rules.default_tol);
+        }
+        cout << rules.default_tol << "x tolerances:\n" << tolerances << endl;
     } else {
         cout << "No viable recipes found." << endl;
     }
     if (silent) {
         cout.setstate(ios::failbit);
     }
+    if (timeline_file.is_open()) {
+        timeline_stop();
+        timeline_write(timeline_file);
+    }
 
     return 0;
 }
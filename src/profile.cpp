@@ -0,0 +1,100 @@
+#include <format>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "profile.hpp"
+
+namespace asim {
+
+// every thread's counters, kept after their thread exits so its work still shows up in the report
+static std::mutex profile_registry_mutex;
+static std::vector<std::shared_ptr<profile_data>> profile_registry;
+
+profile_data& profile_data::operator+=(const profile_data& other) {
+    for (size_t i = 0; i < profile_phase_count; ++i) {
+        calls[i] += other.calls[i];
+        cycles[i] += other.cycles[i];
+    }
+    for (size_t i = 0; i < profile_event_count; ++i) events[i] += other.events[i];
+    for (size_t i = 0; i < profile_tick_buckets; ++i) ticks[i] += other.ticks[i];
+    for (size_t i = 0; i < profile_reaction_buckets; ++i) reactions[i] += other.reactions[i];
+    return *this;
+}
+
+profile_data& profile_local() {
+    thread_local std::shared_ptr<profile_data> local = []{
+        auto data = std::make_shared<profile_data>();
+        std::lock_guard lock(profile_registry_mutex);
+        profile_registry.push_back(data);
+        return data;
+    }();
+    return *local;
+}
+
+profile_data profile_merged() {
+    profile_data out;
+    std::lock_guard lock(profile_registry_mutex);
+    for (const std::shared_ptr<profile_data>& data : profile_registry) out += *data;
+    return out;
+}
+
+void profile_reset() {
+    std::lock_guard lock(profile_registry_mutex);
+    // drop the ones whose thread exited
+    std::erase_if(profile_registry, [](const std::shared_ptr<profile_data>& data) { return data.use_count() == 1; });
+    for (std::shared_ptr<profile_data>& data : profile_registry) *data = {};
+}
+
+static const char* const phase_names[profile_phase_count] = {
+    "trial", "evaluate", "select", "  read inputs", "  cache lookup", "  fill tank", "  restrictions", "  tick"
+};
+static const char* const event_names[profile_event_count] = {
+    "rejected: temperature order", "rejected: fuel pressure", "rejected: pre-restrictions", "failed post-restrictions",
+    "cache hits", "given up", "simulated"
+};
+
+// one line per nonzero bucket, with a bar scaled to the biggest
+static std::string histogram(const uint64_t* counts, size_t buckets, auto&& label) {
+    uint64_t most = *std::max_element(counts, counts + buckets);
+    std::string out;
+    for (size_t i = 0; i < buckets; ++i) {
+        if (counts[i] == 0) continue;
+        out += std::format("  {:>14} {:>12} {}\n", label(i), counts[i], std::string((counts[i] * 40 + most - 1) / most, '#'));
+    }
+    return out;
+}
+
+std::string profile_report() {
+    profile_data data = profile_merged();
+    // shares are of the sampler's own phases, which the sim ones are part of
+    uint64_t total = data.cycles[(size_t)profile_phase::trial] + data.cycles[(size_t)profile_phase::evaluate]
+                   + data.cycles[(size_t)profile_phase::select];
+#if defined(__x86_64__) || defined(__i386__)
+    const char* unit = "cycles";
+#else
+    const char* unit = "ns";
+#endif
+
+    std::string out = std::format("Profile, summed over threads:\n  {:<16} {:>12} {:>14} {:>8}\n", "phase", "calls", std::format("{}/call", unit), "share");
+    for (size_t i = 0; i < profile_phase_count; ++i) {
+        uint64_t calls = data.calls[i];
+        out += std::format("  {:<16} {:>12} {:>14.0f} {:>7.1f}%\n", phase_names[i], calls,
+                           calls ? (double)data.cycles[i] / calls : 0.0, total ? 100.0 * data.cycles[i] / total : 0.0);
+    }
+    out += "Events:\n";
+    for (size_t i = 0; i < profile_event_count; ++i) {
+        out += std::format("  {:<28} {:>12}\n", event_names[i], data.events[i]);
+    }
+    out += "Ticks per simulated bomb:\n";
+    out += histogram(data.ticks, profile_tick_buckets, [](size_t i) {
+        if (i < 2) return std::to_string(i);
+        if (i == profile_tick_buckets - 1) return std::format("{}+", (size_t)1 << (i - 1));
+        return std::format("{}-{}", (size_t)1 << (i - 1), ((size_t)1 << i) - 1);
+    });
+    out += "Reactions per tick:\n";
+    out += histogram(data.reactions, profile_reaction_buckets, [](size_t i) { return std::to_string(i); });
+    return out;
+}
+
+}
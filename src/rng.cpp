@@ -0,0 +1,46 @@
+#include <random>
+
+#include "rng.hpp"
+
+namespace asim {
+
+xoshiro256ss::xoshiro256ss(uint64_t seed) {
+    this->seed(seed);
+}
+
+void xoshiro256ss::seed(uint64_t seed) {
+    // splitmix64, never leaves the state all zero
+    for (uint64_t& w : s) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        w = z ^ (z >> 31);
+    }
+}
+
+xoshiro256ss xoshiro256ss::random() {
+    std::random_device rd;
+    return xoshiro256ss(((uint64_t)rd() << 32) | rd());
+}
+
+void xoshiro256ss::jump() {
+    static constexpr uint64_t poly[] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+    uint64_t t[4] = {0, 0, 0, 0};
+    for (uint64_t word : poly) {
+        for (int b = 0; b < 64; ++b) {
+            if (word & ((uint64_t)1 << b)) {
+                for (int i = 0; i < 4; ++i) t[i] ^= s[i];
+            }
+            operator()();
+        }
+    }
+    for (int i = 0; i < 4; ++i) s[i] = t[i];
+}
+
+xoshiro256ss xoshiro256ss::split() {
+    xoshiro256ss out = *this;
+    jump();
+    return out;
+}
+
+}
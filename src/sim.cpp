@@ -1,25 +1,43 @@
 #include <algorithm>
 #include <cmath>
 #include <memory>
+#include <optional>
 
 #include "sim.hpp"
+#include "batch.hpp"
 #include "constants.hpp"
 #include "gas.hpp"
+#include "profile.hpp"
+#include "sim_cache.hpp"
 #include "utility.hpp"
 
 namespace asim {
 
-void bomb_data::sim_ticks(size_t up_to, field_ref<bomb_data> optstat_ref, bool measure_pre) {
+bool bomb_data::sim_ticks(size_t up_to, field_ref<bomb_data> optstat_ref, bool measure_pre, gas_mask gases, reaction_mask reactions, float give_up_under) {
+    begin_sim(optstat_ref, measure_pre);
+    profile_count(profile_event::simulated);
+    size_t sim_ticks;
+    {
+        profile_scope scope(profile_phase::sim_tick);
+        sim_ticks = tick_n_subset(tank, up_to, gases, reactions, give_up_under);
+    }
+    if (sim_ticks == gas_tank::gave_up) return false;
+    profile_ticks(sim_ticks);
+    finish_sim(sim_ticks, optstat_ref, measure_pre);
+    return true;
+}
+
+void bomb_data::begin_sim(field_ref<bomb_data> optstat_ref, bool measure_pre) {
     if (measure_pre) {
         fin_pressure = tank.mix.pressure();
         optstat = optstat_ref.get(*this);
     }
+}
 
-    size_t a_ticks = tank.tick_n(up_to);
-
-    ticks = a_ticks;
+void bomb_data::finish_sim(size_t sim_ticks, field_ref<bomb_data> optstat_ref, bool measure_pre) {
+    ticks = sim_ticks;
     fin_pressure = tank.mix.pressure();
-    fin_radius = gas_tank::calc_radius(fin_pressure);
+    fin_radius = gas_tank::calc_radius(fin_pressure, *tank.mix.rules);
 
     if (!measure_pre)
         optstat = optstat_ref.get(*this);
@@ -61,7 +79,7 @@ std::string bomb_data::serialize() const {
     return out_str;
 }
 
-bomb_data bomb_data::deserialize(std::string_view str) {
+bomb_data bomb_data::deserialize(std::string_view str, const ruleset& rules) {
     std::map<std::string, std::string> kv_pairs;
     size_t start = 0;
     // parse k=v into map
@@ -84,7 +102,7 @@ bomb_data bomb_data::deserialize(std::string_view str) {
     auto primer_gases = argp::parse_value<std::vector<std::pair<gas_ref, float>>>(kv_pairs["pm"]);
 
     // try to reconstruct the tank
-    gas_tank tank;
+    gas_tank tank(rules);
     tank.mix.canister_fill_to(mix_gases, fuel_temp, fuel_pressure);
     tank.mix.canister_fill_to(primer_gases, thir_temp, to_pressure);
 
@@ -128,7 +146,7 @@ std::string bomb_data::measure_tolerances(float min_ratio) const {
         if (*std::min_element(d_copy.mix_ratios.begin(), d_copy.mix_ratios.end()) < 0.f) return false;
         if (*std::min_element(d_copy.primer_ratios.begin(), d_copy.primer_ratios.end()) < 0.f) return false;
         if (d_copy.fuel_temp < 0.f || d_copy.fuel_pressure < 0.f || d_copy.thir_temp < 0.f || d_copy.to_pressure < 0.f) return false;
-        gas_tank tank;
+        gas_tank tank(*d_copy.tank.mix.rules);
         tank.mix.canister_fill_to(d_copy.mix_gases, get_fractions(d_copy.mix_ratios), d_copy.fuel_temp, d_copy.fuel_pressure);
         tank.mix.canister_fill_to(d_copy.primer_gases, get_fractions(d_copy.primer_ratios), d_copy.thir_temp, d_copy.to_pressure);
         size_t c_ticks = tank.tick_n(ticks / min_ratio);
@@ -209,7 +227,7 @@ std::string bomb_data::print_inline() const {
     float required_primer_p = to_pressure + (to_pressure - fuel_pressure);
 
     out_str += std::format("S: [ time {:.1f}s | radius {:.2f}til | optstat {} ] ",
-                           ticks * tickrate, fin_radius, optstat);
+                           ticks * tank.mix.rules->tickrate, fin_radius, optstat);
     out_str += std::format("M: [ {} | {:.{}f}K | {:.{}f}kPa ] ",
                            mix_string(mix_gases, mix_fractions), fuel_temp, temp_round_digs, fuel_pressure, pressure_round_digs);
     out_str += std::format("C: [ {} | {:.{}f}K | {:.{}f}kPa | >{}kPa ]",
@@ -228,14 +246,15 @@ std::string bomb_data::print_full() const {
     size_t mix_c = mix_gases.size(), primer_c = primer_gases.size(), total_c = mix_c + primer_gases.size();
 
     std::vector<std::pair<float, std::string>> min_amounts(mix_gases.size() + primer_gases.size());
+    const float required_transfer_volume = tank.mix.rules->required_transfer_volume;
     float required_volume = (required_transfer_volume + tank.mix.volume);
     for (size_t i = 0; i < mix_c; ++i) {
-        min_amounts[i] = {to_mols(mix_fractions[i] * fuel_pressure, required_volume, fuel_temp), (std::string)mix_gases[i].name()};
+        min_amounts[i] = {to_mols(mix_fractions[i] * fuel_pressure, required_volume, fuel_temp, *tank.mix.rules), (std::string)mix_gases[i].name()};
     }
     float required_primer_p = to_pressure + (to_pressure - fuel_pressure);
     required_primer_p *= required_volume / required_transfer_volume;
     for (size_t i = 0; i < primer_c; ++i) {
-        min_amounts[i + mix_c] = {to_mols(primer_fractions[i] * required_primer_p, required_volume, thir_temp), (std::string)primer_gases[i].name()};
+        min_amounts[i + mix_c] = {to_mols(primer_fractions[i] * required_primer_p, required_volume, thir_temp, *tank.mix.rules), (std::string)primer_gases[i].name()};
     }
     std::string req_str;
     for (size_t i = 0; i < total_c; ++i) {
@@ -244,7 +263,7 @@ std::string bomb_data::print_full() const {
     }
 
     out_str += std::format("STATS: [ time {:.1f}s | radius {:.2f}til | optstat {} ]\n",
-                           ticks * tickrate, fin_radius, optstat);
+                           ticks * tank.mix.rules->tickrate, fin_radius, optstat);
     out_str += std::format("MIX:   [ {} | {:.{}f}K | {:.{}f}kPa ]\n",
                            mix_string(mix_gases, mix_fractions), fuel_temp, temp_round_digs, fuel_pressure, pressure_round_digs);
     out_str += std::format("CAN:   [ {} | {:.{}f}K | release {:.{}f}kPa | >{:.0f}kPa ]\n",
@@ -280,7 +299,49 @@ std::istream& operator>>(std::istream& stream, field_ref<bomb_data>& re) {
     return stream;
 }
 
-opt_val_wrap do_sim(const std::vector<float>& in_args, const bomb_args& args) {
+// rounded inputs of a bomb, everything needed to set it up
+// fixed-size so reading inputs doesn't allocate
+struct bomb_inputs {
+    float target_temp, fuel_temp, thir_temp, fill_pressure;
+    float mix_fractions[gas_count], primer_fractions[gas_count];
+    size_t mix_count, primer_count;
+
+    std::span<const float> mix() const {
+        return {mix_fractions, mix_count};
+    }
+    std::span<const float> primer() const {
+        return {primer_fractions, primer_count};
+    }
+
+    sim_key key(const bomb_args& args) const {
+        sim_key k(args.mix_gases, args.primer_gases);
+        k.push(target_temp);
+        k.push(fuel_temp);
+        k.push(thir_temp);
+        k.push(fill_pressure);
+        for (float f : mix()) k.push(f);
+        for (float f : primer()) k.push(f);
+        return k;
+    }
+};
+
+// turns ratios into fractions rounded to round_ratio_to, in place
+// same arithmetic as get_fractions() followed by rounding and renormalising
+static void to_rounded_fractions(float* ratios, size_t count, float round_ratio_to) {
+    float i_total = 1.f / std::accumulate(ratios, ratios + count, 0.f);
+    for (size_t i = 0; i < count; ++i) {
+        ratios[i] = round_to(ratios[i] * i_total, round_ratio_to);
+    }
+    float i_rounded_total = 1.f / std::accumulate(ratios, ratios + count, 0.f);
+    for (size_t i = 0; i < count; ++i) {
+        ratios[i] *= i_rounded_total;
+    }
+}
+
+// reads and rounds in_args
+// returns: false if in_args do not describe a valid bomb
+static bool read_inputs(const std::vector<float>& in_args, const bomb_args& args, bomb_inputs& out) {
+    profile_scope scope(profile_phase::sim_read);
     // read input parameters
     float target_temp = in_args[0];
     float fuel_temp = in_args[1];
@@ -290,69 +351,332 @@ opt_val_wrap do_sim(const std::vector<float>& in_args, const bomb_args& args) {
     fuel_temp = round_to(fuel_temp, args.round_temp_to);
     thir_temp = round_to(thir_temp, args.round_temp_to);
     // only round fill pressure if it's not too close to pressure cap
+    const float pressure_cap = args.rules->pressure_cap;
     if (std::abs(fill_pressure - pressure_cap) > args.round_pressure_to * 2.f) {
         fill_pressure = std::min(pressure_cap, round_to(fill_pressure, args.round_pressure_to));
     }
     // invalid mix, abort early
     if ((target_temp > fuel_temp) == (target_temp > thir_temp)) {
-        return {};
+        profile_count(profile_event::rejected_order);
+        return false;
     }
-    const std::vector<gas_ref>& mix_gases = args.mix_gases;
-    const std::vector<gas_ref>& primer_gases = args.primer_gases;
-    bool measure_before = args.measure_before;
-    size_t tick_cap = args.tick_cap;
-    field_ref<bomb_data> optstat_ref = args.opt_param;
-    const std::vector<field_restriction<bomb_data>>& pre_restrictions = args.pre_restrictions;
-    const std::vector<field_restriction<bomb_data>>& post_restrictions = args.post_restrictions;
+    out.target_temp = target_temp;
+    out.fuel_temp = fuel_temp;
+    out.thir_temp = thir_temp;
+    out.fill_pressure = fill_pressure;
 
     // read gas ratios
-    std::vector<float> mix_ratios(mix_gases.size(), 1.f);
-    std::vector<float> primer_ratios(primer_gases.size(), 1.f);
-    size_t mg_s = mix_gases.size() - 1;
-    size_t pg_s = primer_gases.size() - 1;
-    for (size_t i = 0; i < mg_s; ++i) {
-        mix_ratios[i + 1] = std::exp(in_args[4 + i]);
+    size_t mg_s = args.mix_gases.size();
+    size_t pg_s = args.primer_gases.size();
+    CHECKEXCEPT {
+        if (mg_s > gas_count || pg_s > gas_count) throw std::runtime_error("more gases in mix than there are gas types");
     }
-    for (size_t i = 0; i < pg_s; ++i) {
-        primer_ratios[i + 1] = std::exp(in_args[4 + mg_s + i]);
+    out.mix_count = mg_s;
+    out.primer_count = pg_s;
+    out.mix_fractions[0] = 1.f;
+    out.primer_fractions[0] = 1.f;
+    for (size_t i = 1; i < mg_s; ++i) {
+        out.mix_fractions[i] = std::exp(in_args[3 + i]);
+    }
+    for (size_t i = 1; i < pg_s; ++i) {
+        out.primer_fractions[i] = std::exp(in_args[3 + mg_s + i - 1]);
     }
 
-    std::vector<float> mix_fractions = get_fractions(mix_ratios);
-    for (float& f : mix_fractions) f = round_to(f, args.round_ratio_to);
-    mix_fractions *= 1.f / std::accumulate(mix_fractions.begin(), mix_fractions.end(), 0.f);
-    std::vector<float> primer_fractions = get_fractions(primer_ratios);
-    for (float& f : primer_fractions) f = round_to(f, args.round_ratio_to);
-    primer_fractions *= 1.f / std::accumulate(primer_fractions.begin(), primer_fractions.end(), 0.f);
-
-    // set up the tank
-    gas_tank mix_tank;
+    to_rounded_fractions(out.mix_fractions, mg_s, args.round_ratio_to);
+    to_rounded_fractions(out.primer_fractions, pg_s, args.round_ratio_to);
+    return true;
+}
 
+// fills the tank described by in
+// returns: false if in does not describe a valid bomb
+static bool fill_tank(const bomb_inputs& in, const bomb_args& args, gas_tank& tank, float& fuel_pressure) {
+    profile_scope scope(profile_phase::sim_fill);
     // specific heat is heat capacity of 1mol and fractions sum up to 1mol
-    float fuel_specheat = get_mix_heat_capacity(mix_gases, mix_fractions);
-    float primer_specheat = get_mix_heat_capacity(primer_gases, primer_fractions);
+    float fuel_specheat = get_mix_heat_capacity(args.mix_gases, in.mix(), *args.rules);
+    float primer_specheat = get_mix_heat_capacity(args.primer_gases, in.primer(), *args.rules);
     // to how much we want to fill the tank
-    float fuel_pressure = (target_temp / thir_temp - 1.f) * fill_pressure / (fuel_specheat / primer_specheat - 1.f + target_temp * (1.f / thir_temp - fuel_specheat / primer_specheat / fuel_temp));
+    fuel_pressure = (in.target_temp / in.thir_temp - 1.f) * in.fill_pressure / (fuel_specheat / primer_specheat - 1.f + in.target_temp * (1.f / in.thir_temp - fuel_specheat / primer_specheat / in.fuel_temp));
     fuel_pressure = round_to(fuel_pressure, args.round_pressure_to);
-    mix_tank.mix.canister_fill_to(mix_gases, mix_fractions, fuel_temp, fuel_pressure);
-    mix_tank.mix.canister_fill_to(primer_gases, primer_fractions, thir_temp, fill_pressure);
+    tank.mix.canister_fill_to(args.mix_gases, in.mix(), in.fuel_temp, fuel_pressure);
+    tank.mix.canister_fill_to(args.primer_gases, in.primer(), in.thir_temp, in.fill_pressure);
 
     // invalid mix, abort
-    if (fuel_pressure > fill_pressure || fuel_pressure < 0.0) {
+    bool valid = !(fuel_pressure > in.fill_pressure || fuel_pressure < 0.0);
+    if (!valid) profile_count(profile_event::rejected_pressure);
+    return valid;
+}
+
+// full: also fill in the mix description, which allocates and is only needed for printing
+static bomb_data make_bomb(const bomb_inputs& in, const bomb_args& args, const gas_tank& tank, float fuel_pressure, bool full) {
+    static const std::vector<gas_ref> no_gases;
+    return bomb_data(full ? std::vector<float>(in.mix().begin(), in.mix().end()) : std::vector<float>(),
+                     full ? std::vector<float>(in.primer().begin(), in.primer().end()) : std::vector<float>(),
+                     in.fill_pressure, in.fuel_temp, fuel_pressure, in.thir_temp, in.target_temp,
+                     full ? args.mix_gases : no_gases, full ? args.primer_gases : no_gases,
+                     tank, args.round_pressure_to, args.round_temp_to, args.round_ratio_to);
+}
+
+static bool restrictions_met(const std::vector<field_restriction<bomb_data>>& restrictions, const bomb_data& bomb) {
+    profile_scope scope(profile_phase::sim_restrict);
+    return std::none_of(restrictions.begin(), restrictions.end(), [&bomb](const auto& r){ return !r.OK(bomb); });
+}
+
+bool restrictions_satisfiable(const std::vector<field_restriction<bomb_data>>& pre_restrictions,
+                              const std::vector<field_restriction<bomb_data>>& post_restrictions, size_t tick_cap) {
+    auto empty = [](const field_restriction<bomb_data>& r){ return r.min_v > r.max_v; };
+    if (std::any_of(pre_restrictions.begin(), pre_restrictions.end(), empty)) return false;
+    if (std::any_of(post_restrictions.begin(), post_restrictions.end(), empty)) return false;
+    return std::none_of(post_restrictions.begin(), post_restrictions.end(), [tick_cap](const auto& r) {
+        return r.field.offset == bomb_data::ticks_field.offset && r.min_v > (float)tick_cap;
+    });
+}
+
+size_t restricted_tick_limit(const std::vector<field_restriction<bomb_data>>& post_restrictions, size_t tick_cap) {
+    size_t limit = tick_cap;
+    for (const field_restriction<bomb_data>& r : post_restrictions) {
+        if (r.field.offset != bomb_data::ticks_field.offset || r.max_v >= (float)limit) continue;
+        // simulate one tick past the bound, so bombs that need more still come out invalid
+        limit = r.max_v < 0.f ? 0 : (size_t)r.max_v + 1;
+    }
+    return limit;
+}
+
+float restricted_min_pressure(const std::vector<field_restriction<bomb_data>>& post_restrictions, const ruleset& rules) {
+    float pressure = 0.f;
+    for (const field_restriction<bomb_data>& r : post_restrictions) {
+        if (r.field.offset != bomb_data::radius_field.offset || r.min_v <= 0.f) continue;
+        // the inverse of gas_tank::calc_radius(), like radius_to_beat::pressure()
+        pressure = std::max(pressure, rules.tank_fragment_pressure + rules.tank_fragment_scale * r.min_v * r.min_v);
+    }
+    return pressure;
+}
+
+void radius_to_beat::offer(float new_radius) {
+    float cur = radius;
+    while (new_radius > cur && !radius.compare_exchange_weak(cur, new_radius)) {}
+}
+
+float radius_to_beat::pressure(const ruleset& rules) const {
+    float cur = radius;
+    if (cur <= 0.f) return 0.f;
+    return rules.tank_fragment_pressure + rules.tank_fragment_scale * cur * cur;
+}
+
+// pressure under which bombs can be given up on, 0 if none can
+static float give_up_under(const bomb_args& args) {
+    if (!args.to_beat || args.measure_before || args.opt_param.offset != bomb_data::radius_field.offset) return args.min_pressure;
+    return std::max(args.min_pressure, args.to_beat->pressure(*args.rules));
+}
+
+// for bombs given up on once mix's pressure bound fell under give_up_under()
+// ones that can't meet the restrictions are invalid whatever the best so far is, so unlike dominated ones they can be cached
+static sim_result given_up_result(const gas_mixture& mix, const bomb_args& args) {
+    profile_count(profile_event::given_up);
+    if (mix.pressure_bound(args.reactions) < args.min_pressure) {
+        profile_count(profile_event::failed_post_restrictions);
         return {};
     }
+    ++args.to_beat->dominated;
+    return {.dominated = true};
+}
+
+// for bombs that met the pre-simulation restrictions
+static sim_result get_result(const bomb_data& bomb, const bomb_args& args) {
+    bool met = restrictions_met(args.post_restrictions, bomb);
+    if (!met) profile_count(profile_event::failed_post_restrictions);
+    return {bomb.optstat, bomb.fin_radius, bomb.fin_pressure, bomb.fuel_pressure, bomb.ticks, met};
+}
+
+opt_val_wrap do_sim(const std::vector<float>& in_args, const bomb_args& args) {
+    bomb_inputs in;
+    if (!args.satisfiable || !read_inputs(in_args, args, in)) return {};
+
+    sim_result res;
+    std::optional<sim_key> key;
+    if (args.cache) {
+        profile_scope scope(profile_phase::sim_cache);
+        key = in.key(args);
+        if (args.cache->get(*key, res)) {
+            profile_count(profile_event::cache_hit);
+            return res;
+        }
+    }
+
+    gas_tank tank(*args.rules);
+    float fuel_pressure;
+    if (fill_tank(in, args, tank, fuel_pressure)) {
+        bomb_data bomb = make_bomb(in, args, tank, fuel_pressure, false);
+        // a bomb failing these is invalid whatever the simulation says
+        if (restrictions_met(args.pre_restrictions, bomb)) {
+            if (bomb.sim_ticks(args.tick_limit, args.opt_param, args.measure_before, args.gases, args.reactions, give_up_under(args))) {
+                res = get_result(bomb, args);
+            } else {
+                res = given_up_result(bomb.tank.mix, args);
+                if (res.dominated) return res;
+            }
+        } else {
+            profile_count(profile_event::rejected_pre_restrictions);
+        }
+    }
+
+    if (key) args.cache->put(*key, res);
+    return res;
+}
+
+void do_sim_batch(std::span<const std::vector<float>> in_args, const bomb_args& args, std::span<opt_val_wrap> out) {
+    gas_tank_batch batch(args.tick_limit, args.reactions, *args.rules);
+    std::optional<bomb_data> lane_bombs[batch_width];
+    size_t lane_idx[batch_width];
+    std::optional<sim_key> lane_keys[batch_width];
+    std::fill(std::begin(lane_idx), std::end(lane_idx), (size_t)-1);
+    float give_up = give_up_under(args);
+    gas_tank probe(*args.rules);
+    size_t batch_ticks = 0;
+
+    size_t next = 0, count = in_args.size();
+    while (true) {
+        bool any_held = false;
+        for (size_t l = 0; l < batch_width; ++l) {
+            // lane is done, read it back
+            if (lane_idx[l] != (size_t)-1 && !batch.active[l]) {
+                bomb_data& bomb = *lane_bombs[l];
+                batch.store(l, bomb.tank);
+                bomb.finish_sim(batch.ticks[l], args.opt_param, args.measure_before);
+                profile_ticks(batch.ticks[l]);
+
+                sim_result res = get_result(bomb, args);
+                out[lane_idx[l]] = res;
+                if (args.cache) args.cache->put(*lane_keys[l], res);
+                lane_idx[l] = -1;
+            }
+            // lane is free, refill it
+            while (lane_idx[l] == (size_t)-1 && next < count) {
+                size_t idx = next++;
+                bomb_inputs in;
+                if (!args.satisfiable || !read_inputs(in_args[idx], args, in)) {
+                    out[idx] = {};
+                    continue;
+                }
+                sim_result cached;
+                if (args.cache) {
+                    profile_scope scope(profile_phase::sim_cache);
+                    lane_keys[l] = in.key(args);
+                    if (args.cache->get(*lane_keys[l], cached)) {
+                        profile_count(profile_event::cache_hit);
+                        out[idx] = cached;
+                        continue;
+                    }
+                }
+                gas_tank tank(*args.rules);
+                float fuel_pressure;
+                if (!fill_tank(in, args, tank, fuel_pressure)) {
+                    out[idx] = {};
+                    if (args.cache) args.cache->put(*lane_keys[l], {});
+                    continue;
+                }
+                bomb_data& bomb = lane_bombs[l].emplace(make_bomb(in, args, tank, fuel_pressure, false));
+                if (!restrictions_met(args.pre_restrictions, bomb)) {
+                    profile_count(profile_event::rejected_pre_restrictions);
+                    out[idx] = {};
+                    if (args.cache) args.cache->put(*lane_keys[l], {});
+                    continue;
+                }
+                if (give_up > 0.f && bomb.tank.mix.pressure_bound(args.reactions) < give_up) {
+                    sim_result res = given_up_result(bomb.tank.mix, args);
+                    out[idx] = res;
+                    if (args.cache && !res.dominated) args.cache->put(*lane_keys[l], res);
+                    continue;
+                }
+                bomb.begin_sim(args.opt_param, args.measure_before);
+                profile_count(profile_event::simulated);
+                batch.load(l, bomb.tank);
+                lane_idx[l] = idx;
+            }
+            any_held |= lane_idx[l] != (size_t)-1;
+        }
+        if (!any_held) break;
+
+        {
+            profile_scope scope(profile_phase::sim_tick);
+            batch.tick();
+        }
+        // give up on lanes every so often like gas_tank::tick_n() does
+        if (give_up > 0.f && ++batch_ticks % gas_tank::give_up_check_spacing == 0) {
+            for (size_t l = 0; l < batch_width; ++l) {
+                if (lane_idx[l] == (size_t)-1 || !batch.active[l]) continue;
+                batch.store(l, probe);
+                if (probe.mix.pressure_bound(args.reactions) >= give_up) continue;
+                sim_result res = given_up_result(probe.mix, args);
+                out[lane_idx[l]] = res;
+                if (args.cache && !res.dominated) args.cache->put(*lane_keys[l], res);
+                batch.active[l] = 0;
+                lane_idx[l] = -1;
+            }
+        }
+    }
+}
+
+void materialise_result(const std::vector<float>& in_args, const bomb_args& args, opt_val_wrap& res) {
+    bomb_inputs in;
+    gas_tank tank(*args.rules);
+    float fuel_pressure;
+    if (!read_inputs(in_args, args, in) || !fill_tank(in, args, tank, fuel_pressure)) return;
+
+    res.data = std::make_shared<bomb_data>(make_bomb(in, args, tank, fuel_pressure, true));
+    res.data->sim_ticks(args.tick_limit, args.opt_param, args.measure_before, args.gases, args.reactions);
+}
+
+// whether worse_result() picks rhs
+static bool rhs_worse(const sim_result& lhs, const sim_result& rhs, bool maximise) {
+    if (!lhs.valid) return false;
+    if (!rhs.valid) return true;
+    return (rhs.optstat < lhs.optstat) == maximise;
+}
+
+sim_result worse_result(const sim_result& lhs, const sim_result& rhs, bool maximise) {
+    return rhs_worse(lhs, rhs, maximise) ? rhs : lhs;
+}
 
-    std::shared_ptr<bomb_data> bomb = std::make_shared<bomb_data>(mix_fractions, primer_fractions, fill_pressure,
-                   fuel_temp, fuel_pressure, thir_temp, target_temp,
-                   mix_gases, primer_gases,
-                   std::move(mix_tank), args.round_pressure_to, args.round_temp_to, args.round_ratio_to);
+opt_val_wrap do_sim_multi(const std::vector<float>& in_args, const multi_bomb_args& args) {
+    sim_result res = do_sim(in_args, args.per_ruleset[0]).res;
+    for (size_t i = 1; i < args.per_ruleset.size() && res.valid; ++i) {
+        res = worse_result(res, do_sim(in_args, args.per_ruleset[i]).res, args.maximise);
+    }
+    return res;
+}
 
-    bool pre_met = std::none_of(pre_restrictions.begin(), pre_restrictions.end(), [&bomb](const auto& r){ return !r.OK(*bomb); });
+void do_sim_multi_batch(std::span<const std::vector<float>> in_args, const multi_bomb_args& args, std::span<opt_val_wrap> out) {
+    do_sim_batch(in_args, args.per_ruleset[0], out);
+    if (args.per_ruleset.size() == 1) return;
+
+    std::vector<opt_val_wrap> other(in_args.size());
+    for (size_t i = 1; i < args.per_ruleset.size(); ++i) {
+        do_sim_batch(in_args, args.per_ruleset[i], other);
+        for (size_t j = 0; j < out.size(); ++j) {
+            out[j].res = worse_result(out[j].res, other[j].res, args.maximise);
+        }
+    }
+}
 
-    // simulate for up to tick_cap ticks
-    bomb->sim_ticks(tick_cap, optstat_ref, measure_before);
+const bomb_args& materialise_multi(const std::vector<float>& in_args, const multi_bomb_args& args, opt_val_wrap& res) {
+    // the ruleset the rating came from, picked like do_sim_multi() does
+    size_t worst = 0;
+    sim_result worst_res = do_sim(in_args, args.per_ruleset[0]).res;
+    for (size_t i = 1; i < args.per_ruleset.size() && worst_res.valid; ++i) {
+        sim_result other = do_sim(in_args, args.per_ruleset[i]).res;
+        if (rhs_worse(worst_res, other, args.maximise)) {
+            worst = i;
+            worst_res = other;
+        }
+    }
+    materialise_result(in_args, args.per_ruleset[worst], res);
+    return args.per_ruleset[worst];
+}
 
-    bool post_met = std::none_of(post_restrictions.begin(), post_restrictions.end(), [&bomb](const auto& r){ return !r.OK(*bomb); });
-    return opt_val_wrap(bomb, pre_met && post_met);
+void trace_bomb(std::string_view serialized, const bomb_args& args, tick_trace& trace) {
+    bomb_data bomb = bomb_data::deserialize(serialized, *args.rules);
+    trace(bomb.tank, 0, 0);
+    bomb.tank.tick_n(args.tick_limit, args.reactions, 0.f, trace);
 }
 
 }
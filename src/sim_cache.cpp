@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <bit>
+#include <format>
+
+#include "sim_cache.hpp"
+
+namespace asim {
+
+static uint64_t pack_gases(const std::vector<gas_ref>& gases) {
+    uint64_t packed = 0;
+    for (const gas_ref& gas : gases) {
+        packed = (packed << 4) | (gas.idx + 1);
+    }
+    return packed;
+}
+
+sim_key::sim_key(const std::vector<gas_ref>& mix_gases, const std::vector<gas_ref>& primer_gases)
+    : mix_gases(pack_gases(mix_gases)), primer_gases(pack_gases(primer_gases)) {}
+
+void sim_key::push(float value) {
+    values[len++] = std::bit_cast<uint32_t>(value);
+}
+
+// splitmix64 finaliser
+static uint64_t mix_bits(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+size_t sim_key::hash() const {
+    uint64_t h = mix_bits(mix_gases) ^ mix_bits(primer_gases + 1);
+    for (uint32_t i = 0; i < len; ++i) {
+        h = mix_bits(h + values[i]);
+    }
+    return h;
+}
+
+sim_cache::sim_cache(size_t capacity, size_t shard_count) {
+    shard_count = std::max((size_t)1, std::min(shard_count, capacity));
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards.emplace_back(std::make_unique<shard>());
+        // spread the capacity, giving the remainder to the first shards
+        shards.back()->capacity = capacity / shard_count + (i < capacity % shard_count);
+        shards.back()->index.reserve(shards.back()->capacity);
+    }
+}
+
+sim_cache::shard& sim_cache::shard_for(const sim_key& key) {
+    // use the high bits, the low ones pick the bucket inside the shard
+    return *shards[(key.hash() >> 32) % shards.size()];
+}
+
+bool sim_cache::get(const sim_key& key, sim_result& out) {
+    shard& sh = shard_for(key);
+    std::lock_guard lock(sh.mutex);
+    auto it = sh.index.find(key);
+    if (it == sh.index.end()) {
+        ++sh.misses;
+        return false;
+    }
+    entry& e = sh.entries[it->second];
+    e.referenced = true;
+    out = e.value;
+    ++sh.hits;
+    return true;
+}
+
+void sim_cache::put(const sim_key& key, const sim_result& value) {
+    shard& sh = shard_for(key);
+    std::lock_guard lock(sh.mutex);
+    if (sh.capacity == 0 || sh.index.contains(key)) return;
+
+    if (sh.entries.size() < sh.capacity) {
+        sh.index[key] = sh.entries.size();
+        sh.entries.push_back({key, value, false});
+        return;
+    }
+
+    // sweep the hand until we find an entry that wasn't used since the last sweep
+    while (sh.entries[sh.hand].referenced) {
+        sh.entries[sh.hand].referenced = false;
+        sh.hand = (sh.hand + 1) % sh.capacity;
+    }
+    entry& victim = sh.entries[sh.hand];
+    sh.index.erase(victim.key);
+    victim = {key, value, false};
+    sh.index[key] = sh.hand;
+    sh.hand = (sh.hand + 1) % sh.capacity;
+}
+
+size_t sim_cache::hits() const {
+    size_t total = 0;
+    for (const std::unique_ptr<shard>& sh : shards) total += sh->hits;
+    return total;
+}
+
+size_t sim_cache::misses() const {
+    size_t total = 0;
+    for (const std::unique_ptr<shard>& sh : shards) total += sh->misses;
+    return total;
+}
+
+float sim_cache::hit_rate() const {
+    size_t h = hits(), total = h + misses();
+    return total == 0 ? 0.f : (float)h / total;
+}
+
+std::string sim_cache::status_str() {
+    size_t h = hits(), m = misses();
+    size_t recent_h = h - last_hits, recent_total = recent_h + m - last_misses;
+    last_hits = h;
+    last_misses = m;
+    float recent_rate = recent_total == 0 ? 0.f : (float)recent_h / recent_total;
+    return std::format("cache hits: {:.1f}% ({:.1f}% total)", recent_rate * 100.f, hit_rate() * 100.f);
+}
+
+}
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cmath>
+
+#include "surrogate.hpp"
+
+namespace asim {
+
+surrogate::surrogate(size_t capacity, size_t neighbours)
+    : capacity(std::max((size_t)1, capacity)), neighbours(std::clamp(neighbours, (size_t)2, max_neighbours)) {}
+
+void surrogate::add(const std::vector<float>& at, float rating) {
+    if (dims != at.size()) {
+        dims = at.size();
+        points.assign(capacity * dims, 0.f);
+        ratings.assign(capacity, 0.f);
+        distances.assign(capacity, 0.f);
+        count = next = 0;
+    }
+    for (size_t j = 0; j < dims; ++j) {
+        points[j * capacity + next] = at[j];
+    }
+    ratings[next] = rating;
+    next = next + 1 == capacity ? 0 : next + 1;
+    count = std::min(count + 1, capacity);
+}
+
+bool surrogate::predict(const std::vector<float>& at, const std::vector<float>& scale, float& mean, float& sd) const {
+    if (count < neighbours || at.size() != dims) return false;
+
+    // a column at a time, so this vectorises
+    std::fill(distances.begin(), distances.begin() + count, 0.f);
+    for (size_t j = 0; j < dims; ++j) {
+        const float* column = points.data() + j * capacity;
+        float x = at[j], s = scale[j];
+        for (size_t p = 0; p < count; ++p) {
+            float d = (column[p] - x) * s;
+            distances[p] += d * d;
+        }
+    }
+
+    // the nearest neighbours, nearest first
+    size_t k = neighbours;
+    float near_dist[max_neighbours];
+    size_t near_idx[max_neighbours];
+    size_t found = 0;
+    for (size_t p = 0; p < count; ++p) {
+        float dist = distances[p];
+        if (found == k && dist >= near_dist[k - 1]) continue;
+
+        size_t pos = found < k ? found++ : k - 1;
+        while (pos > 0 && near_dist[pos - 1] > dist) {
+            near_dist[pos] = near_dist[pos - 1];
+            near_idx[pos] = near_idx[pos - 1];
+            --pos;
+        }
+        near_dist[pos] = dist;
+        near_idx[pos] = p;
+    }
+
+    // gaussian kernel as wide as the farthest neighbour
+    float width = std::max(near_dist[found - 1], 1e-12f);
+    float weight_sum = 0.f, weighted = 0.f;
+    float weights[max_neighbours];
+    for (size_t n = 0; n < found; ++n) {
+        weights[n] = std::exp(-near_dist[n] / width);
+        weight_sum += weights[n];
+        weighted += weights[n] * ratings[near_idx[n]];
+    }
+    mean = weighted / weight_sum;
+
+    float var = 0.f;
+    for (size_t n = 0; n < found; ++n) {
+        float d = ratings[near_idx[n]] - mean;
+        var += weights[n] * d * d;
+    }
+    // neighbours that agree say little about a point far from all of them
+    sd = std::sqrt(var / weight_sum) * (1.f + std::sqrt(near_dist[0] / width));
+    return true;
+}
+
+void surrogate::clear() {
+    count = next = 0;
+}
+
+size_t surrogate::size() const {
+    return count;
+}
+
+}
@@ -1,32 +1,52 @@
+#include <bit>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <format>
 
+#include "profile.hpp"
 #include "tank.hpp"
+#include "trace.hpp"
 
 namespace asim {
 
-float gas_tank::calc_radius() {
-    return calc_radius(mix.pressure());
+// float == treats 0 and -0 as equal, but they can give different results later
+static bool same_bits(float lhs, float rhs) {
+    return std::bit_cast<uint32_t>(lhs) == std::bit_cast<uint32_t>(rhs);
 }
 
-float gas_tank::calc_radius(float pressure) {
-    if (pressure < tank_fragment_pressure) return 0.f;
-    return std::sqrt((pressure - tank_fragment_pressure) / tank_fragment_scale);
+template<gas_mask Mask>
+float gas_tank_t<Mask>::calc_radius() {
+    return calc_radius(mix.pressure(), *mix.rules);
+}
+
+float gas_tank_base::calc_radius(float pressure, const ruleset& rules) {
+    if (pressure < rules.tank_fragment_pressure) return 0.f;
+    return std::sqrt((pressure - rules.tank_fragment_pressure) / rules.tank_fragment_scale);
+}
+
+template<gas_mask Mask>
+bool gas_tank_t<Mask>::tick() {
+    reaction_mask fired;
+    return tick(&gas_mixture_t<Mask>::reaction_tick, fired);
 }
 
 // do one reaction tick and check state
-bool gas_tank::tick() {
-    bool reacted = mix.reaction_tick();
+template<gas_mask Mask>
+bool gas_tank_t<Mask>::tick(typename gas_mixture_t<Mask>::reaction_tick_t react, reaction_mask& fired) {
+    const ruleset& rules = *mix.rules;
+    fired = (mix.*react)();
+    bool reacted = fired;
 
     float pressure = mix.pressure();
-    if (pressure > tank_fragment_pressure) {
+    if (pressure > rules.tank_fragment_pressure) {
         for (int i = 0; i < 3; ++i) {
-            mix.reaction_tick();
+            fired |= (mix.*react)();
         }
         state = st_exploded;
         return true;
     }
-    if (pressure > tank_rupture_pressure) {
+    if (pressure > rules.tank_rupture_pressure) {
         if (integrity <= 0) {
             state = st_ruptured;
             return true;
@@ -34,11 +54,13 @@ bool gas_tank::tick() {
         --integrity;
         return true;
     }
-    if (pressure > tank_leak_pressure) {
+    if (pressure > rules.tank_leak_pressure) {
         if (integrity <= 0) {
             for (float& amt : mix.amounts) {
                 amt *= 0.75;
             }
+            // summed again rather than scaled, so the sums don't drift from the amounts over a long leak
+            mix.refresh_cache();
         } else {
             --integrity;
         }
@@ -50,17 +72,80 @@ bool gas_tank::tick() {
     return reacted;
 }
 
-size_t gas_tank::tick_n(size_t ticks_limit) {
+template<gas_mask Mask>
+size_t gas_tank_t<Mask>::tick_n(size_t ticks_limit, reaction_mask reactions, float give_up_under) {
+    no_tick_observer observer;
+    return tick_n(ticks_limit, reactions, give_up_under, observer);
+}
+
+template<gas_mask Mask>
+template<typename Observer>
+size_t gas_tank_t<Mask>::tick_n(size_t ticks_limit, reaction_mask reactions, float give_up_under, Observer& observer) {
+    typename gas_mixture_t<Mask>::reaction_tick_t react = gas_mixture_t<Mask>::reaction_tick_for(reactions);
+    reaction_mask fired;
     for (size_t i = 0; i < ticks_limit; ++i) {
+        if (give_up_under > 0.f && i % give_up_check_spacing == 0 && mix.pressure_bound(reactions) < give_up_under) return gave_up;
+        float total_gas = mix.cached_total_gas, heat_capacity = mix.cached_heat_capacity, temperature = mix.temperature;
+        int last_integrity = integrity;
+        bool ticked = tick(react, fired);
+        profile_reactions(fired);
+        observer(*this, i + 1, fired);
         // early exit if we ruptured or if we're inert
-        if (!tick() || state != gas_tank::st_intact) return i + 1;
+        if (!ticked || state != st_intact) return i + 1;
+
+        // a tick only depends on the tank's state, so if one leaves it as it was, so will every tick after
+        // the sums are a cheap hint, if they didn't change check the next tick against the whole state
+        if (!same_bits(mix.cached_total_gas, total_gas) || !same_bits(mix.cached_heat_capacity, heat_capacity)
+         || !same_bits(mix.temperature, temperature) || integrity != last_integrity || ++i == ticks_limit) continue;
+        gas_tank_t before = *this;
+        ticked = tick(react, fired);
+        profile_reactions(fired);
+        observer(*this, i + 1, fired);
+        if (!ticked || state != st_intact) return i + 1;
+        if (same_state(before)) return ticks_limit;
     }
     return ticks_limit;
 }
 
-std::string gas_tank::get_status() {
+template<gas_mask Mask>
+bool gas_tank_t<Mask>::same_state(const gas_tank_t& other) const {
+    return std::memcmp(mix.amounts, other.mix.amounts, sizeof(mix.amounts)) == 0
+        && same_bits(mix.temperature, other.mix.temperature)
+        && same_bits(mix.cached_total_gas, other.mix.cached_total_gas)
+        && same_bits(mix.cached_heat_capacity, other.mix.cached_heat_capacity)
+        && state == other.state && integrity == other.integrity;
+}
+
+template<gas_mask Mask>
+std::string gas_tank_t<Mask>::get_status() {
     return std::format("pressure {} temperature {} integ {} gases [{}]",
                         mix.pressure(), mix.temperature, integrity, mix.to_string());
 }
 
+template struct gas_tank_t<fire_gases_mask>;
+template struct gas_tank_t<no_nitrium_gases_mask>;
+template struct gas_tank_t<all_gases_mask>;
+
+template size_t gas_tank_t<fire_gases_mask>::tick_n(size_t, reaction_mask, float, no_tick_observer&);
+template size_t gas_tank_t<no_nitrium_gases_mask>::tick_n(size_t, reaction_mask, float, no_tick_observer&);
+template size_t gas_tank_t<all_gases_mask>::tick_n(size_t, reaction_mask, float, no_tick_observer&);
+template size_t gas_tank_t<fire_gases_mask>::tick_n(size_t, reaction_mask, float, tick_trace&);
+template size_t gas_tank_t<no_nitrium_gases_mask>::tick_n(size_t, reaction_mask, float, tick_trace&);
+template size_t gas_tank_t<all_gases_mask>::tick_n(size_t, reaction_mask, float, tick_trace&);
+
+template<gas_mask Mask>
+static size_t tick_n_as(gas_tank& tank, size_t ticks_limit, reaction_mask reactions, float give_up_under) {
+    gas_tank_t<Mask> sub(*tank.mix.rules);
+    sub.assign(tank);
+    size_t ticks = sub.tick_n(ticks_limit, reactions, give_up_under);
+    tank.assign(sub);
+    return ticks;
+}
+
+size_t tick_n_subset(gas_tank& tank, size_t ticks_limit, gas_mask gases, reaction_mask reactions, float give_up_under) {
+    if ((gases & fire_gases_mask) == gases) return tick_n_as<fire_gases_mask>(tank, ticks_limit, reactions, give_up_under);
+    if ((gases & no_nitrium_gases_mask) == gases) return tick_n_as<no_nitrium_gases_mask>(tank, ticks_limit, reactions, give_up_under);
+    return tank.tick_n(ticks_limit, reactions, give_up_under);
+}
+
 }
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <format>
+
+#include "thread_pool.hpp"
+#include "timeline.hpp"
+
+namespace asim {
+
+// which pool and deque the current thread works for, if any
+static thread_local thread_pool* current_pool = nullptr;
+static thread_local size_t current_index = 0;
+
+thread_pool::thread_pool(size_t n_threads) {
+    n_threads = std::max((size_t)1, n_threads);
+    for (size_t i = 0; i < n_threads; ++i) {
+        queues.emplace_back(std::make_unique<worker_queue>());
+    }
+    for (size_t i = 0; i < n_threads; ++i) {
+        workers.emplace_back([this, i]{ worker_loop(i); });
+    }
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard lock(sleep_mutex);
+        stopping = true;
+    }
+    sleep_cv.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void thread_pool::submit(task_t task) {
+    size_t index = current_pool == this ? current_index : next_queue++ % queues.size();
+    ++pending;
+    {
+        std::lock_guard lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    ++queued;
+    // a worker only sleeps after seeing queued == 0, so if one is about to sleep, taking the lock makes sure it gets the notify
+    if (sleeping > 0) {
+        { std::lock_guard lock(sleep_mutex); }
+        sleep_cv.notify_one();
+    }
+}
+
+void thread_pool::wait_idle() {
+    std::unique_lock lock(idle_mutex);
+    idle_cv.wait(lock, [this]{ return pending == 0; });
+}
+
+size_t thread_pool::size() const {
+    return workers.size();
+}
+
+bool thread_pool::try_pop(size_t index, task_t& task) {
+    if (queued == 0) return false;
+
+    // own deque first, newest task
+    {
+        worker_queue& own = *queues[index];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --queued;
+            return true;
+        }
+    }
+    // then steal the oldest task of someone else
+    for (size_t k = 1; k < queues.size(); ++k) {
+        worker_queue& other = *queues[(index + k) % queues.size()];
+        std::lock_guard lock(other.mutex);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void thread_pool::worker_loop(size_t index) {
+    current_pool = this;
+    current_index = index;
+    timeline_thread_name(std::format("worker {}", index));
+
+    task_t task;
+    while (true) {
+        if (try_pop(index, task)) {
+            task();
+            task = nullptr;
+            if (--pending == 0) {
+                { std::lock_guard lock(idle_mutex); }
+                idle_cv.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock lock(sleep_mutex);
+        ++sleeping;
+        sleep_cv.wait(lock, [this]{ return stopping || queued > 0; });
+        --sleeping;
+        if (stopping && queued == 0) break;
+    }
+}
+
+}
@@ -0,0 +1,99 @@
+#include <format>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "timeline.hpp"
+
+namespace asim {
+
+struct timeline_buffer {
+    size_t id;
+    std::string name;
+    std::vector<timeline_event> events;
+};
+
+// every thread's buffer, kept after their thread exits so its events still get written
+static std::mutex timeline_mutex;
+static std::vector<std::shared_ptr<timeline_buffer>> timeline_buffers;
+static size_t timeline_next_id = 0;
+static std::chrono::steady_clock::time_point timeline_epoch = std::chrono::steady_clock::now();
+
+static timeline_buffer& local_buffer() {
+    thread_local std::shared_ptr<timeline_buffer> local = []{
+        auto buffer = std::make_shared<timeline_buffer>();
+        std::lock_guard lock(timeline_mutex);
+        buffer->id = timeline_next_id++;
+        buffer->name = std::format("thread {}", buffer->id);
+        timeline_buffers.push_back(buffer);
+        return buffer;
+    }();
+    return *local;
+}
+
+void timeline_start() {
+    {
+        std::lock_guard lock(timeline_mutex);
+        // drop the ones whose thread exited
+        std::erase_if(timeline_buffers, [](const std::shared_ptr<timeline_buffer>& buffer) { return buffer.use_count() == 1; });
+        for (std::shared_ptr<timeline_buffer>& buffer : timeline_buffers) buffer->events.clear();
+        timeline_epoch = std::chrono::steady_clock::now();
+    }
+    timeline_enabled = true;
+}
+
+void timeline_stop() {
+    timeline_enabled = false;
+}
+
+void timeline_thread_name(std::string name) {
+    local_buffer().name = std::move(name);
+}
+
+uint64_t timeline_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - timeline_epoch).count();
+}
+
+void timeline_record(const timeline_event& event) {
+    std::vector<timeline_event>& events = local_buffer().events;
+    // a span right after one just like it extends that one instead, so spans around every sample stay few
+    if (event.kind == 'X' && !events.empty()) {
+        timeline_event& last = events.back();
+        uint64_t last_end = last.start + last.duration;
+        if (last.kind == 'X' && last.name == event.name && last.arg_name == event.arg_name && last.arg == event.arg
+            && event.start >= last_end && event.start - last_end < timeline_merge_gap) {
+            last.duration = event.start + event.duration - last.start;
+            return;
+        }
+    }
+    events.push_back(event);
+}
+
+void timeline_write(std::ostream& out) {
+    std::lock_guard lock(timeline_mutex);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+    auto separate = [&]{
+        if (!first) out << ",\n";
+        first = false;
+    };
+    for (const std::shared_ptr<timeline_buffer>& buffer : timeline_buffers) {
+        if (buffer->events.empty()) continue;
+        separate();
+        // names are ours, nothing in them needs escaping
+        out << std::format(R"({{"ph":"M","name":"thread_name","pid":1,"tid":{},"args":{{"name":"{}"}}}})", buffer->id, buffer->name);
+        for (const timeline_event& event : buffer->events) {
+            separate();
+            // timestamps are in microseconds
+            out << std::format(R"({{"ph":"{}","name":"{}","pid":1,"tid":{},"ts":{:.3f})", event.kind, event.name, buffer->id, event.start * 1e-3);
+            if (event.kind == 'X') out << std::format(R"(,"dur":{:.3f})", event.duration * 1e-3);
+            // instants only mark their own thread
+            if (event.kind == 'i') out << R"(,"s":"t")";
+            if (event.arg_name) out << std::format(R"(,"args":{{"{}":{}}})", event.arg_name, event.arg);
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+}
+
+}
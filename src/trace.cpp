@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#include "trace.hpp"
+
+namespace asim {
+
+static constexpr char trace_magic[8] = {'A', 'S', 'I', 'M', 'T', 'R', 'C', '1'};
+
+// by bit, see reaction_bits
+static constexpr std::string_view reaction_names[] = {
+    "frezon_production", "nitrium_decomposition", "frezon_coolant", "N2O_decomposition", "tritium_fire", "plasma_fire"
+};
+
+static constexpr std::string_view state_names[] = {"intact", "ruptured", "exploded"};
+
+tick_trace::tick_trace(size_t capacity)
+    : capacity(std::max((size_t)1, capacity)),
+      ticks(this->capacity), temperatures(this->capacity), pressures(this->capacity),
+      amounts(this->capacity * gas_count),
+      integrities(this->capacity), states(this->capacity), reactions(this->capacity) {}
+
+size_t tick_trace::size() const {
+    return std::min(recorded, (uint64_t)capacity);
+}
+
+size_t tick_trace::slot(size_t i) const {
+    return (next + capacity - size() + i) % capacity;
+}
+
+void tick_trace::clear() {
+    recorded = 0;
+    next = 0;
+}
+
+template<typename T>
+static void write_value(std::ostream& out, const T& value) {
+    out.write((const char*)&value, sizeof(T));
+}
+
+template<typename T>
+static void read_value(std::istream& in, T& value) {
+    in.read((char*)&value, sizeof(T));
+    if (!in) throw std::runtime_error("trace file ended early");
+}
+
+// kept records are at most two runs of the ring, oldest first
+template<typename F>
+static void for_each_run(const tick_trace& trace, F&& f) {
+    size_t count = trace.size(), first = count == 0 ? 0 : trace.slot(0);
+    size_t head = std::min(count, trace.capacity - first);
+    if (head > 0) f(first, head);
+    if (count > head) f(0, count - head);
+}
+
+template<typename T>
+static void write_column(std::ostream& out, const tick_trace& trace, const T* column) {
+    for_each_run(trace, [&](size_t from, size_t n) {
+        out.write((const char*)(column + from), n * sizeof(T));
+    });
+}
+
+template<typename T>
+static void read_column(std::istream& in, const tick_trace& trace, T* column) {
+    for_each_run(trace, [&](size_t from, size_t n) {
+        in.read((char*)(column + from), n * sizeof(T));
+    });
+    if (!in) throw std::runtime_error("trace file ended early");
+}
+
+void tick_trace::write(std::ostream& out, std::string_view label) const {
+    out.write(trace_magic, sizeof(trace_magic));
+    write_value(out, (uint32_t)label.size());
+    out.write(label.data(), label.size());
+    write_value(out, (uint32_t)gas_count);
+    write_value(out, (uint32_t)size());
+    write_value(out, recorded);
+
+    write_column(out, *this, ticks.data());
+    write_column(out, *this, temperatures.data());
+    write_column(out, *this, pressures.data());
+    for (size_t i = 0; i < gas_count; ++i) {
+        write_column(out, *this, amounts.data() + i * capacity);
+    }
+    write_column(out, *this, integrities.data());
+    write_column(out, *this, states.data());
+    write_column(out, *this, reactions.data());
+}
+
+bool tick_trace::read(std::istream& in, std::string& label) {
+    char magic[sizeof(trace_magic)];
+    in.read(magic, sizeof(magic));
+    if (in.gcount() == 0 && in.eof()) return false;
+    if (!in || std::memcmp(magic, trace_magic, sizeof(magic)) != 0) throw std::runtime_error("not an atmosim trace");
+
+    uint32_t label_size, file_gas_count, count;
+    read_value(in, label_size);
+    label.resize(label_size);
+    in.read(label.data(), label_size);
+    read_value(in, file_gas_count);
+    if (file_gas_count != gas_count) {
+        throw std::runtime_error(std::format("trace has {} gases, we know {}", file_gas_count, gas_count));
+    }
+    read_value(in, count);
+    uint64_t file_recorded;
+    read_value(in, file_recorded);
+    if (count > file_recorded) throw std::runtime_error("trace keeps more records than it made");
+
+    *this = tick_trace(count);
+    recorded = file_recorded;
+    read_column(in, *this, ticks.data());
+    read_column(in, *this, temperatures.data());
+    read_column(in, *this, pressures.data());
+    for (size_t i = 0; i < gas_count; ++i) {
+        read_column(in, *this, amounts.data() + i * capacity);
+    }
+    read_column(in, *this, integrities.data());
+    read_column(in, *this, states.data());
+    read_column(in, *this, reactions.data());
+    return true;
+}
+
+std::string tick_trace::to_csv() const {
+    std::string out = "tick,temperature,pressure";
+    for (size_t i = 0; i < gas_count; ++i) {
+        out += std::format(",{}", gas_types[i].name);
+    }
+    out += ",integrity,state,reactions\n";
+
+    for (size_t r = 0; r < size(); ++r) {
+        size_t at = slot(r);
+        out += std::format("{},{},{}", ticks[at], temperatures[at], pressures[at]);
+        for (size_t i = 0; i < gas_count; ++i) {
+            out += std::format(",{}", amounts[i * capacity + at]);
+        }
+        out += std::format(",{},{},", integrities[at], states[at] < std::size(state_names) ? state_names[states[at]] : "unknown");
+        // reactions as name|name|...
+        bool first = true;
+        for (size_t bit = 0; bit < std::size(reaction_names); ++bit) {
+            if (!(reactions[at] & (1u << bit))) continue;
+            out += std::format("{}{}", first ? "" : "|", reaction_names[bit]);
+            first = false;
+        }
+        out += '\n';
+    }
+    return out;
+}
+
+}
@@ -1,6 +1,8 @@
+#include <atomic>
+#include <cmath>
 #include <functional>
 #include <iostream>
-#include <random>
+#include <thread>
 #include <vector>
 
 #include "utility.hpp"
@@ -8,11 +10,10 @@
 namespace asim {
 
 float frand() {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_real_distribution<float> distribution;
+    // one generator per thread, so threads don't race on it
+    thread_local xoshiro256ss gen = xoshiro256ss::random();
 
-    return distribution(gen);
+    return gen.uniform();
 }
 
 float frand(float to) {
@@ -166,6 +167,16 @@ std::vector<float> random_vec(const std::vector<float>& lower_bounds, const std:
     return out_vec;
 }
 
+std::vector<float> random_vec(const std::vector<float>& lower_bounds, const std::vector<float>& upper_bounds, xoshiro256ss& rng) {
+    size_t dims = lower_bounds.size();
+    std::vector<float> out_vec(dims);
+    rng.uniform(out_vec);
+    for (size_t i = 0; i < dims; ++i) {
+        out_vec[i] = lower_bounds[i] + out_vec[i] * (upper_bounds[i] - lower_bounds[i]);
+    }
+    return out_vec;
+}
+
 std::vector<float> orthogonal_noise(const std::vector<float>& dir, float strength) {
     size_t dims = dir.size();
     std::vector<float> noise(dims);
@@ -221,13 +232,98 @@ void space_vectors(std::vector<std::vector<float>>& vecs, float strength) {
     }
 }
 
+// logged lines get written by a background thread, so whoever logs never waits on stdout
+// they're pushed onto a lock-free list, which the writer takes whole, so lines come out in the order they were logged
+struct log_record {
+    log_record* next;
+    std::string text;
+    bool endl, clear;
+    // the writer stops after this one
+    bool last = false;
+};
+
+static void write_record(const log_record& rec) {
+    if (rec.clear) std::cout << "\33[2K\r";
+    std::cout << rec.text;
+    if (rec.endl) std::cout << '\n';
+}
+
+#ifndef __EMSCRIPTEN__
+struct log_writer {
+    std::atomic<log_record*> head = nullptr;
+    std::atomic<size_t> pushed = 0, written = 0;
+    std::thread thread;
+
+    log_writer(): thread([this]{ run(); }) {}
+
+    // at exit, write what's left
+    ~log_writer() {
+        push(new log_record{nullptr, "", false, false, true});
+        thread.join();
+    }
+
+    void push(log_record* rec) {
+        // counted before it's on the list, so written can't catch up to a flush target while it's unwritten
+        ++pushed;
+        log_record* old = head.load(std::memory_order_relaxed);
+        do {
+            rec->next = old;
+        } while (!head.compare_exchange_weak(old, rec, std::memory_order_release, std::memory_order_relaxed));
+        // only an empty list can have the writer waiting on it
+        if (!old) head.notify_one();
+    }
+
+    void run() {
+        std::vector<log_record*> batch;
+        bool stop = false;
+        while (!stop) {
+            head.wait(nullptr, std::memory_order_acquire);
+            log_record* rec = head.exchange(nullptr, std::memory_order_acquire);
+            // the list is newest first
+            for (; rec; rec = rec->next) batch.push_back(rec);
+            for (auto it = batch.rbegin(); it != batch.rend(); ++it) {
+                write_record(**it);
+                stop |= (*it)->last;
+                delete *it;
+            }
+            // once per batch rather than per line
+            std::cout.flush();
+            written += batch.size();
+            written.notify_all();
+            batch.clear();
+        }
+    }
+
+    void flush() {
+        size_t target = pushed;
+        size_t done;
+        while ((done = written) < target) written.wait(done);
+    }
+};
+
+static log_writer& get_log_writer() {
+    static log_writer writer;
+    return writer;
+}
+#endif
+
 void log(std::function<std::string()>&& str, size_t log_level, size_t level, bool endl, bool clear) {
     if (log_level < level) return;
-    log_mutex.lock();
-    if (clear) std::cout << "\33[2K\r";
-    std::cout << str();
-    if (endl) std::cout << std::endl;
-    log_mutex.unlock();
+    log_record* rec = new log_record{nullptr, str(), endl, clear};
+#ifdef __EMSCRIPTEN__
+    // no threads on web
+    write_record(*rec);
+    std::cout.flush();
+    delete rec;
+#else
+    get_log_writer().push(rec);
+#endif
+}
+
+void log_flush() {
+#ifndef __EMSCRIPTEN__
+    get_log_writer().flush();
+#endif
 }
 
 duration_t as_seconds(float count) {
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <limits>
+#include <string>
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace asim {
+
+// the CPU's counters of what happened while running some code, see perf_event_open(2)
+// opt in with ATMOSIM_PERF_COUNTERS=1, they need Linux and perf_event_paranoid <= 2
+// counters the CPU or VM doesn't have read as 0, and the ratios needing them as nan
+enum struct perf_counter : uint8_t {
+    cycles,
+    instructions,
+    branches,
+    branch_misses,
+    l1d_misses,
+    llc_misses,
+    count
+};
+
+inline constexpr size_t perf_counter_count = (size_t)perf_counter::count;
+
+struct perf_values {
+    uint64_t values[perf_counter_count] = {};
+    // how many ticks or calls the counts are over
+    uint64_t per = 1;
+
+    uint64_t operator[](perf_counter c) const { return values[(size_t)c]; }
+    bool has(perf_counter c) const { return values[(size_t)c] != 0; }
+
+    double ratio(perf_counter of, perf_counter to) const {
+        return has(of) && has(to) ? (double)(*this)[of] / (*this)[to] : std::numeric_limits<double>::quiet_NaN();
+    }
+    double ipc() const { return ratio(perf_counter::instructions, perf_counter::cycles); }
+    double branch_miss_rate() const { return ratio(perf_counter::branch_misses, perf_counter::branches); }
+    double per_one(perf_counter c) const {
+        return has(c) ? (double)(*this)[c] / per : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    // unit: what per counts, like "tick"
+    std::string report(const std::string& name, const std::string& unit) const {
+        return std::format("{}: per {} over {}: {:.1f} cycles, {:.1f} instructions, {:.2f} L1d misses, {:.3f} LLC misses; IPC {:.2f}, branch misses {:.2f}%",
+                           name, unit, per,
+                           per_one(perf_counter::cycles), per_one(perf_counter::instructions),
+                           per_one(perf_counter::l1d_misses), per_one(perf_counter::llc_misses),
+                           ipc(), branch_miss_rate() * 100.0);
+    }
+};
+
+inline bool perf_counters_requested() {
+    const char* env = std::getenv("ATMOSIM_PERF_COUNTERS");
+    return env && *env && std::string(env) != "0";
+}
+
+// counts this thread's user-space events between each start() and stop(), so setup in between isn't counted
+// each counter is opened on its own so ones the CPU can't fit together still get a scaled estimate
+struct perf_counters {
+    int fds[perf_counter_count];
+
+    perf_counters() {
+        for (size_t i = 0; i < perf_counter_count; ++i) fds[i] = open((perf_counter)i);
+    }
+    ~perf_counters() {
+#ifdef __linux__
+        for (int fd : fds) if (fd >= 0) close(fd);
+#endif
+    }
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    bool available() const {
+        return fds[(size_t)perf_counter::cycles] >= 0;
+    }
+
+    void start() {
+#ifdef __linux__
+        for (int fd : fds) if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+    void stop() {
+#ifdef __linux__
+        for (int fd : fds) if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+
+    // everything counted so far
+    // per: what to divide counts by in the report, like how many ticks were run
+    perf_values read(uint64_t per = 1) const {
+        perf_values out;
+        out.per = per == 0 ? 1 : per;
+#ifdef __linux__
+        for (size_t i = 0; i < perf_counter_count; ++i) {
+            if (fds[i] < 0) continue;
+            // value, time enabled, time running
+            uint64_t read_buf[3];
+            if (::read(fds[i], read_buf, sizeof(read_buf)) != sizeof(read_buf) || read_buf[2] == 0) continue;
+            // the kernel only counted for part of the time if it had to take turns with other counters
+            out.values[i] = (uint64_t)((double)read_buf[0] * read_buf[1] / read_buf[2]);
+        }
+#endif
+        return out;
+    }
+
+    static int open([[maybe_unused]] perf_counter c) {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        switch (c) {
+            case perf_counter::cycles: attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+            case perf_counter::instructions: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+            case perf_counter::branches: attr.config = PERF_COUNT_HW_BRANCH_INSTRUCTIONS; break;
+            case perf_counter::branch_misses: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+            case perf_counter::l1d_misses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+            case perf_counter::llc_misses: attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+            default: return -1;
+        }
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+        return -1;
+#endif
+    }
+};
+
+}
@@ -1,4 +1,11 @@
+#include <atomic>
+#include <bit>
 #include <cmath>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <thread>
 #include <vector>
 
 #include <catch2/catch_test_macros.hpp>
@@ -6,10 +13,21 @@
 #include <catch2/benchmark/catch_benchmark.hpp>
 #include <argparse/args.hpp>
 
+#include "batch.hpp"
 #include "constants.hpp"
 #include "gas.hpp"
 #include "tank.hpp"
+#include "cmaes.hpp"
 #include "optimiser.hpp"
+#include "perf_counters.hpp"
+#include "profile.hpp"
+#include "rng.hpp"
+#include "sim.hpp"
+#include "sim_cache.hpp"
+#include "surrogate.hpp"
+#include "thread_pool.hpp"
+#include "timeline.hpp"
+#include "trace.hpp"
 #include "utility.hpp"
 
 using Catch::Approx;
@@ -35,9 +53,9 @@ TEST_CASE("Gas system fundamentals") {
         const float pressure = 101.325f;
         const float volume = 1.0f;
         const float temp = 273.15f;
-        const float mols = pressure * volume / R / temp;
+        const float mols = pressure * volume / default_ruleset.R / temp;
 
-        REQUIRE(mols == Approx(pressure * volume / (R * temp)).epsilon(0.001));
+        REQUIRE(mols == Approx(pressure * volume / (default_ruleset.R * temp)).epsilon(0.001));
         REQUIRE(to_pressure(volume, mols, temp) == Approx(pressure).epsilon(0.001));
         REQUIRE(to_volume(pressure, mols, temp) == Approx(volume).epsilon(0.001));
 
@@ -45,6 +63,59 @@ TEST_CASE("Gas system fundamentals") {
         const float mix_temp = to_mix_temp(2.0f, 1.0f, 300.0f, 1.0f, 1.0f, 400.0f);
         REQUIRE(mix_temp == Approx((2.0f*1.0f*300.0f + 1.0f*1.0f*400.0f) / (2.0f*1.0f + 1.0f*1.0f)));
     }
+
+    SECTION("Cached sums") {
+        gas_tank tank;
+        auto require_synced = [&]() {
+            REQUIRE(tank.mix.cached_total_gas == Approx(tank.mix.compute_total_gas()).epsilon(1e-4f));
+            REQUIRE(tank.mix.cached_heat_capacity == Approx(tank.mix.compute_heat_capacity()).epsilon(1e-4f));
+        };
+
+        tank.mix.canister_fill_to({{plasma, 0.6f}, {tritium, 0.4f}}, 400.f, 600.f);
+        require_synced();
+        tank.mix.adjust_amount_of(frezon, 2.f);
+        tank.mix.set_amount_of(nitrogen, 1.f);
+        require_synced();
+        tank.mix.canister_fill_to(oxygen, default_ruleset.T20C, default_ruleset.pressure_cap);
+        require_synced();
+        // through reactions and the leak path
+        tank.tick_n(200);
+        require_synced();
+        REQUIRE(tank.mix.pressure() == Approx(tank.mix.compute_total_gas() * tank.mix.temperature * tank.mix.rvol).epsilon(1e-4f));
+    }
+
+    // a baked build can't leak under other rules
+#ifndef ASIM_BAKED_CONFIG
+    SECTION("Cached sums through a long leak") {
+        // leaks every tick once integrity runs out, for as long as there's gas
+        ruleset leaky;
+        leaky.tank_leak_pressure = 0.f;
+        gas_tank tank(leaky);
+        tank.mix.set_amount_of(oxygen, 1.2345678f);
+        tank.mix.set_amount_of(nitrogen, 3.1415927f);
+        tank.mix.set_amount_of(carbon_dioxide, 0.70710677f);
+        gas_tank_batch batch(200, all_reactions_mask, leaky);
+        batch.load(0, tank);
+
+        // summed again each leak tick, so not even rounding apart
+        bool synced = true;
+        for (size_t i = 0; i < 200; ++i) {
+            tank.tick();
+            synced &= tank.mix.cached_total_gas == tank.mix.compute_total_gas();
+            synced &= tank.mix.cached_heat_capacity == tank.mix.compute_heat_capacity();
+        }
+        REQUIRE(synced);
+        REQUIRE(tank.state == gas_tank::st_intact);
+        REQUIRE(tank.mix.total_gas() < 1e-20f);
+
+        batch.tick_n();
+        REQUIRE(batch.ticks[0] == 200);
+        gas_tank batched(leaky);
+        batch.store(0, batched);
+        REQUIRE(batched.mix.cached_total_gas == tank.mix.cached_total_gas);
+        REQUIRE(batched.mix.cached_heat_capacity == tank.mix.cached_heat_capacity);
+    }
+#endif
 }
 
 TEST_CASE("Vector math operations") {
@@ -108,7 +179,7 @@ TEST_CASE("Vector math operations") {
 }
 
 TEST_CASE("Gas system performance benchmarks") {
-    gas_mixture bench_mix(tank_volume);
+    gas_mixture bench_mix(default_ruleset.tank_volume);
 
     SECTION("total_gas() calculation") {
         bench_mix.canister_fill_to({ {oxygen, 0.2f}, {nitrogen, 0.5f}, {plasma, 0.3f} }, 500.f, 3000.f);
@@ -143,6 +214,70 @@ TEST_CASE("Gas system performance benchmarks") {
     }
 }
 
+// wall time only tells how long, these tell why: run with ATMOSIM_PERF_COUNTERS=1 to print them
+TEST_CASE("Hardware counters") {
+    if (!perf_counters_requested()) return;
+    perf_counters counters;
+    if (!counters.available()) {
+        WARN("perf_event_open() failed, no counters: not Linux, perf_event_paranoid above 2, or a VM without them");
+        return;
+    }
+    const size_t runs = 20000;
+
+    SECTION("reaction_tick") {
+        gas_mixture start_mix(default_ruleset.tank_volume);
+        start_mix.canister_fill_to({ {oxygen, 10.f}, {plasma, 5.f} }, 2000.f, 1.f);
+        float sink = 0.f;
+        for (size_t i = 0; i < runs; ++i) {
+            gas_mixture mix = start_mix;
+            counters.start();
+            mix.reaction_tick();
+            counters.stop();
+            sink += mix.temperature;
+        }
+        // and keeps the ticks from being optimised out
+        REQUIRE(sink > 0.f);
+        perf_values values = counters.read(runs);
+        REQUIRE(values.has(perf_counter::cycles));
+        WARN(values.report("reaction_tick()", "tick"));
+    }
+
+    SECTION("tick_n") {
+        uint64_t ticks = 0;
+        for (size_t i = 0; i < runs / 10; ++i) {
+            gas_tank tank;
+            std::vector<std::pair<gas_ref, float>> mix = {{plasma, 0.52208485f}, {tritium, 0.47791515f}};
+            tank.mix.canister_fill_to(mix, 382.42734f + (i % 16), 684.853f);
+            tank.mix.canister_fill_to(oxygen, default_ruleset.T20C, default_ruleset.pressure_cap);
+            counters.start();
+            ticks += tank.tick_n(1000);
+            counters.stop();
+        }
+        perf_values values = counters.read(ticks);
+        REQUIRE(values.has(perf_counter::cycles));
+        WARN(values.report("tick_n()", "tick"));
+    }
+
+    SECTION("do_sim") {
+        std::vector<gas_ref> mix_gases = {plasma, tritium};
+        std::vector<gas_ref> primer_gases = {oxygen};
+        std::vector<field_restriction<bomb_data>> no_restrictions;
+        bomb_args args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, no_restrictions};
+        uint64_t ticks = 0;
+        for (size_t i = 0; i < runs / 10; ++i) {
+            // different bombs, so branches don't just learn one
+            std::vector<float> input = {380.f + (i % 64), 360.f, 800.f, default_ruleset.pressure_cap, 0.f};
+            counters.start();
+            opt_val_wrap res = do_sim(input, args);
+            counters.stop();
+            ticks += res.valid() ? res.res.ticks : 0;
+        }
+        perf_values values = counters.read(ticks);
+        REQUIRE(values.has(perf_counter::cycles));
+        WARN(values.report("do_sim()", "tick"));
+    }
+}
+
 TEST_CASE("Gas system argparse test") {
     SECTION("Gas read") {
         gas_ref read_gas1, read_gas2;
@@ -167,7 +302,7 @@ TEST_CASE("Gas system argparse test") {
 }
 
 TEST_CASE("Gas reactions") {
-    gas_mixture mix(tank_volume);
+    gas_mixture mix(default_ruleset.tank_volume);
 
     // UP TO DATE AS OF: 21.06.2025
     SECTION("Plasma fire reaction") {
@@ -255,6 +390,11 @@ TEST_CASE("Gas reactions") {
 }
 
 TEST_CASE("Tank simulation validation") {
+    // the recipes were measured under the default rules, a baked config or ATMOSIM_CONFIG with others changes their results
+    if (default_ruleset != ruleset{}) {
+        WARN("not the default rules, skipping the validation recipes");
+        return;
+    }
     gas_tank tank;
 
     // UP TO DATE AS OF: 03.07.2025
@@ -268,7 +408,7 @@ TEST_CASE("Tank simulation validation") {
 
         std::vector<std::pair<gas_ref, float>> mix = {{plasma, plasma_frac}, {tritium, tritium_frac}};
         tank.mix.canister_fill_to(mix, mix_temp, mix_pressure);
-        tank.mix.canister_fill_to(oxygen, T20C, pressure_cap);
+        tank.mix.canister_fill_to(oxygen, default_ruleset.T20C, default_ruleset.pressure_cap);
 
         size_t ticks = tank.tick_n(ticks_expected * 2);
 
@@ -290,7 +430,7 @@ TEST_CASE("Tank simulation validation") {
 
         std::vector<std::pair<gas_ref, float>> mix = {{oxygen, oxygen_frac}, {tritium, tritium_frac}, {nitrous_oxide, oxide_frac}};
         tank.mix.canister_fill_to(mix, mix_temp, mix_pressure);
-        tank.mix.canister_fill_to(frezon, thir_temp, pressure_cap);
+        tank.mix.canister_fill_to(frezon, thir_temp, default_ruleset.pressure_cap);
 
         size_t ticks = tank.tick_n(ticks_expected * 2);
 
@@ -323,6 +463,779 @@ TEST_CASE("Tank simulation validation") {
         REQUIRE(tank.calc_radius() == Catch::Approx(radius_expected).epsilon(0.01f));
         REQUIRE(ticks == ticks_expected);
     }
+
+#ifndef ASIM_BAKED_CONFIG
+    SECTION("Steady tank fast-forward") {
+        // frezon production that converts nothing: it reacts every tick but the tank never changes
+        ruleset rules;
+        rules.frezon_production_conversion_rate = std::numeric_limits<float>::infinity();
+        gas_tank steady(rules);
+        steady.mix.canister_fill_to({{oxygen, 0.4f}, {nitrogen, 0.3f}, {tritium, 0.3f}}, 50.f, 500.f);
+        gas_tank naive = steady;
+
+        size_t naive_ticks = 0;
+        while (naive_ticks < 1000) {
+            ++naive_ticks;
+            if (!naive.tick() || naive.state != naive.st_intact) break;
+        }
+        REQUIRE(steady.tick_n(1000) == naive_ticks);
+        REQUIRE(naive_ticks == 1000);
+        REQUIRE(steady.mix.pressure() == naive.mix.pressure());
+        REQUIRE(steady.mix.temperature == naive.mix.temperature);
+        REQUIRE(steady.integrity == naive.integrity);
+    }
+#endif
+}
+
+TEST_CASE("Tick traces") {
+    gas_tank tank;
+    tank.mix.canister_fill_to({{plasma, 0.52208485f}, {tritium, 0.47791515f}}, 382.42734f, 684.853f);
+    tank.mix.canister_fill_to(oxygen, default_ruleset.T20C, default_ruleset.pressure_cap);
+    gas_tank plain = tank;
+    size_t plain_ticks = plain.tick_n(100);
+
+    SECTION("Observing doesn't change the simulation") {
+        tick_trace trace(256);
+        REQUIRE(tank.tick_n(100, all_reactions_mask, 0.f, trace) == plain_ticks);
+        REQUIRE(tank.mix.pressure() == plain.mix.pressure());
+        REQUIRE(trace.size() == plain_ticks);
+
+        size_t last = trace.slot(trace.size() - 1);
+        REQUIRE(trace.ticks[last] == plain_ticks);
+        REQUIRE(trace.states[last] == gas_tank::st_exploded);
+        REQUIRE(trace.pressures[last] == Approx(plain.mix.pressure()));
+        REQUIRE(trace.amounts[plasma.idx * trace.capacity + last] == plain.mix.amount_of(plasma));
+        bool burnt_plasma = false;
+        for (size_t i = 0; i < trace.size(); ++i) {
+            burnt_plasma |= (trace.reactions[trace.slot(i)] & r_plasma_fire) != 0;
+        }
+        REQUIRE(burnt_plasma);
+    }
+
+    SECTION("Ring keeps the last ticks") {
+        tick_trace trace(16);
+        tank.tick_n(100, all_reactions_mask, 0.f, trace);
+        REQUIRE(trace.recorded == plain_ticks);
+        REQUIRE(trace.size() == 16);
+        for (size_t i = 0; i < trace.size(); ++i) {
+            REQUIRE(trace.ticks[trace.slot(i)] == plain_ticks - 15 + i);
+        }
+    }
+
+    SECTION("Traces read back") {
+        tick_trace long_trace(256), short_trace(16);
+        gas_tank other = tank;
+        tank.tick_n(100, all_reactions_mask, 0.f, long_trace);
+        other.tick_n(100, all_reactions_mask, 0.f, short_trace);
+
+        std::stringstream file;
+        long_trace.write(file, "long");
+        short_trace.write(file, "short");
+
+        tick_trace read(1);
+        std::string label;
+        REQUIRE(read.read(file, label));
+        REQUIRE(label == "long");
+        REQUIRE(read.to_csv() == long_trace.to_csv());
+        REQUIRE(read.read(file, label));
+        REQUIRE(label == "short");
+        REQUIRE(read.to_csv() == short_trace.to_csv());
+        REQUIRE(!read.read(file, label));
+
+        // header and a line per tick
+        std::string csv = read.to_csv();
+        REQUIRE(std::count(csv.begin(), csv.end(), '\n') == 17);
+        REQUIRE(csv.starts_with("tick,temperature,pressure,oxygen,"));
+    }
+}
+
+TEST_CASE("Batched tank simulation") {
+    // a spread of tanks, including the validation recipes above, all of which should match the scalar kernel exactly
+    std::vector<gas_tank> tanks;
+    {
+        gas_tank tank;
+        tank.mix.canister_fill_to({{plasma, 0.52208485f}, {tritium, 1.f - 0.52208485f}}, 382.42734f, 684.853f);
+        tank.mix.canister_fill_to(oxygen, default_ruleset.T20C, default_ruleset.pressure_cap);
+        tanks.push_back(tank);
+    }
+    {
+        gas_tank tank;
+        tank.mix.canister_fill_to({{oxygen, 0.14539835f}, {tritium, 0.16864481f}, {nitrous_oxide, 0.6859568f}}, 112.840805f, 726.60645f);
+        tank.mix.canister_fill_to(frezon, 542.761f, default_ruleset.pressure_cap);
+        tanks.push_back(tank);
+    }
+    {
+        gas_tank tank;
+        tank.mix.canister_fill_to({{nitrous_oxide, 0.4931195f}, {tritium, 0.50688046f}}, 159.82f, 476.4f);
+        tank.mix.canister_fill_to({{oxygen, 0.028119187f}, {frezon, 0.9718808f}}, 528.35f, 788.9f);
+        tanks.push_back(tank);
+    }
+    const std::vector<std::vector<std::pair<gas_ref, float>>> fuels = {
+        {{plasma, 0.6f}, {tritium, 0.4f}}, {{tritium, 1.f}}, {{plasma, 1.f}},
+        {{nitrous_oxide, 0.5f}, {tritium, 0.5f}}, {{nitrium, 0.3f}, {plasma, 0.7f}}
+    };
+    const std::vector<std::vector<std::pair<gas_ref, float>>> primers = {
+        {{oxygen, 1.f}}, {{oxygen, 0.5f}, {frezon, 0.5f}}, {{oxygen, 0.9f}, {nitrogen, 0.1f}}
+    };
+    for (size_t i = 0; i < 37; ++i) {
+        gas_tank tank;
+        tank.mix.canister_fill_to(fuels[i % fuels.size()], 50.f + 17.f * i, 200.f + 13.f * i);
+        tank.mix.canister_fill_to(primers[i % primers.size()], 293.15f + 11.f * i, default_ruleset.pressure_cap);
+        tanks.push_back(tank);
+    }
+
+    const size_t tick_cap = 5000;
+    std::vector<gas_tank> scalar_tanks = tanks;
+    std::vector<size_t> scalar_ticks;
+    for (gas_tank& tank : scalar_tanks) {
+        scalar_ticks.push_back(tank.tick_n(tick_cap));
+    }
+
+    SECTION("Batch matches scalar simulation") {
+        // refill lanes as they retire, like do_sim_batch does
+        gas_tank_batch batch(tick_cap);
+        std::vector<size_t> lane_idx(batch_width, (size_t)-1);
+        std::vector<gas_tank> batch_tanks = tanks;
+        std::vector<size_t> batch_ticks(tanks.size(), 0);
+        size_t next = 0;
+        while (true) {
+            bool any_held = false;
+            for (size_t l = 0; l < batch_width; ++l) {
+                if (lane_idx[l] != (size_t)-1 && !batch.active[l]) {
+                    batch.store(l, batch_tanks[lane_idx[l]]);
+                    batch_ticks[lane_idx[l]] = batch.ticks[l];
+                    lane_idx[l] = -1;
+                }
+                if (lane_idx[l] == (size_t)-1 && next < tanks.size()) {
+                    batch.load(l, tanks[next]);
+                    lane_idx[l] = next++;
+                }
+                any_held |= lane_idx[l] != (size_t)-1;
+            }
+            if (!any_held) break;
+            batch.tick();
+        }
+
+        for (size_t i = 0; i < tanks.size(); ++i) {
+            REQUIRE(batch_ticks[i] == scalar_ticks[i]);
+            REQUIRE(batch_tanks[i].state == scalar_tanks[i].state);
+            REQUIRE(batch_tanks[i].integrity == scalar_tanks[i].integrity);
+            REQUIRE(batch_tanks[i].mix.temperature == scalar_tanks[i].mix.temperature);
+            for (size_t g = 0; g < gas_count; ++g) {
+                REQUIRE(batch_tanks[i].mix.amounts[g] == scalar_tanks[i].mix.amounts[g]);
+            }
+        }
+    }
+
+    SECTION("Gas subset matches full simulation") {
+        REQUIRE(string_gas_map.at("oxygen") == oxygen);
+        REQUIRE(string_gas_map.at("nitrium") == nitrium);
+        REQUIRE(reachable_gases(mask_of(oxygen) | mask_of(plasma)) == fire_gases_mask);
+        REQUIRE(reachable_gases(mask_of(nitrogen) | mask_of(frezon)) == (mask_of(nitrogen) | mask_of(frezon) | mask_of(nitrous_oxide) | mask_of(oxygen)));
+        REQUIRE(possible_reactions(mask_of(oxygen) | mask_of(plasma)) == (r_plasma_fire | r_tritium_fire));
+        REQUIRE(possible_reactions(mask_of(tritium) | mask_of(plasma)) == 0);
+        REQUIRE(possible_reactions(mask_of(oxygen) | mask_of(nitrogen) | mask_of(tritium)) == (all_reactions_mask & ~r_nitrium_decomposition & ~r_plasma_fire));
+
+        for (size_t i = 0; i < tanks.size(); ++i) {
+            gas_mask gases = 0;
+            for (size_t g = 0; g < gas_count; ++g) {
+                if (tanks[i].mix.amounts[g] != 0.f) gases |= mask_of(gas_ref{g});
+            }
+            gases = reachable_gases(gases);
+            gas_tank tank = tanks[i];
+            size_t ticks = tick_n_subset(tank, tick_cap, gases, possible_reactions(gases));
+
+            REQUIRE(ticks == scalar_ticks[i]);
+            REQUIRE(tank.state == scalar_tanks[i].state);
+            REQUIRE(tank.integrity == scalar_tanks[i].integrity);
+            REQUIRE(tank.mix.temperature == scalar_tanks[i].mix.temperature);
+            for (size_t g = 0; g < gas_count; ++g) {
+                REQUIRE(tank.mix.amounts[g] == scalar_tanks[i].mix.amounts[g]);
+            }
+        }
+    }
+
+    SECTION("Batch tick limit") {
+        gas_tank_batch batch(10);
+        batch.load(0, tanks[2]);
+        batch.tick_n();
+
+        REQUIRE(batch.ticks[0] == 10);
+        REQUIRE(batch.active_count() == 0);
+    }
+}
+
+TEST_CASE("Simulation cache") {
+    std::vector<gas_ref> mix_gases = {plasma, tritium};
+    std::vector<gas_ref> primer_gases = {oxygen};
+    std::vector<field_restriction<bomb_data>> no_restrictions;
+    sim_cache cache(256, 4);
+    bomb_args args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, no_restrictions, &cache};
+    bomb_args uncached_args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, no_restrictions};
+
+    // target temp, fuel temp, primer temp, fill pressure, plasma:tritium log-ratio
+    std::vector<float> input = {400.f, 380.f, 800.f, default_ruleset.pressure_cap, 0.f};
+
+    SECTION("Cached results match simulation") {
+        opt_val_wrap direct = do_sim(input, uncached_args);
+        opt_val_wrap first = do_sim(input, args);
+        REQUIRE(cache.misses() == 1);
+        REQUIRE(cache.hits() == 0);
+
+        // a nearby input rounding to the same lattice point is a hit
+        std::vector<float> nearby = input;
+        nearby[0] += 0.001f;
+        opt_val_wrap second = do_sim(nearby, args);
+        REQUIRE(cache.hits() == 1);
+
+        REQUIRE(direct.valid());
+        REQUIRE(first.valid());
+        REQUIRE(second.valid());
+        REQUIRE(first.res.fin_radius == direct.res.fin_radius);
+        REQUIRE(second.res.fin_radius == direct.res.fin_radius);
+        REQUIRE(second.res.ticks == direct.res.ticks);
+    }
+
+    SECTION("Batch uses the cache") {
+        std::vector<std::vector<float>> inputs(20, input);
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            inputs[i][0] += (i % 5) * 1.f;
+        }
+        std::vector<opt_val_wrap> results(inputs.size());
+        do_sim_batch(inputs, args, results);
+        REQUIRE(cache.hits() + cache.misses() == inputs.size());
+
+        // everything is cached now
+        size_t hits = cache.hits();
+        do_sim_batch(inputs, args, results);
+        REQUIRE(cache.hits() == hits + inputs.size());
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            opt_val_wrap direct = do_sim(inputs[i], uncached_args);
+            REQUIRE(results[i].valid() == direct.valid());
+            if (direct.valid()) REQUIRE(results[i].res.fin_radius == direct.res.fin_radius);
+        }
+    }
+
+    SECTION("Eviction keeps the cache bounded") {
+        sim_cache small(8, 2);
+        for (size_t i = 0; i < 100; ++i) {
+            sim_key key(mix_gases, primer_gases);
+            key.push((float)i);
+            small.put(key, {});
+        }
+        size_t found = 0;
+        for (size_t i = 0; i < 100; ++i) {
+            sim_key key(mix_gases, primer_gases);
+            key.push((float)i);
+            sim_result out;
+            found += small.get(key, out);
+        }
+        REQUIRE(found <= 8);
+        REQUIRE(found > 0);
+
+        // gas sets are part of the key
+        sim_key a(mix_gases, primer_gases), b(primer_gases, mix_gases);
+        REQUIRE(!(a == b));
+    }
+}
+
+TEST_CASE("Profiling") {
+    std::vector<gas_ref> mix_gases = {plasma, tritium};
+    std::vector<gas_ref> primer_gases = {oxygen};
+    std::vector<field_restriction<bomb_data>> no_restrictions;
+    bomb_args args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, no_restrictions};
+    std::vector<float> input = {400.f, 380.f, 800.f, default_ruleset.pressure_cap, 0.f};
+    // mix-to temperature isn't between the two
+    std::vector<float> misordered = {900.f, 380.f, 800.f, default_ruleset.pressure_cap, 0.f};
+
+    profile_reset();
+    opt_val_wrap res = do_sim(input, args);
+    do_sim(misordered, args);
+    std::vector<opt_val_wrap> batch_res(4);
+    do_sim_batch(std::vector<std::vector<float>>(4, input), args, batch_res);
+    profile_data data = profile_merged();
+
+    if constexpr (profiling_enabled) {
+        REQUIRE(data.events[(size_t)profile_event::simulated] == 5);
+        REQUIRE(data.events[(size_t)profile_event::rejected_order] == 1);
+        REQUIRE(data.calls[(size_t)profile_phase::sim_read] == 6);
+        REQUIRE(data.calls[(size_t)profile_phase::sim_fill] == 5);
+        REQUIRE(data.calls[(size_t)profile_phase::sim_tick] > 0);
+        // every simulated bomb lands in the bucket of its tick count
+        REQUIRE(data.ticks[std::bit_width((size_t)res.res.ticks)] == 5);
+        uint64_t ticks = std::accumulate(std::begin(data.reactions), std::end(data.reactions), (uint64_t)0);
+        REQUIRE(ticks == 5 * res.res.ticks);
+        REQUIRE(profile_report().find("fill tank") != std::string::npos);
+    } else {
+        // compiled out
+        REQUIRE(data.events[(size_t)profile_event::simulated] == 0);
+        REQUIRE(data.calls[(size_t)profile_phase::sim_read] == 0);
+    }
+}
+
+TEST_CASE("Timeline") {
+    timeline_start();
+    timeline_thread_name("tester");
+    {
+        timeline_span span("outer", "round", 3);
+        timeline_instant("marker");
+    }
+    std::thread other([]{
+        timeline_thread_name("other");
+        timeline_span span("inner");
+    });
+    other.join();
+    timeline_stop();
+    // not recorded
+    timeline_instant("stopped");
+
+    std::ostringstream out;
+    timeline_write(out);
+    std::string json = out.str();
+    REQUIRE(json.find("\"traceEvents\"") != std::string::npos);
+    REQUIRE(json.find(R"("name":"outer")") != std::string::npos);
+    REQUIRE(json.find(R"("args":{"round":3})") != std::string::npos);
+    REQUIRE(json.find(R"("ph":"i","name":"marker")") != std::string::npos);
+    // the other thread exited, its events are still there
+    REQUIRE(json.find(R"("name":"inner")") != std::string::npos);
+    REQUIRE(json.find(R"("args":{"name":"tester"})") != std::string::npos);
+    REQUIRE(json.find(R"("args":{"name":"other"})") != std::string::npos);
+    REQUIRE(json.find("stopped") == std::string::npos);
+
+    // starting again forgets the last run
+    timeline_start();
+    timeline_stop();
+    std::ostringstream empty;
+    timeline_write(empty);
+    REQUIRE(empty.str().find("outer") == std::string::npos);
+}
+
+TEST_CASE("Materialised results") {
+    std::vector<gas_ref> mix_gases = {plasma, tritium};
+    std::vector<gas_ref> primer_gases = {oxygen, nitrogen};
+    std::vector<field_restriction<bomb_data>> no_restrictions;
+    bomb_args args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, no_restrictions};
+
+    std::vector<float> input = {400.f, 380.f, 800.f, default_ruleset.pressure_cap, 0.3f, -1.f};
+    opt_val_wrap res = do_sim(input, args);
+    REQUIRE(res.valid());
+    REQUIRE(res.data == nullptr);
+
+    // the full bomb is simulated again and has to agree with the compact result
+    materialise_result(input, args, res);
+    REQUIRE(res.data != nullptr);
+    REQUIRE(res.data->optstat == res.res.optstat);
+    REQUIRE(res.data->fin_radius == res.res.fin_radius);
+    REQUIRE(res.data->fin_pressure == res.res.fin_pressure);
+    REQUIRE(res.data->ticks == res.res.ticks);
+    REQUIRE(res.data->mix_gases.size() == 2);
+    REQUIRE(res.data->primer_ratios.size() == 2);
+}
+
+TEST_CASE("Restrictions") {
+    std::vector<gas_ref> mix_gases = {plasma, tritium};
+    std::vector<gas_ref> primer_gases = {oxygen};
+    std::vector<field_restriction<bomb_data>> no_restrictions;
+    bomb_args free_args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, no_restrictions};
+
+    std::vector<float> input = {400.f, 380.f, 800.f, default_ruleset.pressure_cap, 0.f};
+    opt_val_wrap free = do_sim(input, free_args);
+    REQUIRE(free.valid());
+    const float ticks = free.res.ticks;
+
+    SECTION("Tick bound stops the simulation") {
+        std::vector<field_restriction<bomb_data>> met = {{bomb_data::ticks_field, 0.f, ticks}};
+        std::vector<field_restriction<bomb_data>> broken = {{bomb_data::ticks_field, 0.f, ticks - 1.f}};
+        bomb_args met_args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, met};
+        bomb_args broken_args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, broken};
+        REQUIRE(met_args.tick_limit == (size_t)ticks + 1);
+        REQUIRE(broken_args.tick_limit == (size_t)ticks);
+
+        opt_val_wrap met_res = do_sim(input, met_args);
+        REQUIRE(met_res.valid());
+        REQUIRE(met_res.res.fin_radius == free.res.fin_radius);
+        REQUIRE(met_res.res.ticks == free.res.ticks);
+        REQUIRE(!do_sim(input, broken_args).valid());
+
+        std::vector<std::vector<float>> inputs(3, input);
+        std::vector<opt_val_wrap> results(inputs.size());
+        do_sim_batch(inputs, broken_args, results);
+        REQUIRE(!results[0].valid());
+        do_sim_batch(inputs, met_args, results);
+        REQUIRE(results[0].res.fin_radius == free.res.fin_radius);
+    }
+
+    SECTION("Radius bound gives up early") {
+        // what 40 tiles needs under the default rules, as a radius under the rules in use, so baked rules get the same bound
+        float min_radius = std::sqrt((ruleset{}.tank_fragment_pressure + ruleset{}.tank_fragment_scale * 40.f * 40.f - default_ruleset.tank_fragment_pressure) / default_ruleset.tank_fragment_scale);
+        std::vector<field_restriction<bomb_data>> high = {{bomb_data::radius_field, min_radius, 1000.f}};
+        sim_cache cache(64);
+        bomb_args high_args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, high, &cache};
+        REQUIRE(high_args.min_pressure == Approx(default_ruleset.tank_fragment_pressure + default_ruleset.tank_fragment_scale * min_radius * min_radius));
+        REQUIRE(free_args.min_pressure == 0.f);
+
+        // a 12.3 tile bomb, its pressure bound falls under what 40 tiles needs well before it explodes
+        gas_tank tank;
+        tank.mix.canister_fill_to({{plasma, 0.52208485f}, {tritium, 0.47791515f}}, 382.42734f, 684.853f);
+        tank.mix.canister_fill_to(oxygen, default_ruleset.T20C, default_ruleset.pressure_cap);
+        gas_tank plain = tank;
+        size_t plain_ticks = plain.tick_n(1000, high_args.reactions);
+        REQUIRE(plain.state == gas_tank::st_exploded);
+        tick_trace trace(64);
+        REQUIRE(tank.tick_n(1000, high_args.reactions, high_args.min_pressure, trace) == gas_tank::gave_up);
+        REQUIRE(trace.recorded > 0);
+        REQUIRE(trace.recorded < plain_ticks);
+
+        // invalid whatever the best so far is, so not dominated and cached
+        opt_val_wrap res = do_sim(input, high_args);
+        REQUIRE(!res.valid());
+        REQUIRE(!res.res.dominated);
+        REQUIRE(cache.misses() == 1);
+        std::vector<std::vector<float>> inputs(3, input);
+        std::vector<opt_val_wrap> results(inputs.size());
+        do_sim_batch(inputs, high_args, results);
+        REQUIRE(!results[0].valid());
+        REQUIRE(!results[0].res.dominated);
+        REQUIRE(cache.hits() == 3);
+    }
+
+    SECTION("Failed pre-restrictions skip the simulation") {
+        std::vector<field_restriction<bomb_data>> cold = {{bomb_data::temperature_field, 0.f, 300.f}};
+        bomb_args cold_args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, cold, no_restrictions};
+        REQUIRE(!do_sim(input, cold_args).valid());
+
+        std::vector<std::vector<float>> inputs(3, input);
+        std::vector<opt_val_wrap> results(inputs.size());
+        do_sim_batch(inputs, cold_args, results);
+        REQUIRE(!results[0].valid());
+    }
+
+    SECTION("Unsatisfiable restrictions") {
+        std::vector<field_restriction<bomb_data>> empty = {{bomb_data::radius_field, 5.f, 1.f}};
+        std::vector<field_restriction<bomb_data>> too_long = {{bomb_data::ticks_field, 2000.f, 3000.f}};
+        REQUIRE(restrictions_satisfiable(no_restrictions, no_restrictions, 1000));
+        REQUIRE(!restrictions_satisfiable(empty, no_restrictions, 1000));
+        REQUIRE(!restrictions_satisfiable(no_restrictions, empty, 1000));
+        REQUIRE(!restrictions_satisfiable(no_restrictions, too_long, 1000));
+        REQUIRE(restrictions_satisfiable(no_restrictions, too_long, 5000));
+    }
+}
+
+TEST_CASE("Pruning") {
+    SECTION("Pressure bound holds") {
+        for (float plasma_frac : {0.f, 0.3f, 1.f}) {
+            for (float fuel_temp : {300.f, 800.f}) {
+                gas_tank tank;
+                tank.mix.canister_fill_to({{plasma, plasma_frac}, {tritium, 1.f - plasma_frac}}, fuel_temp, 300.f);
+                tank.mix.canister_fill_to({{oxygen, 0.9f}, {carbon_dioxide, 0.1f}}, 1000.f, default_ruleset.pressure_cap);
+                reaction_mask reactions = possible_reactions(fire_gases_mask);
+
+                float bound = tank.mix.pressure_bound(reactions);
+                while (tank.state == gas_tank::st_intact && tank.tick()) {
+                    REQUIRE(tank.mix.pressure() <= bound);
+                    float next_bound = tank.mix.pressure_bound(reactions);
+                    REQUIRE(next_bound <= bound * 1.001f);
+                    bound = next_bound;
+                }
+            }
+        }
+        // no bound worked out for anything but fires
+        gas_mixture mix(default_ruleset.tank_volume);
+        mix.canister_fill_to(nitrous_oxide, 1000.f, 500.f);
+        REQUIRE(mix.pressure_bound(r_N2O_decomposition) == std::numeric_limits<float>::max());
+    }
+
+    std::vector<gas_ref> mix_gases = {plasma, tritium};
+    std::vector<gas_ref> primer_gases = {oxygen};
+    std::vector<field_restriction<bomb_data>> no_restrictions;
+    std::vector<float> input = {400.f, 380.f, 800.f, default_ruleset.pressure_cap, 0.f};
+    bomb_args free_args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, no_restrictions};
+    opt_val_wrap free = do_sim(input, free_args);
+    REQUIRE(free.valid());
+
+    SECTION("Bombs that can beat the best are simulated") {
+        radius_to_beat to_beat;
+        to_beat.offer(free.res.fin_radius);
+        to_beat.offer(0.f);
+        REQUIRE(to_beat.radius == free.res.fin_radius);
+        bomb_args args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, no_restrictions, nullptr, &default_ruleset, &to_beat};
+
+        opt_val_wrap res = do_sim(input, args);
+        REQUIRE(res.valid());
+        REQUIRE(res.res.fin_radius == free.res.fin_radius);
+        REQUIRE(to_beat.dominated == 0);
+    }
+
+    SECTION("Bombs that can't are given up on") {
+        radius_to_beat to_beat;
+        to_beat.offer(1000.f);
+        sim_cache cache(64);
+        bomb_args args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, no_restrictions, &cache, &default_ruleset, &to_beat};
+
+        opt_val_wrap res = do_sim(input, args);
+        REQUIRE(!res.valid());
+        REQUIRE(res.res.dominated);
+        REQUIRE(to_beat.dominated == 1);
+
+        std::vector<std::vector<float>> inputs(3, input);
+        std::vector<opt_val_wrap> results(inputs.size());
+        do_sim_batch(inputs, args, results);
+        REQUIRE(results[2].res.dominated);
+        REQUIRE(to_beat.dominated == 4);
+        // a better best may not come along, but the result still depends on it
+        REQUIRE(cache.hits() == 0);
+        REQUIRE(cache.misses() == 4);
+    }
+}
+
+TEST_CASE("Rulesets") {
+    SECTION("Defaults") {
+        // an empty config changes nothing
+        ruleset loaded = ruleset::load(toml::table());
+        REQUIRE(loaded.heat_scale == ruleset{}.heat_scale);
+        REQUIRE(loaded.fire_plasma_energy_released == ruleset{}.fire_plasma_energy_released);
+        REQUIRE(loaded.super_saturation_ends == ruleset{}.super_saturation_ends);
+        REQUIRE(loaded.tank_leak_pressure == ruleset{}.tank_leak_pressure);
+        REQUIRE(oxygen.specific_heat(loaded) == 20.f * loaded.heat_scale);
+    }
+
+    SECTION("Compile-time rulesets") {
+        static constexpr config_value values[] = {{"Cvars", "HeatScale", 0.5f}, {"Plasma", "SuperSaturationThreshold", 30.f}, {"Tank", "Volume", 10.f}};
+        static constexpr ruleset baked = ruleset::from_values(values);
+        // scaled and derived values follow the config like with load()
+        STATIC_REQUIRE(baked.fire_plasma_energy_released == 160000.f * 0.5f);
+        STATIC_REQUIRE(baked.super_saturation_ends == 10.f);
+        STATIC_REQUIRE(baked.tank_volume == 10.f);
+        STATIC_REQUIRE(ruleset::from_values({}).tank_leak_pressure == ruleset{}.tank_leak_pressure);
+        // derived defaults follow what they're derived from, and given values override them
+        static constexpr config_value more_values[] = {{"Atmospherics", "OneAtmosphere", 100.f}, {"Tritium", "FireEnergyReleased", 1000.f}, {"Tank", "RupturePressure", 3000.f}};
+        static constexpr ruleset more = ruleset::from_values(more_values);
+        STATIC_REQUIRE(more.tank_leak_pressure == 30.f * 100.f);
+        STATIC_REQUIRE(more.tank_rupture_pressure == 3000.f);
+        STATIC_REQUIRE(more.fire_hydrogen_energy_released == 1000.f * ruleset{}.heat_scale);
+    }
+
+    // a baked build can't simulate other rules
+#ifndef ASIM_BAKED_CONFIG
+    std::vector<gas_ref> mix_gases = {plasma, tritium};
+    std::vector<gas_ref> primer_gases = {oxygen};
+    std::vector<field_restriction<bomb_data>> no_restrictions;
+    ruleset scaled;
+    scaled.tank_fragment_scale *= 4.f;
+    bomb_args args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, no_restrictions};
+    bomb_args scaled_args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::radius_field, no_restrictions, no_restrictions, nullptr, &scaled};
+
+    std::vector<float> input = {400.f, 380.f, 800.f, default_ruleset.pressure_cap, 0.f};
+
+    SECTION("Rules change results") {
+        opt_val_wrap base = do_sim(input, args);
+        opt_val_wrap other = do_sim(input, scaled_args);
+        REQUIRE(base.valid());
+        REQUIRE(other.valid());
+        REQUIRE(other.res.ticks == base.res.ticks);
+        REQUIRE(other.res.fin_radius == Approx(base.res.fin_radius * 0.5f).epsilon(0.001));
+
+        // batches simulate under their own rules too
+        std::vector<std::vector<float>> inputs(3, input);
+        std::vector<opt_val_wrap> results(inputs.size());
+        do_sim_batch(inputs, scaled_args, results);
+        REQUIRE(results[0].res.fin_radius == other.res.fin_radius);
+    }
+
+    SECTION("Worst result across rulesets") {
+        multi_bomb_args multi{{args, scaled_args}, true};
+        opt_val_wrap res = do_sim_multi(input, multi);
+        REQUIRE(res.res.fin_radius == do_sim(input, scaled_args).res.fin_radius);
+
+        std::vector<std::vector<float>> inputs(2, input);
+        inputs[1][1] = 500.f; // hotter fuel than primer can't mix to 400K
+        std::vector<opt_val_wrap> results(inputs.size());
+        do_sim_multi_batch(inputs, multi, results);
+        REQUIRE(results[0].res.fin_radius == res.res.fin_radius);
+        REQUIRE(!results[1].valid());
+
+        // the bomb shown is the one its rating came from
+        opt_val_wrap materialised = res;
+        materialise_multi(input, multi, materialised);
+        REQUIRE(materialised.data);
+        REQUIRE(materialised.data->fin_radius == res.res.fin_radius);
+
+        // and a trace of it replays that same bomb, even when it's not the first ruleset's
+        ruleset fragile;
+        fragile.tank_leak_pressure *= 0.5f;
+        fragile.tank_rupture_pressure *= 0.5f;
+        fragile.tank_fragment_pressure *= 0.5f;
+        bomb_args long_args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::ticks_field, no_restrictions, no_restrictions};
+        bomb_args fragile_args{mix_gases, primer_gases, false, 0.1f, 0.01f, 0.00001f, 1000, bomb_data::ticks_field, no_restrictions, no_restrictions, nullptr, &fragile};
+        multi_bomb_args fragile_multi{{long_args, fragile_args}, true};
+        std::vector<float> slow_input = {375.f, 382.42734f, default_ruleset.T20C, 684.853f, 0.478f};
+        opt_val_wrap fragile_res = do_sim_multi(slow_input, fragile_multi);
+        REQUIRE(fragile_res.res.ticks < do_sim(slow_input, long_args).res.ticks);
+        const bomb_args& used = materialise_multi(slow_input, fragile_multi, fragile_res);
+        REQUIRE(&used == &fragile_multi.per_ruleset[1]);
+        REQUIRE(fragile_res.data);
+        tick_trace trace(4);
+        trace_bomb(fragile_res.data->serialize(), used, trace);
+        const gas_tank& tank = fragile_res.data->tank;
+        size_t last = trace.slot(trace.size() - 1);
+        REQUIRE(trace.ticks[last] == (uint32_t)fragile_res.data->ticks);
+        REQUIRE(trace.temperatures[last] == tank.mix.temperature);
+        REQUIRE(trace.states[last] == tank.state);
+        REQUIRE(trace.integrities[last] == tank.integrity);
+
+        sim_result valid{1.f, 0.f, 0.f, 0.f, 0, true}, better{2.f, 0.f, 0.f, 0.f, 0, true}, invalid{};
+        REQUIRE(worse_result(valid, better, true).optstat == 1.f);
+        REQUIRE(worse_result(valid, better, false).optstat == 2.f);
+        REQUIRE(!worse_result(better, invalid, true).valid);
+    }
+#endif
+}
+
+TEST_CASE("Thread pool") {
+    thread_pool pool(4);
+    REQUIRE(pool.size() == 4);
+
+    SECTION("Runs every task") {
+        std::atomic<size_t> count{0};
+        for (size_t i = 0; i < 1000; ++i) {
+            pool.submit([&]{ ++count; });
+        }
+        pool.wait_idle();
+        REQUIRE(count == 1000);
+    }
+
+    SECTION("Tasks submitted by tasks") {
+        // each chain resubmits itself until it has run 100 times
+        std::atomic<size_t> count{0};
+        std::function<void(size_t)> chain = [&](size_t left) {
+            ++count;
+            if (left > 1) pool.submit([&chain, left]{ chain(left - 1); });
+        };
+        for (size_t i = 0; i < 16; ++i) {
+            pool.submit([&chain]{ chain(100); });
+        }
+        pool.wait_idle();
+        REQUIRE(count == 1600);
+    }
+}
+
+TEST_CASE("Logging") {
+    // nothing else may be mid-write while we swap out std::cout's buffer
+    log_flush();
+    std::ostringstream out;
+    std::streambuf* was = std::cout.rdbuf(out.rdbuf());
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([t]{
+            for (size_t i = 0; i < 100; ++i) {
+                log([&]{ return std::format("{} {}", t, i); }, LOG_DEBUG, LOG_DEBUG, true, false);
+            }
+            log([]{ return "hidden"; }, LOG_INFO, LOG_DEBUG);
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    log_flush();
+    std::cout.rdbuf(was);
+
+    // every line written, each thread's in the order it logged them
+    std::istringstream in(out.str());
+    std::vector<size_t> next(4, 0);
+    size_t t, i, lines = 0;
+    bool in_order = true;
+    while (in >> t >> i) {
+        in_order &= i == next[t]++;
+        ++lines;
+    }
+    REQUIRE(in_order);
+    REQUIRE(lines == 400);
+    REQUIRE(out.str().find("hidden") == std::string::npos);
+}
+
+TEST_CASE("Log flush") {
+    // std::cout's buffer, readable while the writer writes to it
+    struct locked_buf : std::streambuf {
+        std::mutex mutex;
+        std::string text;
+
+        int overflow(int c) override {
+            std::lock_guard lock(mutex);
+            if (c != traits_type::eof()) text += (char)c;
+            return c;
+        }
+        std::streamsize xsputn(const char* s, std::streamsize n) override {
+            std::lock_guard lock(mutex);
+            text.append(s, n);
+            return n;
+        }
+        bool contains(const std::string& line) {
+            std::lock_guard lock(mutex);
+            return text.find(line) != std::string::npos;
+        }
+    };
+
+    log_flush();
+    locked_buf buf;
+    std::streambuf* was = std::cout.rdbuf(&buf);
+
+    // once log_flush() returns, our own lines are out, whoever else is logging meanwhile
+    std::atomic<size_t> missing = 0;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([t, &buf, &missing]{
+            for (size_t i = 0; i < 200; ++i) {
+                log([&]{ return std::format("{} {}", t, i); }, LOG_DEBUG, LOG_DEBUG, true, false);
+                log_flush();
+                missing += !buf.contains(std::format("{} {}\n", t, i));
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    log_flush();
+    std::cout.rdbuf(was);
+
+    REQUIRE(missing == 0);
+}
+
+TEST_CASE("Random streams") {
+    SECTION("Matches the reference") {
+        xoshiro256ss rng;
+        rng.s[0] = 1; rng.s[1] = 2; rng.s[2] = 3; rng.s[3] = 4;
+        REQUIRE(rng() == 11520);
+        REQUIRE(rng() == 0);
+        REQUIRE(rng() == 1509978240);
+        REQUIRE(rng() == 1215971899390074240);
+    }
+
+    SECTION("Seeds and jumps") {
+        xoshiro256ss a(42), b(42), c(43);
+        REQUIRE(a() == b());
+        REQUIRE(a() != c());
+
+
+        // split hands out the stream as it was and jumps past it
+        xoshiro256ss jumped(42), fresh(42), expected(42);
+        xoshiro256ss stream = jumped.split();
+        expected.jump();
+        REQUIRE(stream() == fresh());
+        REQUIRE(jumped() == expected());
+        REQUIRE(jumped() != stream());
+    }
+
+    SECTION("Uniforms") {
+        xoshiro256ss rng(7);
+        std::vector<float> draws(10001);
+        rng.uniform(draws);
+        REQUIRE(*std::min_element(draws.begin(), draws.end()) >= 0.f);
+        REQUIRE(*std::max_element(draws.begin(), draws.end()) < 1.f);
+        double sum = 0.0;
+        for (float f : draws) sum += f;
+        REQUIRE(sum / draws.size() == Approx(0.5).margin(0.01));
+
+        std::vector<size_t> hits(5, 0);
+        for (size_t i = 0; i < 10000; ++i) ++hits[rng.below(5)];
+        for (size_t h : hits) REQUIRE(h == Approx(2000).margin(200));
+    }
 }
 
 // wrapper for bomb_data for use by the optimiser
@@ -366,6 +1279,61 @@ float_wrap opt_fun(const std::vector<float>& in_args, const std::tuple<>&) {
     return {val};
 }
 
+TEST_CASE("Surrogate") {
+    surrogate model(64, 4);
+    std::vector<float> scale = {1.f, 1.f};
+    float mean, sd;
+
+    SECTION("Needs enough results to guess") {
+        model.add({0.f, 0.f}, 1.f);
+        model.add({1.f, 0.f}, 1.f);
+        REQUIRE(!model.predict({0.5f, 0.f}, scale, mean, sd));
+    }
+
+    SECTION("Predicts from nearby results") {
+        // rating = x + 2y on a grid
+        for (int x = 0; x < 8; ++x) {
+            for (int y = 0; y < 8; ++y) {
+                model.add({x / 7.f, y / 7.f}, x / 7.f + 2.f * y / 7.f);
+            }
+        }
+        REQUIRE(model.size() == 64);
+        REQUIRE(model.predict({0.5f, 0.5f}, scale, mean, sd));
+        REQUIRE(mean == Approx(1.5f).margin(0.1f));
+        REQUIRE(model.predict({0.1f, 0.9f}, scale, mean, sd));
+        REQUIRE(mean == Approx(1.9f).margin(0.15f));
+
+        // a flat region is predicted confidently, a sloped one less so
+        surrogate flat(64, 4);
+        for (int x = 0; x < 8; ++x) {
+            for (int y = 0; y < 8; ++y) {
+                flat.add({x / 7.f, y / 7.f}, 3.f);
+            }
+        }
+        float flat_mean, flat_sd;
+        REQUIRE(flat.predict({0.5f, 0.5f}, scale, flat_mean, flat_sd));
+        REQUIRE(flat_mean == Approx(3.f));
+        REQUIRE(flat_sd < sd);
+
+        // ignored dimensions don't count towards distance: this looks only at y = 0, where ratings are x
+        REQUIRE(model.predict({100.f, 0.f}, {0.f, 1.f}, mean, sd));
+        REQUIRE(mean >= 0.f);
+        REQUIRE(mean <= 1.f);
+    }
+
+    SECTION("Keeps the last results") {
+        for (int i = 0; i < 100; ++i) {
+            model.add({i / 100.f, 0.f}, i);
+        }
+        REQUIRE(model.size() == 64);
+        REQUIRE(model.predict({0.99f, 0.f}, scale, mean, sd));
+        REQUIRE(mean == Approx(98.f).margin(1.5f));
+        // the oldest results are gone, so the nearest to 0 are the oldest kept
+        REQUIRE(model.predict({0.f, 0.f}, scale, mean, sd));
+        REQUIRE(mean == Approx(37.5f).margin(1.5f));
+    }
+}
+
 TEST_CASE("Optimiser validation") {
     SECTION("Coordinate descent") {
         SECTION("Sine wave optimisation") {
@@ -439,4 +1407,385 @@ TEST_CASE("Optimiser validation") {
             }
         }
     }
+
+    SECTION("Multithreaded") {
+        optimiser<std::tuple<>, float_wrap>
+        optim(opt_fun,
+            {0.f, -0.5f},
+            {1.f, 1.5f},
+            true,
+            std::make_tuple(),
+            as_seconds(0.05f),
+            5,
+            0.5f);
+        optim.poll_spacing = as_seconds(0.005f);
+        optim.n_threads = 4;
+
+        optim.find_best();
+        REQUIRE(optim.best_result.valid());
+        REQUIRE(optim.best_arg[0] == Approx(0.292f).epsilon(0.01f));
+        REQUIRE(optim.best_arg[1] == Approx(0.f).margin(0.01f));
+        REQUIRE(optim.best_result.data == Approx(1.092f).epsilon(0.01f));
+    }
+
+    SECTION("Island migration") {
+        optimiser<std::tuple<>, float_wrap>
+        optim(opt_fun,
+            {0.f, -0.5f},
+            {1.f, 1.5f},
+            true,
+            std::make_tuple(),
+            as_seconds(0.05f),
+            5,
+            0.5f);
+        optim.poll_spacing = as_seconds(0.005f);
+        optim.migration_spacing = 2;
+
+        SECTION("Migrants replace the worst members") {
+            using sampler_t = optimiser<std::tuple<>, float_wrap>::sampler;
+            sampler_t from(optim, 0), to(optim, 1);
+            optim.islands = {&from, &to};
+            for (sampler_t* samp : optim.islands) {
+                samp->reset(optim.lower_bounds, optim.upper_bounds);
+                samp->until = main_clock.now();
+                samp->do_sampling();
+            }
+
+            size_t best = std::max_element(from.fitness.begin(), from.fitness.end(), [](const float_wrap& a, const float_wrap& b) { return b > a; }) - from.fitness.begin();
+            float to_worst = std::min_element(to.fitness.begin(), to.fitness.end(), [](const float_wrap& a, const float_wrap& b) { return b > a; })->data;
+            from.emigrate();
+            REQUIRE(to.mailbox.load() != nullptr);
+            REQUIRE(from.mailbox.load() == nullptr);
+
+            to.immigrate();
+            REQUIRE(to.mailbox.load() == nullptr);
+            if (from.fitness[best].data > to_worst) {
+                REQUIRE(std::find(to.population.begin(), to.population.end(), from.population[best]) != to.population.end());
+            }
+            // nothing gets evaluated again
+            REQUIRE(to.sample_count == optim.pop_size);
+            optim.islands.clear();
+        }
+
+        SECTION("Islands find the optimum") {
+            optim.n_threads = 4;
+            SECTION("Ring") {}
+            SECTION("Random") {
+                optim.migration_topology = decltype(optim)::topology::random;
+            }
+
+            optim.find_best();
+            REQUIRE(optim.best_result.valid());
+            REQUIRE(optim.best_arg[0] == Approx(0.292f).epsilon(0.01f));
+            REQUIRE(optim.best_arg[1] == Approx(0.f).margin(0.01f));
+            REQUIRE(optim.best_result.data == Approx(1.092f).epsilon(0.01f));
+        }
+    }
+
+    SECTION("Shared population") {
+        using shared_population = optimiser<std::tuple<>, float_wrap>::shared_population;
+
+        SECTION("Members are read back as written") {
+            xoshiro256ss rng(0);
+            shared_population pop(8, std::vector<float>(20, 0.f), std::vector<float>(20, 1.f), rng);
+            REQUIRE((uintptr_t)&pop.coord(1, 0) % 64 == 0);
+            REQUIRE((uintptr_t)&pop.members[1] % 64 == 0);
+
+            std::vector<float> at(20), out(20);
+            for (size_t j = 0; j < 20; ++j) at[j] = j * 0.05f;
+            bool evaluated;
+            uint32_t seq = pop.read(3, out, evaluated);
+            REQUIRE(!evaluated);
+
+            uint32_t was = pop.hold(3);
+            REQUIRE(was == seq);
+            REQUIRE((pop.members[3].seq & 1));
+            pop.write(3, at);
+            pop.members[3].evaluated = true;
+            pop.release(3, was);
+
+            REQUIRE(pop.read(3, out, evaluated) == seq + 2);
+            REQUIRE(evaluated);
+            REQUIRE(out == at);
+        }
+
+        SECTION("Threads find the optimum") {
+            optimiser<std::tuple<>, float_wrap>
+            optim(opt_fun,
+                {0.f, -0.5f},
+                {1.f, 1.5f},
+                true,
+                std::make_tuple(),
+                as_seconds(0.05f),
+                5,
+                0.5f);
+            optim.poll_spacing = as_seconds(0.005f);
+            optim.n_threads = 4;
+            optim.share_population = true;
+
+            optim.find_best();
+            REQUIRE(optim.best_result.valid());
+            REQUIRE(optim.best_arg[0] == Approx(0.292f).epsilon(0.01f));
+            REQUIRE(optim.best_arg[1] == Approx(0.f).margin(0.01f));
+            REQUIRE(optim.best_result.data == Approx(1.092f).epsilon(0.01f));
+        }
+    }
+
+    SECTION("SHADE") {
+        optimiser<std::tuple<>, float_wrap>
+        optim(opt_fun,
+            {0.f, -0.5f},
+            {1.f, 1.5f},
+            true,
+            std::make_tuple(),
+            as_seconds(0.05f),
+            5,
+            0.5f);
+        optim.poll_spacing = as_seconds(0.01f);
+        optim.de_strategy = decltype(optim)::strategy::shade;
+
+        SECTION("Learns F and CR") {
+            optimiser<std::tuple<>, float_wrap>::sampler samp(optim);
+            samp.reset(optim.lower_bounds, optim.upper_bounds);
+            samp.until = main_clock.now() + as_seconds(0.01f);
+            samp.do_sampling();
+
+            REQUIRE(samp.memory_F.size() == optim.history_size);
+            bool learnt = false;
+            for (size_t h = 0; h < optim.history_size; ++h) {
+                learnt |= samp.memory_F[h] != optim.mutation_factor || samp.memory_CR[h] != optim.crossover_prob;
+                REQUIRE(samp.memory_F[h] > 0.f);
+                REQUIRE(samp.memory_F[h] <= 1.f);
+                REQUIRE(samp.memory_CR[h] >= 0.f);
+                REQUIRE(samp.memory_CR[h] <= 1.f);
+            }
+            REQUIRE(learnt);
+            REQUIRE(samp.archive.size() <= optim.pop_size);
+            for (const std::vector<float>& member : samp.population) {
+                REQUIRE(member[0] >= 0.f);
+                REQUIRE(member[0] <= 1.f);
+                REQUIRE(member[1] >= -0.5f);
+                REQUIRE(member[1] <= 1.5f);
+            }
+        }
+
+        SECTION("Maximisation") {
+            optim.find_best();
+            REQUIRE(optim.best_result.valid());
+            REQUIRE(optim.best_arg[0] == Approx(0.292f).epsilon(0.01f));
+            REQUIRE(optim.best_arg[1] == Approx(0.f).margin(0.01f));
+            REQUIRE(optim.best_result.data == Approx(1.092f).epsilon(0.01f));
+        }
+    }
+
+    SECTION("Surrogate prescreening") {
+        optimiser<std::tuple<>, float_wrap>
+        optim(opt_fun,
+            {0.f, -0.5f},
+            {1.f, 1.5f},
+            true,
+            std::make_tuple(),
+            as_seconds(0.05f),
+            5,
+            0.5f);
+        optim.poll_spacing = as_seconds(0.01f);
+        optim.surrogate_points = 256;
+
+        optimiser<std::tuple<>, float_wrap>::sampler samp(optim);
+        samp.reset(optim.lower_bounds, optim.upper_bounds);
+        samp.until = main_clock.now() + as_seconds(0.01f);
+        samp.do_sampling();
+        REQUIRE(samp.model->size() > 0);
+        REQUIRE(samp.skipped_count > 0);
+
+        optim.find_best();
+        REQUIRE(optim.best_result.valid());
+        REQUIRE(optim.best_arg[0] == Approx(0.292f).epsilon(0.01f));
+        REQUIRE(optim.best_arg[1] == Approx(0.f).margin(0.01f));
+        REQUIRE(optim.best_result.data == Approx(1.092f).epsilon(0.01f));
+    }
+
+    SECTION("Seeded sample budget") {
+        auto run = [](size_t threads, uint64_t seed) {
+            std::atomic<size_t> samples = 0;
+            optimiser<std::tuple<>, float_wrap>
+            optim([&samples](const std::vector<float>& in, std::tuple<> args) { ++samples; return opt_fun(in, args); },
+                {0.f, -0.5f},
+                {1.f, 1.5f},
+                true,
+                std::make_tuple(),
+                as_seconds(0.f),
+                5,
+                0.5f);
+            optim.n_threads = threads;
+            // migrants move between rounds too
+            optim.migration_spacing = 2;
+            optim.de_strategy = decltype(optim)::strategy::shade;
+            optim.max_samples = 20000;
+            optim.seed = seed;
+            optim.find_best();
+            // the same budget is the same number of evaluations
+            REQUIRE(samples == optim.max_samples);
+            return std::make_pair(optim.best_arg, optim.best_result.data);
+        };
+
+        for (size_t threads : {1, 4}) {
+            auto first = run(threads, 1234);
+            REQUIRE(first.first[0] == Approx(0.292f).epsilon(0.01f));
+            REQUIRE(first.first[1] == Approx(0.f).margin(0.01f));
+            REQUIRE(first.second == Approx(1.092f).epsilon(0.01f));
+            // bit for bit, even if threads finish in another order
+            REQUIRE(run(threads, 1234) == first);
+        }
+    }
+
+    SECTION("Persistent population") {
+        optimiser<std::tuple<>, float_wrap>
+        optim(opt_fun,
+            {0.f, -0.5f},
+            {1.f, 1.5f},
+            true,
+            std::make_tuple(),
+            as_seconds(0.05f),
+            5,
+            0.5f);
+
+        // until is already past, so do_sampling() only sets up the population
+        optimiser<std::tuple<>, float_wrap>::sampler samp(optim);
+        samp.reset(optim.lower_bounds, optim.upper_bounds);
+        samp.until = main_clock.now();
+
+        samp.do_sampling();
+        REQUIRE(samp.population.size() == optim.pop_size);
+        REQUIRE(samp.sample_count == optim.pop_size);
+        std::vector<std::vector<float>> first_population = samp.population;
+
+        // same bounds: nothing gets re-evaluated
+        samp.do_sampling();
+        REQUIRE(samp.sample_count == optim.pop_size);
+        REQUIRE(samp.population == first_population);
+
+        // zoomed bounds: only members outside the new bounds get moved and re-evaluated
+        samp.reset({0.25f, 0.f}, {0.75f, 1.f});
+        size_t outside = 0;
+        for (const std::vector<float>& member : first_population) {
+            outside += member[0] < 0.25f || member[0] > 0.75f || member[1] < 0.f || member[1] > 1.f;
+        }
+        samp.do_sampling();
+        REQUIRE(samp.sample_count == optim.pop_size + outside);
+        for (size_t i = 0; i < samp.population.size(); ++i) {
+            REQUIRE(samp.population[i][0] >= 0.25f);
+            REQUIRE(samp.population[i][0] <= 0.75f);
+            REQUIRE(samp.population[i][1] >= 0.f);
+            REQUIRE(samp.population[i][1] <= 1.f);
+            REQUIRE(samp.fitness[i].data == opt_fun(samp.population[i], {}).data);
+        }
+    }
+}
+
+TEST_CASE("CMA-ES") {
+    SECTION("Sine wave optimisation") {
+        cmaes<std::tuple<>, float_wrap>
+        optim(opt_sine,
+            {-M_PI * 0.5f},
+            {M_PI * 0.5f},
+            true,
+            std::make_tuple(),
+            as_seconds(0.01f));
+
+        SECTION("Maximisation") {
+            optim.find_best();
+            REQUIRE(optim.best_result.valid());
+            REQUIRE(optim.best_arg[0] == Approx(M_PI * 0.5f).epsilon(0.01f));
+            REQUIRE(optim.best_result.data == Approx(1.f).epsilon(0.01f));
+        }
+
+        SECTION("Minimisation") {
+            optim.maximise = false;
+            optim.find_best();
+            REQUIRE(optim.best_result.valid());
+            REQUIRE(optim.best_arg[0] == Approx(-M_PI * 0.5f).epsilon(0.01f));
+            REQUIRE(optim.best_result.data == Approx(-1.f).epsilon(0.01f));
+        }
+    }
+
+    SECTION("2-variable optimisation") {
+        cmaes<std::tuple<>, float_wrap>
+        optim(opt_fun,
+            {0.f, -0.5f},
+            {1.f, 1.5f},
+            true,
+            std::make_tuple(),
+            as_seconds(0.05f));
+
+        SECTION("Single thread") {}
+        SECTION("Multithreaded") {
+            optim.n_threads = 4;
+        }
+
+        optim.find_best();
+        REQUIRE(optim.best_result.valid());
+        REQUIRE(optim.best_arg[0] == Approx(0.292f).epsilon(0.01f));
+        REQUIRE(optim.best_arg[1] == Approx(0.f).margin(0.01f));
+        REQUIRE(optim.best_result.data == Approx(1.092f).epsilon(0.01f));
+        // converged runs get restarted with bigger generations
+        REQUIRE(optim.restarts > 0);
+    }
+
+    SECTION("Seeded sample budget") {
+        auto run = [](uint64_t seed) {
+            cmaes<std::tuple<>, float_wrap>
+            optim(opt_fun,
+                {0.f, -0.5f},
+                {1.f, 1.5f},
+                true,
+                std::make_tuple(),
+                as_seconds(0.f));
+            optim.n_threads = 4;
+            optim.max_samples = 5000;
+            optim.seed = seed;
+            optim.find_best();
+            REQUIRE(optim.sample_count >= optim.max_samples);
+            return std::make_pair(optim.best_arg, optim.best_result.data);
+        };
+
+        auto first = run(1234);
+        REQUIRE(first.second == Approx(1.092f).epsilon(0.01f));
+        REQUIRE(run(1234) == first);
+    }
+
+    SECTION("Fixed dimensions stay put") {
+        cmaes<std::tuple<>, float_wrap>
+        optim(opt_fun,
+            {0.f, 0.75f},
+            {1.f, 0.75f},
+            true,
+            std::make_tuple(),
+            as_seconds(0.01f));
+
+        optim.find_best();
+        REQUIRE(optim.best_result.valid());
+        REQUIRE(optim.best_arg[1] == 0.75f);
+    }
+
+    SECTION("Covariance decomposition") {
+        cmaes<std::tuple<>, float_wrap>
+        optim(opt_fun, {0.f, 0.f, 0.f}, {1.f, 1.f, 1.f}, true, std::make_tuple(), as_seconds(0.f));
+        optim.n = 3;
+        optim.B.assign(9, 0.0);
+        optim.D.assign(3, 0.0);
+        optim.C = {4.0, 1.0, 0.5,
+                   1.0, 3.0, 0.2,
+                   0.5, 0.2, 2.0};
+        optim.eigen_decompose();
+
+        // B diag(D)^2 B^T gives C back
+        for (size_t i = 0; i < 3; ++i) {
+            for (size_t j = 0; j < 3; ++j) {
+                double c = 0.0;
+                for (size_t k = 0; k < 3; ++k) c += optim.B[i * 3 + k] * optim.D[k] * optim.D[k] * optim.B[j * 3 + k];
+                REQUIRE(c == Approx(optim.C[i * 3 + j]).margin(1e-9));
+            }
+        }
+    }
 }